@@ -0,0 +1,8 @@
+#ifndef __AUDIO_CONFIG_H__
+#define __AUDIO_CONFIG_H__
+
+#include "usb.h"
+
+USB_Implementation AUDIO_GetImplementation();
+
+#endif
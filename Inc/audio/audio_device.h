@@ -0,0 +1,78 @@
+#ifndef __AUDIO_DEVICE_H
+#define __AUDIO_DEVICE_H
+
+#include "usb.h"
+#include "audio/audio_sai.h"
+
+// 48 kHz, playback 2 x 16 bit, capture 1 x 16 bit. Asynchronous packets carry 47 - 49 frames
+#define AUDIO_RATE 48000
+#define AUDIO_NOMINAL_FRAMES 48
+#define AUDIO_MAX_FRAMES 49
+#define AUDIO_PLAY_FRAME 4
+#define AUDIO_CAPTURE_FRAME 2
+
+#define AUDIO_EP_PLAY 1
+#define AUDIO_EP_FEEDBACK 2
+#define AUDIO_EP_CAPTURE 3
+
+// Entities of the topology: clock -> USB IN terminal -> feature unit -> speaker, microphone -> USB OUT terminal
+#define AUDIO_ID_CLOCK 1
+#define AUDIO_ID_PLAY_USB 2
+#define AUDIO_ID_VOLUME 3
+#define AUDIO_ID_PLAY_OUT 4
+#define AUDIO_ID_MIC 5
+#define AUDIO_ID_CAPTURE_USB 6
+
+#define AUDIO_REQUEST_CUR 0x01
+#define AUDIO_REQUEST_RANGE 0x02
+#define AUDIO_CS_SAM_FREQ 0x01
+#define AUDIO_CS_CLOCK_VALID 0x02
+#define AUDIO_FU_MUTE 0x01
+#define AUDIO_FU_VOLUME 0x02
+
+// Volume range in 1/256 dB, steps of 1 dB
+#define AUDIO_VOLUME_MIN (-60 * 256)
+#define AUDIO_VOLUME_MAX 0
+#define AUDIO_VOLUME_RES 256
+
+// Playback fill level in frames the feedback steers to, measured right before a packet is added
+#ifndef AUDIO_TARGET_FRAMES
+#define AUDIO_TARGET_FRAMES 24
+#endif
+
+// The feedback is averaged over 2^AUDIO_FEEDBACK_SHIFT frames
+#ifndef AUDIO_FEEDBACK_SHIFT
+#define AUDIO_FEEDBACK_SHIFT 6
+#endif
+
+// Vendor request to the device returning AUDIO_Stats, wValue = 1 clears the counters afterwards
+#define AUDIO_STATS_REQUEST 0xA0
+
+typedef struct {
+    unsigned int PlayPackets;
+    unsigned int PlayFrames;
+    unsigned int PlayUnderruns;   // The SAI caught up with the packets, silence was played
+    unsigned int PlayOverruns;    // Packets dropped because the ring was full
+    unsigned int CapturePackets;
+    unsigned int CaptureFrames;
+    unsigned int CaptureShort;    // Packets with less than 47 frames
+    unsigned int CaptureOverruns; // Frames skipped because the host did not fetch them
+    unsigned int SaiErrors;       // FIFO over- & underruns of the SAI blocks
+    unsigned int Feedback;        // Last feedback value, frames per ms in 10.14
+    int PlayLevel;                // Ring fill level in frames before the last packet
+    unsigned int SofJitter;       // ns the last SOF interrupt was off the 1 ms period
+    unsigned int SofMaxJitter;
+} AUDIO_Stats;
+
+/// @brief Clear the rings and start the SAI
+void AUDIO_Init();
+/// @brief Take a playback packet into the ring, RX callback of the isochronous OUT endpoint
+void AUDIO_HandlePlayback(unsigned char ep, short length);
+/// @brief Update the feedback and queue the next capture packet, called on every SOF
+void AUDIO_Sof(unsigned short frame);
+char AUDIO_SetupPacket(USB_SETUP_PACKET *setup, const unsigned char *data, short length);
+void AUDIO_Reset(char interface, char alternateId);
+/// @brief Get the streaming counters
+const AUDIO_Stats *AUDIO_GetStats();
+
+#endif
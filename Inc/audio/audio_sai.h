@@ -0,0 +1,25 @@
+#ifndef __AUDIO_SAI_H
+#define __AUDIO_SAI_H
+
+#include "platform.h"
+
+// Stereo frames of 32 bit slots in each circular DMA ring, the SAI reads & writes them directly.
+// 88 frames are 1.83 ms at 48 kHz, room for one packet of 49 frames above the fill level kept by the feedback
+#ifndef AUDIO_RING_FRAMES
+#define AUDIO_RING_FRAMES 88
+#endif
+
+/// @brief Set up SAI1 as I2S slave of the codec and start both DMA rings
+/// @param playback Ring of AUDIO_RING_FRAMES * 2 slots sent by block A on PA10
+/// @param capture Ring of AUDIO_RING_FRAMES * 2 slots received by block B on PB5
+/// @remark The codec is the clock master, SCK on PA8 and FS on PB9. Without it both rings stand still
+void AUDIO_Sai_Init(int *playback, int *capture);
+/// @brief Get the frame the playback DMA reads next
+unsigned short AUDIO_Sai_PlaybackPosition();
+/// @brief Get the frame the capture DMA writes next, all frames before it are complete
+unsigned short AUDIO_Sai_CapturePosition();
+/// @brief Check & clear the FIFO over- / underrun flags of both blocks
+/// @return The number of blocks that had an error
+char AUDIO_Sai_CheckErrors();
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef __BOOT_H_
+#define __BOOT_H_
+
+#include "platform.h"
+
+// Vendor request to the device: IN returns the BOOT_PHASES timestamps as unsigned int
+#define BOOT_REQUEST 0xE4
+
+typedef enum {
+    BOOT_MAIN,       // Startup code done (.data, .bss, CCM-SRAM), main entered
+    BOOT_CLOCK,      // Clock profile running, timebase started
+    BOOT_PULLUP,     // D+ pull-up enabled
+    BOOT_RESET,      // First bus reset
+    BOOT_SETUP,      // First SETUP packet
+    BOOT_ADDRESS,    // SET_ADDRESS
+    BOOT_CONFIGURED, // SET_CONFIGURATION
+    BOOT_NETWORK,    // lwIP & the NCM interface up
+    BOOT_PHASES
+} BOOT_PHASE;
+
+/// @brief Start the cycle counter, called by the reset handler before .data & .bss are initialized
+/// @remark Does not touch any variable. The stm32f042 has no cycle counter, its timestamps start at Timebase_Init
+void BOOT_Start();
+/// @brief Record the microseconds since reset at which a phase was reached, only the first call per phase counts
+/// @remark BOOT_CLOCK has to be marked after Timebase_Init and before Cycles_Init clears the cycle counter
+void BOOT_Mark(BOOT_PHASE phase);
+/// @brief Get the timestamps of all phases in microseconds since reset, 0 if not reached yet
+const unsigned int *BOOT_GetTimes();
+
+#endif
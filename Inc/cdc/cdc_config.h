@@ -4,6 +4,19 @@
 #include "usb.h"
 #include "platform.h"
 
+// Length of the descriptors of one port: IAD, both interfaces, the functional descriptors & three endpoints
+#define CDC_FUNCTION_LENGTH 61
+
 USB_Implementation CDC_GetImplementation();
+/// @brief Write the interface association and all descriptors of one ACM port
+/// @param buffer Target for the descriptors
+/// @param size Size of the buffer
+/// @param port The CDC port
+/// @return Number of bytes written
+unsigned short CDC_BuildFunction(unsigned char *buffer, unsigned short size, unsigned char port);
+/// @brief Get the notification & data endpoint configuration of a port
+/// @param endpoints Target for two endpoint configurations
+/// @param port The CDC port
+void CDC_GetEndpoints(USB_CONFIG_EP *endpoints, unsigned char port);
 
 #endif
@@ -8,7 +8,87 @@
 #define CDC_CONFIG_GETLINECODING 0x21
 #define CDC_CONFIG_CONTROLLINESTATE 0x22
 
+typedef struct {
+    unsigned int BaudRate;
+    unsigned char StopBits; // 0: 1, 1: 1.5, 2: 2 stop bits
+    unsigned char Parity;   // 0: none, 1: odd, 2: even, 3: mark, 4: space
+    unsigned char DataBits;
+} CDC_LINECODING;
+
+// Ring buffer sizes, both have to be a power of two
+#ifndef CDC_RX_BUFFER
+#define CDC_RX_BUFFER 256
+#endif
+#ifndef CDC_TX_BUFFER
+#define CDC_TX_BUFFER 512
+#endif
+#define CDC_PACKET_SIZE 64
+
+// Number of ACM ports, each behind its own interface association. Every port takes two endpoints (notification &
+// data) and the hardware has seven besides EP0, so three is the limit
+#ifndef CDC_PORTS
+#define CDC_PORTS 1
+#endif
+
+#if CDC_PORTS < 1 || CDC_PORTS > 3
+#error "CDC_PORTS has to be 1 to 3"
+#endif
+
+// Interfaces & endpoints of a port: communication interface 2n, data interface 2n + 1, notification EP 2n + 1 and
+// data EP 2n + 2 (IN & OUT)
+#ifndef CDC_INTERFACE_BASE
+#define CDC_INTERFACE_BASE 0
+#endif
+#define CDC_PORT_INTERFACE(n) (CDC_INTERFACE_BASE + 2 * (n))
+#define CDC_PORT_NOTIFY_EP(n) (2 * (n) + 1)
+#define CDC_PORT_DATA_EP(n) (2 * (n) + 2)
+
+/// @brief Assign interfaces & endpoints to the ports, called by CDC_GetImplementation
+void CDC_Init();
+/// @brief Move the data endpoints, see USB_Implementation.RemapEndpoints_Handler
+void CDC_RemapEndpoints(const unsigned char *map);
+
+/// @brief Read received data
+/// @param port The CDC port
+/// @param data Buffer to copy the data to
+/// @param length Size of the buffer
+/// @return Number of bytes copied
+/// @remark Reading releases the OUT endpoint again if the ring was full
+short CDC_Read(unsigned char port, char *data, short length);
+/// @brief Get the received data without copying it
+/// @param length Will contain the number of contiguous bytes at the returned position
+/// @return The oldest received byte, valid until it is released by CDC_Consume
+const char *CDC_Peek(unsigned char port, short *length);
+/// @brief Release data returned by CDC_Peek
+/// @param length Number of bytes that were used
+void CDC_Consume(unsigned char port, short length);
+/// @brief Get the number of bytes waiting to be read
+short CDC_Available(unsigned char port);
+/// @brief Queue data for sending
+/// @param data The data to send
+/// @param length Number of bytes to send
+/// @return Number of bytes queued, less than length if the ring is full
+/// @remark Queued data is sent from the TX-complete interrupt until the ring is empty
+short CDC_Write(unsigned char port, const char *data, short length);
+/// @brief Get the number of bytes CDC_Write would accept
+short CDC_WriteSpace(unsigned char port);
+/// @brief Drop all buffered data
+/// @remark Also called when the host opens the port (SET_CONTROL_LINE_STATE)
+void CDC_Reset(unsigned char port);
+
+/// @brief Get notified when the host changes the line coding
+/// @remark Called from the USB-ISR, return USB_ERR to refuse the line coding
+void CDC_SetLineCodingHandler(unsigned char port, char (*handler)(const CDC_LINECODING *coding));
+/// @brief Pass received data to a function instead of buffering it
+/// @remark Called from the USB-ISR, the data is only valid until the handler returns
+void CDC_SetReceiveHandler(unsigned char port, void (*handler)(const char *data, short length));
+/// @brief Get notified right before CDC_Reset drops the rings
+/// @remark Called with interrupts disabled, a consumer of CDC_Peek has to stop using its block and must not call
+/// CDC_Consume for it afterwards
+void CDC_SetResetHandler(unsigned char port, void (*handler)());
+
 char CDC_SetupPacket(USB_SETUP_PACKET *setup, char* data, short length);
 void CDC_HandlePacket(unsigned char ep, short length);
+void CDC_TransmitComplete(unsigned char ep, short length);
 
 #endif
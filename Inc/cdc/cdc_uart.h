@@ -0,0 +1,32 @@
+#ifndef __CDC_UART_H
+#define __CDC_UART_H
+
+#include "cdc/cdc_device.h"
+
+// CDC port bridged to the UART
+#ifndef CDC_UART_PORT
+#define CDC_UART_PORT 0
+#endif
+
+// UART4 on PC10 (TX) & PC11 (RX), received bytes go through this circular DMA buffer
+#ifndef CDC_UART_RX_DMA
+#define CDC_UART_RX_DMA 1024
+#endif
+
+typedef struct {
+    unsigned int RxBytes;  // Bytes received on the UART and queued for the host
+    unsigned int TxBytes;  // Bytes sent on the UART
+    unsigned int Dropped;  // Received bytes that did not fit into the CDC TX ring
+    unsigned int Overruns; // Hardware overruns, the DMA did not keep up
+    unsigned int Framing;  // Framing, noise & parity errors
+} CDC_UartStats;
+
+/// @brief Set up UART4 & its DMA channels and bridge them to the CDC data interface
+/// @remark The UART follows SET_LINE_CODING, the rings of cdc_device buffer both directions
+void CDC_Uart_Init();
+/// @brief Start sending data received from the host, if the UART is idle
+void CDC_Uart_Loop();
+/// @brief Get the bridge counters
+const CDC_UartStats *CDC_Uart_GetStats();
+
+#endif
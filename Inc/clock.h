@@ -0,0 +1,33 @@
+#ifndef __CLOCK_H_
+#define __CLOCK_H_
+
+#include "stm32.h"
+
+// Clock profiles, select one with CLOCK_PROFILE. USB always runs from the HSI48 trimmed to the SOFs by the CRS, so it stays at exactly 48 MHz
+//  stm32g4:  LOW 25 MHz (HSE), BALANCED 71.875 MHz (PLL / AHB 2), PERFORMANCE 170 MHz (PLL, range 1 boost)
+//  stm32f042: LOW & BALANCED 8 MHz (HSI), PERFORMANCE 48 MHz (HSI48)
+#define CLOCK_PROFILE_LOW 1
+#define CLOCK_PROFILE_BALANCED 2
+#define CLOCK_PROFILE_PERFORMANCE 3
+
+#ifndef CLOCK_PROFILE
+#define CLOCK_PROFILE CLOCK_PROFILE_BALANCED
+#endif
+
+#pragma pack(1)
+typedef struct {
+    unsigned char Profile;      // CLOCK_PROFILE_x
+    unsigned char FlashLatency; // Wait states
+    unsigned char Boost;        // 1 if the core regulator runs in range 1 boost mode
+    unsigned char Caches;       // 1 if prefetch & the flash caches are on
+    unsigned int CoreClock;     // Hz
+} CLOCK_INFO;
+#pragma pack()
+
+/// @brief Switch to the clock profile selected by CLOCK_PROFILE and enable the USB & GPIOA clocks
+/// @remark Sets the flash wait states before raising the clock, updates SystemCoreClock
+void CLOCK_Init();
+/// @brief Get the running profile, for benchmarks to normalize their results
+const CLOCK_INFO *CLOCK_GetInfo();
+
+#endif
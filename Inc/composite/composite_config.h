@@ -0,0 +1,20 @@
+#ifndef __COMPOSITE_CONFIG_H__
+#define __COMPOSITE_CONFIG_H__
+
+#include "usb.h"
+#include "platform.h"
+
+#define COMPOSITE_MAX_FUNCTIONS 4
+#define COMPOSITE_MAX_INTERFACES 8
+#define COMPOSITE_MAX_DESCRIPTOR 384
+
+/// @brief Merge several implementations into one configuration
+/// @param implementations The implementations, each one becomes a function of the device
+/// @param count Number of implementations
+/// @return The implementation for USB_Init
+/// @remark Interfaces & endpoints are numbered in order of the functions, functions with several interfaces get an
+/// interface association. Setup packets reach the owning function with its own interface numbers, moved endpoints are
+/// announced through RemapEndpoints_Handler. Functions that do not fit into the endpoints or USB-SRAM are left out
+USB_Implementation COMPOSITE_GetImplementation(const USB_Implementation *implementations, unsigned char count);
+
+#endif
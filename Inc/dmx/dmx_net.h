@@ -0,0 +1,31 @@
+#ifndef __DMX_NET_H
+#define __DMX_NET_H
+
+#include "dmx/dmx_universe.h"
+
+#define DMX_ARTNET_PORT 6454
+#define DMX_SACN_PORT 5568
+
+// Art-Net port-address and sACN universe received into slot 0, the following slots continue from there
+#ifndef DMX_ARTNET_BASE
+#define DMX_ARTNET_BASE 0
+#endif
+#ifndef DMX_SACN_BASE
+#define DMX_SACN_BASE 1
+#endif
+
+typedef struct {
+    unsigned int ArtDmx;   // ArtDmx packets stored into a universe
+    unsigned int Sacn;     // E1.31 data packets stored into a universe
+    unsigned int Ignored;  // Valid packets for universes without a slot, previews or other start codes
+    unsigned int Invalid;  // Packets on the DMX ports that failed to parse
+    unsigned int Busy;     // Valid packets dropped while HID or the Enttec input was writing the slot
+} DMX_NetStats;
+
+/// @brief Receive Art-Net and sACN straight from the NCM NTBs into the universe slots
+/// @remark Other Art-Net opcodes are left to lwIP
+void DMX_Net_Init();
+/// @brief Get the receive counters
+const DMX_NetStats *DMX_Net_GetStats();
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef __DMX_OUTPUT_H
+#define __DMX_OUTPUT_H
+
+#include "dmx/dmx_universe.h"
+
+// USART1 (PA9), USART2 (PA2) & USART3 (PB10), each sending the universe slot of the same index
+#ifndef DMX_OUTPUT_PORTS
+#define DMX_OUTPUT_PORTS 3
+#endif
+
+// The break is a 0x00 sent at this baudrate: 9 low bits = 100us, the 2 stop bits are the first 22us of the MAB
+#define DMX_BREAK_BAUD 90000
+#define DMX_DATA_BAUD 250000
+
+typedef struct {
+    unsigned int Frames;      // Complete frames sent
+    unsigned int Updates;     // Frames that carried a new universe update
+    unsigned int LastFrameMs; // sys_now() at the start of the last frame
+    unsigned int PeriodMs;    // Duration of the last complete frame
+} DMX_OutputStats;
+
+/// @brief Configure the UARTs & DMA channels and start sending frames back to back
+void DMX_Output_Init();
+/// @brief Get the counters of an output port
+const DMX_OutputStats *DMX_Output_GetStats(unsigned char port);
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef __DMX_UNIVERSE_H
+#define __DMX_UNIVERSE_H
+
+#include "platform.h"
+
+#define DMX_CHANNELS 512
+
+// Number of universe slots kept in RAM, each takes three frames of DMX_CHANNELS
+#ifndef DMX_UNIVERSE_COUNT
+#if defined(STM32G474xx)
+#define DMX_UNIVERSE_COUNT 8
+#elif defined(STM32G441xx)
+#define DMX_UNIVERSE_COUNT 4
+#else
+#define DMX_UNIVERSE_COUNT 1
+#endif
+#endif
+
+#define DMX_FRESH 0x80
+
+// Milliseconds after which an unfinished write no longer blocks the other inputs of a slot
+#ifndef DMX_WRITER_TIMEOUT
+#define DMX_WRITER_TIMEOUT 1000
+#endif
+
+/// @brief The inputs feeding the universe slots
+typedef enum {
+    DMX_WRITER_NONE,
+    DMX_WRITER_HID,    // HID output reports, USB interrupt
+    DMX_WRITER_ENTTEC, // Enttec Pro on the CDC interface, USB interrupt, a frame spans several packets
+    DMX_WRITER_NET,    // Art-Net & sACN, main loop
+} DMX_Writer;
+
+/// @brief One universe, triple buffered between one writer at a time and a single reader
+/// @remark The writer fills Frames[Back], the reader owns Frames[Front]. Handing over a frame is a single exchange
+/// of Middle, so neither side ever waits or sees a half written frame. Several inputs may feed the same slot, they
+/// claim Writer from DMX_Universe_BeginWrite until EndWrite and a second input is turned away meanwhile
+typedef struct {
+    unsigned char Frames[3][DMX_CHANNELS];
+    unsigned short Length[3];
+    volatile unsigned char Middle; // Index of the spare frame, DMX_FRESH if it holds data the reader has not seen
+    unsigned char Back;
+    unsigned char Front;
+    unsigned char Latest;    // Index of the last published frame, only read by the writer
+    unsigned char Prepared;  // Frames[Back] already holds a copy of the latest frame
+    unsigned int Updates;    // Frames published by the writer
+    unsigned int LastUpdate; // sys_now() of the last published frame
+    volatile unsigned char Writer; // DMX_Writer currently filling Frames[Back], DMX_WRITER_NONE if none
+    unsigned int Claimed;          // sys_now() when Writer claimed the slot
+} DMX_Universe;
+
+/// @brief Reset all universe slots
+void DMX_Universe_Init();
+/// @brief Claim the slot and get the frame to write the next channel values to
+/// @param universe The universe slot
+/// @param writer The input writing the frame
+/// @return The frame buffer or 0 if the slot does not exist or another input is writing to it
+/// @remark The content is undefined, the writer has to fill in the complete frame. A claim older than
+/// DMX_WRITER_TIMEOUT is taken over, an input holding it across calls checks DMX_Universe_IsWriter before writing on
+unsigned char *DMX_Universe_BeginWrite(unsigned char universe, DMX_Writer writer);
+/// @brief Claim the slot and get the frame to change some of the channel values in
+/// @param universe The universe slot
+/// @param writer The input writing the frame
+/// @return The frame buffer, holding the latest published values, or 0 if the slot does not exist or another input
+/// is writing to it
+unsigned char *DMX_Universe_BeginUpdate(unsigned char universe, DMX_Writer writer);
+/// @brief Publish the frame returned by DMX_Universe_BeginWrite or BeginUpdate to the reader and release the slot
+/// @param universe The universe slot
+/// @param writer The input that claimed the slot, nothing is published if it lost the claim
+/// @param length The number of valid channels in the frame
+void DMX_Universe_EndWrite(unsigned char universe, DMX_Writer writer, unsigned short length);
+/// @brief Release the slot without publishing the frame
+/// @param universe The universe slot
+/// @param writer The input that claimed the slot
+void DMX_Universe_Abort(unsigned char universe, DMX_Writer writer);
+/// @brief Whether the input still holds the claim of the slot
+char DMX_Universe_IsWriter(unsigned char universe, DMX_Writer writer);
+/// @brief Get the latest frame of a universe
+/// @param universe The universe slot
+/// @param length Will contain the number of valid channels
+/// @return The frame, valid until the next call for this universe. 0 if the slot does not exist
+/// @remark May be called from an interrupt, but only from one context per universe. The same holds for the writer:
+/// each universe is written by one claiming input at a time, while the reader and writer never lock each other out
+const unsigned char *DMX_Universe_Read(unsigned char universe, unsigned short *length);
+/// @brief Whether a frame was published since the last DMX_Universe_Read
+char DMX_Universe_HasUpdate(unsigned char universe);
+/// @brief Get the bookkeeping of a universe slot
+const DMX_Universe *DMX_Universe_Get(unsigned char universe);
+
+#endif
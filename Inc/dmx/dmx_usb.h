@@ -0,0 +1,32 @@
+#ifndef __DMX_USB_H
+#define __DMX_USB_H
+
+#include "dmx/dmx_universe.h"
+
+// HID output report: the first byte selects the universe (bits 4 - 6) and the block of 32 channels (low nibble).
+// Blocks are collected in one frame until a report with DMX_HID_COMMIT publishes it
+#define DMX_HID_BLOCK 32
+#define DMX_HID_COMMIT 0x80
+
+// GET_REPORT (feature) with the universe as report ID returns DMX_HidStatus, read by Tools/dmx_hid_check.py
+#define DMX_HID_FEATURE 3
+
+typedef struct {
+    unsigned int Updates;    // Frames published to the universe
+    unsigned short Length;   // Channels of the latest frame
+    unsigned short Checksum; // Fletcher-16 of these channels
+} DMX_HidStatus;
+
+// Enttec DMX USB Pro framing on the CDC interface: 0x7E, label, length (LE), data, 0xE7
+#define DMX_ENTTEC_START 0x7E
+#define DMX_ENTTEC_END 0xE7
+#define DMX_ENTTEC_GETPARAMS 3
+#define DMX_ENTTEC_SENDDMX 6
+#define DMX_ENTTEC_GETSERIAL 10
+
+/// @brief Feed HID output reports and Enttec Pro frames from the CDC interface into the universe slots
+/// @remark With USB_COMPOSITE, HID, Enttec and Art-Net / sACN may feed the same slot. Each frame is written by the
+/// input that claimed the slot first, the others drop their data until it is published
+void DMX_Usb_Init();
+
+#endif
@@ -4,5 +4,7 @@
 #include "usb.h"
 
 USB_Implementation HID_GetImplementation();
+/// @brief Get the report descriptor referenced by the HID descriptor
+const char *HID_GetReportDescriptor(short *length);
 
 #endif
\ No newline at end of file
@@ -15,6 +15,14 @@
 #define HID_CLASS_SETPROTOCOL 0x0B
 
 
+/// @brief Set the function receiving every output report
+/// @remark Called from the USB-ISR, the report is only valid until the handler returns
+void HID_SetReportHandler(void (*handler)(const char *report, short length));
+/// @brief Set the function answering GET_REPORT
+/// @param handler Gets the report type (wValue high byte) & ID, returns the report or 0 to stall the request
+/// @remark Called from the USB-ISR, the returned report has to stay valid until it was sent
+void HID_SetGetReportHandler(const char *(*handler)(unsigned char type, unsigned char id, short *length));
+
 void HID_HandlePacket(unsigned char ep, short length);
 char HID_SetupPacket(USB_SETUP_PACKET *setup, char *data, short length);
 
@@ -0,0 +1,75 @@
+#ifndef __LOG_H_
+#define __LOG_H_
+
+#include "platform.h"
+
+#ifndef LOG_BUFFER
+#define LOG_BUFFER 256 // Words, power of two
+#endif
+
+#ifndef LOG_BATCH
+#define LOG_BATCH 512 // Bytes handed to the transport at once
+#endif
+
+#define LOG_MAX_ARGS 4
+#define LOG_MAGIC 0x474F4C53 // "SLOG", starts every batch
+
+typedef struct {
+    unsigned int Records;
+    unsigned int Dropped;  // Ring was full
+    unsigned int Batches;
+    unsigned int MaxUsage; // Words
+} LOG_Stats;
+
+#ifdef LOG
+#include "cdc/cdc_device.h"
+
+#ifndef LOG_CDC_PORT
+#define LOG_CDC_PORT (CDC_PORTS - 1)
+#endif
+
+// LOG_Flush writes from the main loop, it can't share a ring with the UART bridge or the Enttec replies on port 0
+#if LOG_CDC_PORT < 1 || LOG_CDC_PORT >= CDC_PORTS
+#error "The log needs a CDC port of its own, build with CDC_PORTS >= 2"
+#endif
+#ifdef CDC_UART
+#include "cdc/cdc_uart.h"
+#if LOG_CDC_PORT == CDC_UART_PORT
+#error "The log can't share its CDC port with the UART bridge"
+#endif
+#endif
+
+// The format string is placed in the non-loaded .logstr section, its address is the ID sent to the host
+#define LOG_NARGS(...) LOG_NARGS_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define LOG_NARGS_(_0, _1, _2, _3, _4, n, ...) n
+
+/// @brief Log a message, only the ID of the format string and up to four integer arguments are recorded
+/// @remark Safe from any interrupt priority. The arguments are sent as 32 bit words, so %s and floats are not supported
+#define LOG_Print(format, ...)                                                                     \
+    do {                                                                                           \
+        static const char logFormat[] __attribute__((section(".logstr"), used)) = format;          \
+        _Static_assert(LOG_NARGS(__VA_ARGS__) <= LOG_MAX_ARGS, "Too many log arguments");          \
+        LOG_Write((unsigned int)logFormat, LOG_NARGS(__VA_ARGS__), (const unsigned int[]){0, ##__VA_ARGS__} + 1); \
+    } while (0)
+
+/// @brief Append a record to the ring
+/// @param id Address of the format string in .logstr
+/// @param count Number of arguments
+/// @param args The arguments
+void LOG_Write(unsigned int id, unsigned char count, const unsigned int *args);
+
+/// @brief Send finished records to the host, call from the main loop
+void LOG_Flush();
+
+/// @brief Get the counters of the log
+const LOG_Stats *LOG_GetStats();
+
+#else
+
+#define LOG_Print(format, ...) \
+    do {                       \
+    } while (0)
+
+#endif
+
+#endif
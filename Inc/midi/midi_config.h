@@ -0,0 +1,8 @@
+#ifndef __MIDI_CONFIG_H__
+#define __MIDI_CONFIG_H__
+
+#include "usb.h"
+
+USB_Implementation MIDI_GetImplementation();
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef __MIDI_DEVICE_H
+#define __MIDI_DEVICE_H
+
+#include "usb.h"
+#include "timer.h"
+
+// One bulk endpoint pair carries all cables, a packet holds up to 16 event packets of 4 bytes
+#define MIDI_EP 1
+#define MIDI_PACKET_SIZE 64
+#define MIDI_PACKET_EVENTS (MIDI_PACKET_SIZE / 4)
+
+// Events waiting to be sent, power of two
+#ifndef MIDI_QUEUE
+#define MIDI_QUEUE 256
+#endif
+
+// Period of the timer sending partly filled packets, bounds the latency of single events while the endpoint is idle
+#ifndef MIDI_FLUSH_US
+#define MIDI_FLUSH_US 250
+#endif
+
+// Vendor request to the device returning MIDI_Stats, wValue = 1 clears the counters afterwards
+#define MIDI_STATS_REQUEST 0xA1
+
+// USB-MIDI event packet (MIDI10 chapter 4) as a little endian word: cable number & code index number, then the three MIDI bytes.
+// An event of 0 is never valid, the queue uses it to mark free slots
+#define MIDI_EVENT(cable, cin, b0, b1, b2) ((unsigned int)((((cable) & 0x0F) << 4) | ((cin) & 0x0F)) | ((b0) << 8) | ((b1) << 16) | ((unsigned int)(b2) << 24))
+#define MIDI_EVENT_CABLE(event) (((event) >> 4) & 0x0F)
+#define MIDI_EVENT_CIN(event) ((event) & 0x0F)
+
+typedef struct {
+    unsigned int RxEvents;
+    unsigned int RxPackets;
+    unsigned int TxEvents;
+    unsigned int TxPackets;
+    unsigned int TxFull;    // Packets sent with 16 events right after the previous one
+    unsigned int TxFlushed; // Partly filled packets sent by the flush timer
+    unsigned int Dropped;   // Events lost because the queue was full
+    unsigned int MaxQueued; // Events
+} MIDI_Stats;
+
+/// @brief Clear the queue and start the flush timer, called by MIDI_GetImplementation
+void MIDI_Init();
+
+/// @brief Queue an event packet for the host
+/// @param event The event, see MIDI_EVENT
+/// @return USB_OK, or USB_ERR if the queue is full and the event was dropped
+/// @remark Lock-free and safe from any interrupt priority. Events are packed into full packets while the endpoint is busy,
+/// a partly filled packet is sent by the flush timer
+char MIDI_Send(unsigned int event);
+/// @brief Queue a channel, system common or real time message, the code index number is derived from the status byte
+/// @return USB_OK, or USB_ERR for data bytes, SysEx or a full queue
+char MIDI_SendMessage(unsigned char cable, unsigned char status, unsigned char data1, unsigned char data2);
+/// @brief Get the number of events MIDI_Send would accept
+unsigned short MIDI_SendSpace();
+
+/// @brief Set the function receiving every event packet from the host
+/// @remark Called from the USB-ISR. Without a handler received events are only counted
+void MIDI_SetReceiveHandler(void (*handler)(unsigned int event));
+
+/// @brief Get the counters of the MIDI function
+const MIDI_Stats *MIDI_GetStats();
+
+char MIDI_SetupPacket(USB_SETUP_PACKET *setup, const unsigned char *data, short length);
+void MIDI_HandlePacket(unsigned char ep, short length);
+void MIDI_TransmitComplete(unsigned char ep, short length);
+void MIDI_Suspend();
+void MIDI_Wakeup();
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef __NCM_BENCH_H
+#define __NCM_BENCH_H
+
+#include "platform.h"
+
+// The iperf2 server (lwiperf) listens on TCP 5001, the rest is plain UDP
+#define NCM_BENCH_ECHO_PORT 7
+#define NCM_BENCH_SINK_PORT 9
+#define NCM_BENCH_STATS_PORT 5002
+// Raw ethernet frames of this type are echoed without lwIP (IEEE local experimental EtherType)
+#define NCM_BENCH_ETHERTYPE 0x88B5
+
+#pragma pack(1)
+/// @brief Snapshot returned on the stats port. All counters are little endian
+typedef struct {
+    unsigned int Uptime;    // ms since boot, used by the host to build rates
+    unsigned int CoreClock; // Hz, to convert cycles into time
+
+    unsigned int RxNtbs;      // NTBs received from the host
+    unsigned int RxDatagrams; // Datagrams extracted from received NTBs
+    unsigned int RxDrops;     // Datagrams dropped because no pbuf was available
+    unsigned int TxNtbs;      // NTBs sent to the host
+    unsigned int TxDatagrams; // Datagrams packed into sent NTBs
+
+    unsigned int IsrCalls;     // Calls of the bulk OUT handler
+    unsigned int IsrCycles;    // Cycles spent in the bulk OUT handler
+    unsigned int IsrMaxCycles; // Longest single call of the bulk OUT handler
+    unsigned int CopyCycles;   // Cycles spent copying between NTBs and pbufs
+    unsigned int CopyBytes;    // Bytes copied between NTBs and pbufs
+
+    unsigned int UdpEchoed;    // Datagrams mirrored on the echo port
+    unsigned int UdpSunk;      // Datagrams discarded on the sink port
+    unsigned int UdpSinkBytes; // Payload bytes discarded on the sink port
+
+    unsigned int IperfBytes; // Bytes of the last finished iperf session
+    unsigned int IperfMs;    // Duration of the last finished iperf session
+    unsigned int IperfKbps;  // Bandwidth of the last finished iperf session
+
+    unsigned int RawEchoed; // Frames mirrored on NCM_BENCH_ETHERTYPE
+
+    unsigned int ClockProfile; // CLOCK_PROFILE_x, to compare runs of different builds
+    unsigned int FlashLatency; // Flash wait states of the profile
+} NCM_BenchStats;
+
+/// @brief One row of the memcpy / memset table returned for an 'M' on the stats port
+typedef struct {
+    unsigned short Size;
+    unsigned char DstOffset;  // Misalignment of the destination
+    unsigned char SrcOffset;  // Misalignment of the source, 0xFF for memset
+    unsigned int Cycles;      // Best of NCM_BENCH_MEMORY_RUNS
+    unsigned int ByteCycles;  // Same with a plain byte loop for reference
+} NCM_BenchMemory;
+#pragma pack()
+
+#ifdef NCM_BENCHMARK
+extern NCM_BenchStats ncmBenchStats;
+
+#define NCM_BENCH_COUNT(field, n) (ncmBenchStats.field += (n))
+#define NCM_BENCH_BEGIN(var) unsigned int var = sys_cycles()
+#define NCM_BENCH_END(var, field) (ncmBenchStats.field += sys_cycles() - (var))
+#else
+#define NCM_BENCH_COUNT(field, n)
+#define NCM_BENCH_BEGIN(var)
+#define NCM_BENCH_END(var, field)
+#endif
+
+struct netif;
+
+/// @brief Start the iperf server and the UDP echo, sink & stats services
+/// @param netif The NCM network interface to measure
+void NCM_Bench_Init(struct netif *netif);
+/// @brief Account a single call of the bulk OUT handler
+/// @param cycles The number of cycles the call took
+void NCM_Bench_IsrDone(unsigned int cycles);
+
+#endif
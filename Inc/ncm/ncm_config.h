@@ -4,7 +4,10 @@
 #include "usb.h"
 #include "platform.h"
 
+/// @brief Prepare the NTB buffers, lwIP is started by NCM_Loop after SET_CONFIGURATION
+/// @remark Call it after USB_Init, TX NTBs in the USB-SRAM are placed behind the endpoint buffers laid out there
 void NCM_Init();
+/// @brief Poll the network, brings it up on the first call after the device was configured
 void NCM_Loop();
 USB_Implementation NCM_GetImplementation();
 
@@ -2,6 +2,8 @@
 #define __NCM_DEVICE_H
 
 #include "usb.h"
+#include "lwipprofile.h"
+#include <string.h>
 
 #define NCM_SET_NTB_INPUT_SIZE 0x86
 #define NCM_GET_NTB_INPUT_SIZE 0x85
@@ -10,6 +12,13 @@
 #define NCM_NETWORK_CONNECTION 0x00
 #define NCM_NETWORK_SPEEDCHANGE 0x2A
 
+// TX NTBs in the USB-SRAM may only be written through the USB core
+#if NCM_TX_PMA
+#define NCM_CopyToTx(target, source, length) USB_WriteSRAM((volatile unsigned char *)(target), source, length)
+#else
+#define NCM_CopyToTx(target, source, length) memcpy(target, source, length)
+#endif
+
 #pragma pack(1)
 // NCM10 Table 6-3
 typedef struct {
@@ -76,11 +85,13 @@ typedef enum {
     NCM_BUF_UNUSED,
     NCM_BUF_READY,
     NCM_BUF_LOCKED,
+    NCM_BUF_DRAINING, // parsed, but datagrams are still referenced
 } NCM_BufferState;
 
 struct NCM_BufferInfo {
     char *buffer;
-    NCM_BufferState status;
+    volatile NCM_BufferState status;
+    unsigned char references;
     unsigned short length;
     unsigned short offset;
     NCM_BufferInfo *next;
@@ -91,7 +102,7 @@ typedef struct {
     unsigned char datagramCount;
     unsigned short offset;
     unsigned short sequence;
-    NCM_NTB_DATAPOINTER_16 datagrams[10];
+    NCM_NTB_DATAPOINTER_16 datagrams[NCM_NTB_MAX_DATAGRAMS];
 } NCM_TX_BufferInfo;
 
 typedef struct {
@@ -100,15 +111,26 @@ typedef struct {
     NCM_NTB_DATAPOINTER_16 *datagramm;
 } NCM_RX_BufferInfo;
 
+/// @brief Link the NTB buffers, must be called before the interface is used
+void NCM_InitBuffers();
+
 char NCM_SetupPacket(USB_SETUP_PACKET *setup, char *data, short length);
 void NCM_HandlePacket(unsigned char ep, short length);
 void NCM_Reset(char interface, char alternateId);
 void NCM_ControlTransmit(unsigned char ep, short length);
+void NCM_RemapEndpoints(const unsigned char *map);
 
 void NCM_LinkUp();
 void NCM_LinkDown();
 
+/// @brief Get the next received datagram
+/// @param length Will contain the length of the datagram
+/// @return A pointer into the NTB, valid until it is released with NCM_ReleaseRxDatagram
 char *NCM_GetNextRxDatagramBuffer(short *length);
+/// @brief Return a datagram so its NTB buffer can receive again
+void NCM_ReleaseRxDatagram(const char *datagram);
+/// @brief Reserve space for a datagram in the current NTB
+/// @return The buffer to write the datagram to with NCM_CopyToTx, or 0 if no NTB buffer is free
 char *NCM_GetNextTxDatagramBuffer(short length);
 void NCM_FlushTx();
 void NCM_BufferTransmitted(unsigned char ep, short length);
@@ -2,8 +2,53 @@
 #define __NCM_NETIF_H
 
 #include "lwip/netif.h"
+#include "netif/ethernet.h"
+
+// Number of EtherTypes that can be handled next to lwIP
+#define NCM_NETIF_MAX_ETHERTYPES 4
+// Number of UDP ports that can be handled next to lwIP
+#define NCM_NETIF_MAX_UDP_PORTS 4
+
+/// @brief Handler for frames of a registered EtherType
+/// @param header The ethernet header of the frame
+/// @param payload The data following the header
+/// @param length The length of the payload
+/// @remark Runs in ncm_netif_poll, header & payload are only valid until the handler returns
+typedef void (*ncm_netif_ethertype_fn)(const struct eth_hdr *header, const char *payload, short length);
+
+/// @brief Handler for IPv4 UDP datagrams to a registered port
+/// @param src The sender address
+/// @param payload The UDP payload
+/// @param length The length of the payload
+/// @return 1 if the datagram was consumed, 0 to pass it on to lwIP
+/// @remark Runs in ncm_netif_poll, payload is only valid until the handler returns
+typedef u8_t (*ncm_netif_udp_fn)(const ip4_addr_t *src, const char *payload, short length);
 
 err_t ncm_netif_init(struct netif *netif);
 void ncm_netif_poll(struct netif *netif);
 
+/// @brief Handle an EtherType before lwIP sees it
+/// @param type The EtherType in host byte order
+/// @param handler The handler to call, 0 to hand the EtherType back to lwIP
+/// @return ERR_OK or ERR_MEM if all NCM_NETIF_MAX_ETHERTYPES slots are taken
+err_t ncm_netif_register_ethertype(u16_t type, ncm_netif_ethertype_fn handler);
+/// @brief Handle UDP datagrams to a port before lwIP sees them
+/// @param port The destination port in host byte order
+/// @param handler The handler to call, 0 to hand the port back to lwIP
+/// @return ERR_OK or ERR_MEM if all NCM_NETIF_MAX_UDP_PORTS slots are taken
+/// @remark Only unfragmented IPv4 datagrams are matched, the UDP checksum is not verified
+err_t ncm_netif_register_udp(u16_t port, ncm_netif_udp_fn handler);
+/// @brief Prepare the ethernet header for ncm_netif_send_raw once
+/// @param header The header to fill
+/// @param dest The destination MAC address
+/// @param type The EtherType in host byte order
+void ncm_netif_raw_header(struct eth_hdr *header, const struct eth_addr *dest, u16_t type);
+/// @brief Send a frame without going through lwIP
+/// @param header A header prepared with ncm_netif_raw_header
+/// @param payload The data following the header
+/// @param length The length of the payload
+/// @param flush Whether to send the NTB right away instead of waiting for more datagrams
+/// @return ERR_OK or ERR_MEM if no NTB buffer is free
+err_t ncm_netif_send_raw(const struct eth_hdr *header, const void *payload, short length, char flush);
+
 #endif
@@ -4,10 +4,39 @@
 #include "stm32.h"
 #include <stddef.h>
 
+#if defined(RAMFUNC) && (defined(STM32G441xx) || defined(STM32G474xx))
+// Run from the CCM-SRAM: fetched over the I-Code bus without flash wait states and copied there by the startup code.
+// Calls between flash & CCM-SRAM are out of BL range and go through long branch veneers of the linker
+#define __RAMFUNC __attribute__((section(".ccmfunc"), noinline))
+#else
+#define __RAMFUNC
+#endif
+
+// Not cleared by the startup code, for large buffers that are initialized before use
+#define __NOINIT __attribute__((section(".noinit")))
+
 unsigned int sys_jiffies();
 unsigned int sys_now();
 void delay_ms(unsigned int ms);
 
 void Systick_Init();
 
+/// @brief Start TIM2 as free running 32 bit timebase for sys_now_us() and the timer service
+/// @remark Call again after the core clock was changed
+void Timebase_Init();
+/// @brief Get the microseconds since Timebase_Init, wraps after ~71 minutes
+unsigned int sys_now_us();
+/// @brief Busy wait for the given number of microseconds
+void delay_us(unsigned int us);
+/// @brief Get the raw TIM2 count, it runs at the timer clock
+unsigned int Timebase_Ticks();
+/// @brief Convert microseconds to TIM2 ticks
+unsigned int Timebase_UsToTicks(unsigned int us);
+
+/// @brief Enable the cycle counter used by sys_cycles()
+void Cycles_Init();
+/// @brief Get the current core cycle count
+/// @remark Uses the DWT cycle counter where available, otherwise it is derived from the SysTick
+unsigned int sys_cycles();
+
 #endif
@@ -0,0 +1,54 @@
+#ifndef __PROFILER_H_
+#define __PROFILER_H_
+
+#include "usb.h"
+
+#ifndef PROFILER_RATE
+#define PROFILER_RATE 4001 // Hz, not a multiple of the 1 kHz tick so periodic work is not always hit at the same phase
+#endif
+
+#ifndef PROFILER_SLOTS
+#if defined(STM32F042x6)
+#define PROFILER_SLOTS 64
+#else
+#define PROFILER_SLOTS 512
+#endif
+#endif
+
+// Vendor request to the device: IN with wValue = 0xFFFF returns PROFILER_INFO, otherwise the slots from wValue on.
+// OUT with wValue = PROFILER_STOP / START / CLEAR controls the sampling
+#define PROFILER_REQUEST 0xE3
+#define PROFILER_INFO_INDEX 0xFFFF
+#define PROFILER_STOP 0
+#define PROFILER_START 1
+#define PROFILER_CLEAR 2
+
+#pragma pack(1)
+typedef struct {
+    unsigned int Pc;
+    unsigned int Lr; // Of the interrupted code, only the caller if it is a leaf or did not use LR yet
+    unsigned int Count;
+} PROFILER_SLOT;
+
+typedef struct {
+    unsigned int Samples;
+    unsigned int Lost; // Samples that found no free slot
+    unsigned short Slots;
+    unsigned short Rate;
+    unsigned int CoreClock;
+    unsigned char Running;
+} PROFILER_INFO;
+#pragma pack()
+
+/// @brief Start sampling the interrupted PC & LR with TIM6 (stm32g4) or TIM14 (stm32f042) at PROFILER_RATE
+/// @remark The timer runs at the highest interrupt priority, so the other interrupts are sampled as well
+void PROFILER_Init();
+/// @brief Pause or resume sampling
+void PROFILER_Enable(char enable);
+/// @brief Clear the histogram
+void PROFILER_Clear();
+/// @brief Handle the profiler vendor request
+/// @return USB_OK if the request was answered, USB_ERR otherwise
+char PROFILER_SetupPacket(USB_SETUP_PACKET *setup);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef __TIMER_H_
+#define __TIMER_H_
+
+#include "platform.h"
+
+typedef struct TIMER {
+    struct TIMER *Next;
+    unsigned int Due;    // TIM2 ticks
+    unsigned int Period; // TIM2 ticks, 0 for a one-shot timer
+    void (*Callback)(void *arg);
+    void *Arg;
+} TIMER;
+
+/// @brief Run a callback after a delay and optionally repeat it
+/// @param timer Storage for the timer, has to stay valid until it expired or was stopped
+/// @param delay Microseconds until the first call
+/// @param period Microseconds between the following calls, 0 to call only once
+/// @param callback The function to call
+/// @param arg Passed to the callback
+/// @remark The callbacks run in the TIM2 interrupt at the priority of the USB interrupts, so they are never interrupted by the USB stack.
+/// Delays and periods have to be shorter than 2^31 timer ticks (~29 s at 71.875 MHz)
+void TIMER_Start(TIMER *timer, unsigned int delay, unsigned int period, void (*callback)(void *arg), void *arg);
+/// @brief Stop a running timer, nothing happens if it is not running
+void TIMER_Stop(TIMER *timer);
+
+#endif
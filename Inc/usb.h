@@ -19,8 +19,8 @@ typedef struct {
 
 typedef struct {
     unsigned char EP;
-    unsigned char RxBufferSize;
-    unsigned char TxBufferSize;
+    unsigned short RxBufferSize; // Up to 1023 for isochronous endpoints, which use only one direction
+    unsigned short TxBufferSize;
     unsigned short Type;
     void (*RxCallback)(unsigned char ep, short length);
     void (*TxCallback)(unsigned char ep, short length);
@@ -39,19 +39,69 @@ typedef struct {
     char *(*GetOSDescriptor)(short *);
 
     char (*SetupPacket_Handler)(USB_SETUP_PACKET *, const unsigned char *, short);
+    // Receives the OUT data stages longer than USB_MaxControlData packet by packet (setup, data, length, offset), return USB_OK to accept
+    // SetupPacket_Handler is called afterwards with data = 0 and the total length. Without it these requests are stalled
+    char (*ControlData_Handler)(USB_SETUP_PACKET *, const unsigned char *, short, unsigned short);
     void (*ResetInterface_Handler)(char, char);
 
     void (*Suspend_Handler)();
     void (*Wakeup_Handler)();
+    // Called on every SOF with the frame number if set or an isochronous endpoint is configured, to schedule isochronous data
+    void (*Sof_Handler)(unsigned short frame);
+
+    // Called by the composite layer if the endpoints were moved, map[ep as in Endpoints] = assigned ep
+    void (*RemapEndpoints_Handler)(const unsigned char *map);
 } USB_Implementation;
 
 #define USB_OK 0
 #define USB_BUSY 1
 #define USB_ERR 2
+#define USB_DEFER 3 // From a SetupPacket_Handler: the reply follows later with USB_CompleteControl
+
+// Vendor request to the device returning USB_STATISTICS, wValue = 1 clears the counters afterwards
+#define USB_STATS_REQUEST 0xE2
+
+typedef struct {
+    unsigned int RxBytes;
+    unsigned int RxPackets;
+    unsigned int RxZlps;
+    unsigned int TxBytes;
+    unsigned int TxPackets;
+    unsigned int TxZlps;
+    unsigned int Completions;  // Transfers handed to the TX-callback
+    unsigned int Naks;         // Packets held back by USB_PauseReceive
+    unsigned int IsrCalls;
+    unsigned int IsrCycles;
+    unsigned int IsrMaxCycles;
+    unsigned short MaxQueued;  // Longest transfer passed to USB_Transmit
+    unsigned short Reserved;
+} USB_EP_STATISTICS;
+
+typedef struct {
+    unsigned int Resets;
+    unsigned int Suspends;
+    unsigned int Wakeups;
+    unsigned int Errors;       // ERR: CRC, bit stuffing & framing errors or a missing handshake, the peripheral does not tell them apart
+    unsigned int Overruns;     // PMAOVR: the USB-SRAM was not accessed in time
+    unsigned int MissedSofs;   // ESOF while not suspended, a suspend is preceded by up to three
+    unsigned int Irqs;
+    unsigned int IrqCycles;
+    unsigned int IrqMaxCycles;
+    unsigned int L1Sleeps;       // LPM L1 requests acknowledged
+    unsigned int RemoteWakeups;  // Resumes signaled by USB_RemoteWakeup
+    unsigned int WakeLatency;    // us from the last resume (host or remote) to the first SOF
+    unsigned int WakeMaxLatency;
+    USB_EP_STATISTICS Endpoints[USB_NumEndpoints];
+} USB_STATISTICS;
 
 // Disable this define to disable the timeout feature
 #define USB_TXTIMEOUT 50
 
+// Milliseconds a deferred control request may take before it is stalled
+#ifndef USB_CONTROL_TIMEOUT
+#define USB_CONTROL_TIMEOUT 1000
+#endif
+
 /// @brief Initialize all USB related stuff
 void USB_Init(USB_Implementation impl);
 /// @brief Low Priority handler for most interrupts
@@ -65,18 +115,71 @@ void USB_HP_IRQHandler();
 /// @param length The number of bytes to sent
 /// @remark Will automatically split the transmission into multiple chunks if necessary
 void USB_Transmit(unsigned char ep, const unsigned char* buffer, short length);
+/// @brief Get the handle of the control request passed to the SetupPacket_Handler that is running
+/// @remark Keep it when returning USB_DEFER. Data of an OUT request has to be copied before, the buffer is reused by the next request
+unsigned char USB_GetControlHandle();
+/// @brief Finish a control request the SetupPacket_Handler deferred with USB_DEFER, e.g. from the main loop
+/// @param handle The handle of the request, see USB_GetControlHandle
+/// @param result USB_OK to send the data (IN) or acknowledge the status stage (OUT), USB_ERR to stall
+/// @param data The reply of an IN request, has to stay valid until it was sent. Ignored for OUT requests
+/// @param length The length of the reply, truncated to wLength
+/// @return USB_OK if the request was still pending, USB_ERR if it timed out after USB_CONTROL_TIMEOUT or the host started another one
+/// @remark Until then EP0 NAKs the data or status stage, the other endpoints keep running
+char USB_CompleteControl(unsigned char handle, char result, const unsigned char *data, short length);
+/// @brief Whether the host selected a configuration
+char USB_IsConfigured();
+/// @brief Whether the bus is suspended or in LPM L1 sleep
+char USB_IsSuspended();
+/// @brief Wake the host from suspend or L1 sleep by resume signaling
+/// @return USB_OK if signaling started, USB_ERR if the bus is awake or the host did not allow a remote wakeup
+/// @remark From suspend the resume starts once the bus was idle for 5ms and lasts 2ms, both timed by the timer service.
+///         From L1 the peripheral signals 50us by itself
+char USB_RemoteWakeup();
 /// @brief Whether there is currently any unfinished transfer running
 /// @param ep The endpoint to check
 /// @remark Do not busy-wait on this during reception. It will stall the USB-ISR
 char USB_IsTransmitPending(unsigned char ep);
+/// @brief Queue the next packet of an isochronous IN endpoint
+/// @param ep The endpoint id
+/// @param buffer The data, copied right away
+/// @param length The number of bytes, at most the TxBufferSize of the endpoint
+/// @remark Writes the half of the double buffer the hardware is not sending, it goes out with the next frame but one.
+/// Call it from the TX-callback or the Sof_Handler, a half without new data is sent as an empty packet
+void USB_TransmitIso(unsigned char ep, const unsigned char *buffer, short length);
 /// @brief Get data out of the reception buffers
 /// @param ep The endpoint id to fetch data from
 /// @param buffer The target buffer to write to
 /// @param length The length of the buffer. Will contain the number of bytes read
 void USB_Fetch(unsigned char ep, unsigned char* buffer, short *length);
+/// @brief Keep the endpoint in NAK after the next received packet
+/// @param ep The endpoint id
+/// @remark Call this from the RX-callback when the packet can not be consumed yet. It stays in the USB-SRAM until USB_ResumeReceive
+void USB_PauseReceive(unsigned char ep);
+/// @brief Accept packets on a paused endpoint again
+/// @param ep The endpoint id
+void USB_ResumeReceive(unsigned char ep);
+/// @brief Reserve a block of USB-SRAM outside of the endpoint buffers
+/// @param size The number of bytes to reserve
+/// @return The start of the block or 0 if it would reach into the endpoint buffers of the implementation
+/// @remark Only after USB_Init, which lays out the endpoint buffers. Data in this block can be passed to USB_Transmit
+/// directly and is sent without copying it first
+volatile unsigned char *USB_AllocateSRAM(unsigned short size);
+/// @brief Copy data into the USB-SRAM
+/// @param target The address in the USB-SRAM, may be odd
+/// @param source The data to copy
+/// @param length The number of bytes to copy
+void USB_WriteSRAM(volatile unsigned char *target, const void *source, short length);
 /// @brief Configure an endpoint
 void USB_SetEPConfig(USB_CONFIG_EP config);
 
+/// @brief Get the live bus & endpoint counters
+/// @remark Only counted if USB_STATS is defined. The values are updated from the USB-ISR, use USB_SnapshotStatistics for a consistent copy
+const USB_STATISTICS *USB_GetStatistics();
+/// @brief Copy the counters with interrupts disabled
+/// @param target The copy
+/// @param clear Whether to reset the counters afterwards
+void USB_SnapshotStatistics(USB_STATISTICS *target, char clear);
+
 /// @brief Set USB implementation details
 /// @param impl The function calls & settings to use
 void USB_SetImplementation(USB_Implementation impl);
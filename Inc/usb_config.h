@@ -17,6 +17,24 @@
 #define FUNC_NCM 0x1A
 #define FUNC_ECM 0x0F
 
+// Audio 2.0 class specific subtypes
+#define AC_HEADER 0x01
+#define AC_INPUT_TERMINAL 0x02
+#define AC_OUTPUT_TERMINAL 0x03
+#define AC_FEATURE_UNIT 0x06
+#define AC_CLOCK_SOURCE 0x0A
+#define AS_GENERAL 0x01
+#define AS_FORMAT_TYPE 0x02
+#define EP_GENERAL 0x01
+
+// MIDI 1.0 class specific subtypes & jack types
+#define MS_HEADER 0x01
+#define MIDI_IN_JACK 0x02
+#define MIDI_OUT_JACK 0x03
+#define MS_GENERAL 0x01
+#define JACK_EMBEDDED 0x01
+#define JACK_EXTERNAL 0x02
+
 #pragma pack(1)
 typedef struct {
     unsigned char Length;
@@ -149,6 +167,185 @@ typedef struct {
     unsigned short Desc0Length;
 } USB_DESC_FUNC_HID;
 
+// Audio20 Table 4-5
+typedef struct {
+    unsigned char Length;
+    unsigned char Type;
+    unsigned char SubType;
+    unsigned short ADCVersion;
+    unsigned char Category;
+    unsigned short TotalLength;
+    unsigned char Controls;
+} USB_DESC_AUDIO_HEADER;
+
+// Audio20 Table 4-6
+typedef struct {
+    unsigned char Length;
+    unsigned char Type;
+    unsigned char SubType;
+    unsigned char ClockID;
+    unsigned char Attributes;
+    unsigned char Controls;
+    unsigned char AssocTerminal;
+    unsigned char strClock;
+} USB_DESC_AUDIO_CLOCK;
+
+// Audio20 Table 4-9
+typedef struct {
+    unsigned char Length;
+    unsigned char Type;
+    unsigned char SubType;
+    unsigned char TerminalID;
+    unsigned short TerminalType;
+    unsigned char AssocTerminal;
+    unsigned char ClockID;
+    unsigned char Channels;
+    unsigned int ChannelConfig;
+    unsigned char strChannelNames;
+    unsigned short Controls;
+    unsigned char strTerminal;
+} USB_DESC_AUDIO_INPUT;
+
+// Audio20 Table 4-10
+typedef struct {
+    unsigned char Length;
+    unsigned char Type;
+    unsigned char SubType;
+    unsigned char TerminalID;
+    unsigned short TerminalType;
+    unsigned char AssocTerminal;
+    unsigned char SourceID;
+    unsigned char ClockID;
+    unsigned short Controls;
+    unsigned char strTerminal;
+} USB_DESC_AUDIO_OUTPUT;
+
+// Audio20 Table 4-13, master & two channels
+typedef struct {
+    unsigned char Length;
+    unsigned char Type;
+    unsigned char SubType;
+    unsigned char UnitID;
+    unsigned char SourceID;
+    unsigned int Controls[3];
+    unsigned char strFeature;
+} USB_DESC_AUDIO_FEATURE2;
+
+// Audio20 Table 4-27
+typedef struct {
+    unsigned char Length;
+    unsigned char Type;
+    unsigned char SubType;
+    unsigned char TerminalLink;
+    unsigned char Controls;
+    unsigned char FormatType;
+    unsigned int Formats;
+    unsigned char Channels;
+    unsigned int ChannelConfig;
+    unsigned char strChannelNames;
+} USB_DESC_AUDIO_STREAM;
+
+// Frmts20 Table 2-2
+typedef struct {
+    unsigned char Length;
+    unsigned char Type;
+    unsigned char SubType;
+    unsigned char FormatType;
+    unsigned char SubslotSize;
+    unsigned char BitResolution;
+} USB_DESC_AUDIO_FORMAT1;
+
+// Audio20 Table 4-34
+typedef struct {
+    unsigned char Length;
+    unsigned char Type;
+    unsigned char SubType;
+    unsigned char Attributes;
+    unsigned char Controls;
+    unsigned char LockDelayUnits;
+    unsigned short LockDelay;
+} USB_DESC_AUDIO_ENDPOINT;
+
+// Audio10 Table 4-2, one streaming interface
+typedef struct {
+    unsigned char Length;
+    unsigned char Type;
+    unsigned char SubType;
+    unsigned short ADCVersion;
+    unsigned short TotalLength;
+    unsigned char InCollection;
+    unsigned char Interface0;
+} USB_DESC_AUDIO1_HEADER1;
+
+// Audio10 Table 4-17, standard endpoint with the audio refresh & synch fields
+typedef struct {
+    unsigned char Length;
+    unsigned char Type;
+    unsigned char Address;
+    unsigned char Attributes;
+    unsigned short MaxPacketSize;
+    unsigned char Interval;
+    unsigned char Refresh;
+    unsigned char SynchAddress;
+} USB_DESCRIPTOR_ENDPOINT_AUDIO;
+
+// MIDI10 Table 6-2
+typedef struct {
+    unsigned char Length;
+    unsigned char Type;
+    unsigned char SubType;
+    unsigned short MSCVersion;
+    unsigned short TotalLength;
+} USB_DESC_MIDI_HEADER;
+
+// MIDI10 Table 6-3
+typedef struct {
+    unsigned char Length;
+    unsigned char Type;
+    unsigned char SubType;
+    unsigned char JackType;
+    unsigned char JackID;
+    unsigned char strJack;
+} USB_DESC_MIDI_IN_JACK;
+
+// MIDI10 Table 6-4, one input pin
+typedef struct {
+    unsigned char Length;
+    unsigned char Type;
+    unsigned char SubType;
+    unsigned char JackType;
+    unsigned char JackID;
+    unsigned char InputPins;
+    unsigned char SourceID;
+    unsigned char SourcePin;
+    unsigned char strJack;
+} USB_DESC_MIDI_OUT_JACK1;
+
+// MIDI10 Table 6-7, one embedded jack
+typedef struct {
+    unsigned char Length;
+    unsigned char Type;
+    unsigned char SubType;
+    unsigned char EmbeddedJacks;
+    unsigned char JackID;
+} USB_DESC_MIDI_ENDPOINT1;
+
+// USB 2.0 LPM ECN, Binary Device Object Store
+typedef struct {
+    unsigned char Length;
+    unsigned char Type;
+    unsigned short TotalLength;
+    unsigned char Capabilities;
+} USB_DESCRIPTOR_BOS;
+
+// USB 2.0 LPM ECN, USB 2.0 Extension capability
+typedef struct {
+    unsigned char Length;
+    unsigned char Type;
+    unsigned char CapabilityType;
+    unsigned int Attributes;
+} USB_DESC_CAP_USB20;
+
 #pragma pack()
 
 #define USB_SelfPowered 0
@@ -0,0 +1,67 @@
+#ifndef __USB_TRACE_H
+#define __USB_TRACE_H
+
+#include "usb.h"
+
+#ifndef USB_TRACE_SIZE
+#define USB_TRACE_SIZE 256 // Events, power of two
+#endif
+
+// Vendor requests to the device, answered by the USB core for every implementation
+#define USB_TRACE_REQUEST_INFO 0xE0 // IN: freeze & get USB_TRACE_INFO, OUT: resume (wValue = 1 clears the ring)
+#define USB_TRACE_REQUEST_READ 0xE1 // IN: events from index wValue on, up to the end of the ring
+
+typedef enum {
+    USB_TRACE_IRQ = 1,      // Value = ISTR
+    USB_TRACE_RESET,
+    USB_TRACE_SETUP,        // Value = bmRequestType | bRequest << 8
+    USB_TRACE_CTR_RX,       // Value = received bytes
+    USB_TRACE_CTR_TX,       // Value = bytes sent in total
+    USB_TRACE_PREPARE,      // Value = bytes of the next packet
+    USB_TRACE_CALLBACK,     // Value = 0 for RX, 1 for TX
+    USB_TRACE_RETURN,       // Class callback is done, same value
+    USB_TRACE_SUSPEND,
+    USB_TRACE_WAKEUP,
+    USB_TRACE_L1,           // Value = LPMCSR (BESL, bRemoteWake)
+    USB_TRACE_RESUME,       // Remote wakeup, Value = 1 from L1, 2 from suspend
+    USB_TRACE_DEFER,        // Control request deferred by the class, Value = handle
+    USB_TRACE_COMPLETE,     // Deferred control request finished, Value = handle | result << 8 (0xFF on timeout)
+} USB_TRACE_TYPE;
+
+#pragma pack(1)
+typedef struct {
+    unsigned int Cycles;
+    unsigned char Event;
+    unsigned char Endpoint;
+    unsigned short Value;
+} USB_TRACE_ENTRY;
+
+typedef struct {
+    unsigned int Written; // Events recorded since the last clear, the newest is at (Written - 1) % Size
+    unsigned short Size;
+    unsigned char EntrySize;
+    unsigned char Frozen;
+    unsigned int CoreClock;
+} USB_TRACE_INFO;
+#pragma pack()
+
+#ifdef USB_TRACE
+
+#define USB_TRACE_EVENT(event, ep, value) USB_Trace((event), (ep), (value))
+
+/// @brief Record an event with the current cycle count
+/// @remark Safe from any interrupt priority, the oldest events are overwritten
+void USB_Trace(USB_TRACE_TYPE event, unsigned char ep, unsigned short value);
+/// @brief Handle the trace vendor requests
+/// @return USB_OK if the request was answered, USB_ERR otherwise
+char USB_Trace_SetupPacket(USB_SETUP_PACKET *setup);
+
+#else
+
+#define USB_TRACE_EVENT(event, ep, value) \
+    do {                                  \
+    } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,324 @@
+#include "audio/audio_config.h"
+#include "audio/audio_device.h"
+
+// Speaker & microphone on one codec, a 48 kHz clock source shared by both directions
+static const USB_DESCRIPTOR_DEVICE DeviceDescriptor = {
+    .Length = 18,
+    .Type = 0x01,
+    .USBVersion = 0x0201, // 2.01 for the BOS descriptor (LPM)
+    .DeviceClass = 0xEF,
+    .DeviceSubClass = 0x02,
+    .DeviceProtocol = 0x01,
+    .MaxPacketSize = 64,
+    .VendorID = 0x16C0,
+    .ProductID = 0x088B,
+    .DeviceVersion = 0x0100,
+    .strManufacturer = 1,
+    .strProduct = 2,
+    .strSerialNumber = 3,
+    .Configurations = 1};
+
+static const USB_DESCRIPTOR_CONFIG ConfigDescriptor = {
+    .Length = 9,
+    .Type = 0x02,
+    .TotalLength = 236,
+    .Interfaces = 3,
+    .ConfigurationID = 1,
+    .strConfiguration = 0,
+    .Attributes = (1 << 7) | (1 << 5), // Remote wakeup
+    .MaxPower = 50};
+
+static const USB_FUNC_IAD AudioFunction = {
+    .Length = 8,
+    .DescriptorType = 0x0B,
+    .FirstInterface = 0,
+    .InterfaceCount = 3,
+    .Class = 0x01,
+    .SubClass = 0x00,
+    .Protocol = 0x20,
+    .strFunction = 0};
+
+static const USB_DESCRIPTOR_INTERFACE ControlInterface = {
+    .Length = 9,
+    .Type = 0x04,
+    .InterfaceID = 0,
+    .AlternateID = 0,
+    .Endpoints = 0,
+    .Class = 0x01,
+    .SubClass = 0x01,
+    .Protocol = 0x20,
+    .strInterface = 4};
+
+static const USB_DESC_AUDIO_HEADER ControlHeader = {
+    .Length = 9,
+    .Type = CS_INTERFACE,
+    .SubType = AC_HEADER,
+    .ADCVersion = 0x0200,
+    .Category = 0x08, // I/O box
+    .TotalLength = 93,
+    .Controls = 0};
+
+static const USB_DESC_AUDIO_CLOCK ClockSource = {
+    .Length = 8,
+    .Type = CS_INTERFACE,
+    .SubType = AC_CLOCK_SOURCE,
+    .ClockID = AUDIO_ID_CLOCK,
+    .Attributes = 0x01, // Internal fixed clock, the codec runs the SAI
+    .Controls = 0x05, // Frequency & validity read only
+    .AssocTerminal = 0,
+    .strClock = 0};
+
+static const USB_DESC_AUDIO_INPUT PlayInput = {
+    .Length = 17,
+    .Type = CS_INTERFACE,
+    .SubType = AC_INPUT_TERMINAL,
+    .TerminalID = AUDIO_ID_PLAY_USB,
+    .TerminalType = 0x0101, // USB streaming
+    .AssocTerminal = 0,
+    .ClockID = AUDIO_ID_CLOCK,
+    .Channels = 2,
+    .ChannelConfig = 0x3, // Front left & right
+    .strChannelNames = 0,
+    .Controls = 0,
+    .strTerminal = 0};
+
+static const USB_DESC_AUDIO_FEATURE2 PlayVolume = {
+    .Length = 18,
+    .Type = CS_INTERFACE,
+    .SubType = AC_FEATURE_UNIT,
+    .UnitID = AUDIO_ID_VOLUME,
+    .SourceID = AUDIO_ID_PLAY_USB,
+    .Controls = {0x0F, 0, 0}, // Mute & volume on the master channel
+    .strFeature = 0};
+
+static const USB_DESC_AUDIO_OUTPUT PlayOutput = {
+    .Length = 12,
+    .Type = CS_INTERFACE,
+    .SubType = AC_OUTPUT_TERMINAL,
+    .TerminalID = AUDIO_ID_PLAY_OUT,
+    .TerminalType = 0x0301, // Speaker
+    .AssocTerminal = 0,
+    .SourceID = AUDIO_ID_VOLUME,
+    .ClockID = AUDIO_ID_CLOCK,
+    .Controls = 0,
+    .strTerminal = 0};
+
+static const USB_DESC_AUDIO_INPUT CaptureInput = {
+    .Length = 17,
+    .Type = CS_INTERFACE,
+    .SubType = AC_INPUT_TERMINAL,
+    .TerminalID = AUDIO_ID_MIC,
+    .TerminalType = 0x0201, // Microphone
+    .AssocTerminal = 0,
+    .ClockID = AUDIO_ID_CLOCK,
+    .Channels = 1,
+    .ChannelConfig = 0,
+    .strChannelNames = 0,
+    .Controls = 0,
+    .strTerminal = 0};
+
+static const USB_DESC_AUDIO_OUTPUT CaptureOutput = {
+    .Length = 12,
+    .Type = CS_INTERFACE,
+    .SubType = AC_OUTPUT_TERMINAL,
+    .TerminalID = AUDIO_ID_CAPTURE_USB,
+    .TerminalType = 0x0101, // USB streaming
+    .AssocTerminal = 0,
+    .SourceID = AUDIO_ID_MIC,
+    .ClockID = AUDIO_ID_CLOCK,
+    .Controls = 0,
+    .strTerminal = 0};
+
+// Alternate setting 0 without endpoints for both streaming interfaces, the host selects 1 to start a stream
+static const USB_DESCRIPTOR_INTERFACE PlayInterfaces[2] = {
+    {.Length = 9,
+     .Type = 0x04,
+     .InterfaceID = 1,
+     .AlternateID = 0,
+     .Endpoints = 0,
+     .Class = 0x01,
+     .SubClass = 0x02,
+     .Protocol = 0x20,
+     .strInterface = 0},
+    {.Length = 9,
+     .Type = 0x04,
+     .InterfaceID = 1,
+     .AlternateID = 1,
+     .Endpoints = 2,
+     .Class = 0x01,
+     .SubClass = 0x02,
+     .Protocol = 0x20,
+     .strInterface = 0}};
+
+static const USB_DESC_AUDIO_STREAM PlayStream = {
+    .Length = 16,
+    .Type = CS_INTERFACE,
+    .SubType = AS_GENERAL,
+    .TerminalLink = AUDIO_ID_PLAY_USB,
+    .Controls = 0,
+    .FormatType = 1,
+    .Formats = 1, // PCM
+    .Channels = 2,
+    .ChannelConfig = 0x3,
+    .strChannelNames = 0};
+
+static const USB_DESC_AUDIO_FORMAT1 PlayFormat = {
+    .Length = 6,
+    .Type = CS_INTERFACE,
+    .SubType = AS_FORMAT_TYPE,
+    .FormatType = 1,
+    .SubslotSize = 2,
+    .BitResolution = 16};
+
+static const USB_DESCRIPTOR_ENDPOINT PlayEndpoints[2] = {
+    {.Length = 7,
+     .Type = 0x05,
+     .Address = AUDIO_EP_PLAY,
+     .Attributes = 0x05, // Isochronous, asynchronous
+     .MaxPacketSize = AUDIO_MAX_FRAMES * AUDIO_PLAY_FRAME,
+     .Interval = 1},
+    {.Length = 7,
+     .Type = 0x05,
+     .Address = (1 << 7) | AUDIO_EP_FEEDBACK,
+     .Attributes = 0x11, // Isochronous, feedback
+     .MaxPacketSize = 3,
+     .Interval = 1}};
+
+static const USB_DESC_AUDIO_ENDPOINT StreamEndpoint = {
+    .Length = 8,
+    .Type = CS_ENDPOINT,
+    .SubType = EP_GENERAL,
+    .Attributes = 0,
+    .Controls = 0,
+    .LockDelayUnits = 0,
+    .LockDelay = 0};
+
+static const USB_DESCRIPTOR_INTERFACE CaptureInterfaces[2] = {
+    {.Length = 9,
+     .Type = 0x04,
+     .InterfaceID = 2,
+     .AlternateID = 0,
+     .Endpoints = 0,
+     .Class = 0x01,
+     .SubClass = 0x02,
+     .Protocol = 0x20,
+     .strInterface = 0},
+    {.Length = 9,
+     .Type = 0x04,
+     .InterfaceID = 2,
+     .AlternateID = 1,
+     .Endpoints = 1,
+     .Class = 0x01,
+     .SubClass = 0x02,
+     .Protocol = 0x20,
+     .strInterface = 0}};
+
+static const USB_DESC_AUDIO_STREAM CaptureStream = {
+    .Length = 16,
+    .Type = CS_INTERFACE,
+    .SubType = AS_GENERAL,
+    .TerminalLink = AUDIO_ID_CAPTURE_USB,
+    .Controls = 0,
+    .FormatType = 1,
+    .Formats = 1,
+    .Channels = 1,
+    .ChannelConfig = 0,
+    .strChannelNames = 0};
+
+static const USB_DESC_AUDIO_FORMAT1 CaptureFormat = {
+    .Length = 6,
+    .Type = CS_INTERFACE,
+    .SubType = AS_FORMAT_TYPE,
+    .FormatType = 1,
+    .SubslotSize = 2,
+    .BitResolution = 16};
+
+static const USB_DESCRIPTOR_ENDPOINT CaptureEndpoint = {
+    .Length = 7,
+    .Type = 0x05,
+    .Address = (1 << 7) | AUDIO_EP_CAPTURE,
+    .Attributes = 0x05, // Isochronous, asynchronous
+    .MaxPacketSize = AUDIO_MAX_FRAMES * AUDIO_CAPTURE_FRAME,
+    .Interval = 1};
+
+// Buffer holding the complete descriptor (except the device one) in the correct order
+static char ConfigurationBuffer[236] = {0};
+
+static const USB_CONFIG_EP EndpointConfigs[3] = {
+    {.EP = AUDIO_EP_PLAY,
+     .RxBufferSize = AUDIO_MAX_FRAMES * AUDIO_PLAY_FRAME,
+     .TxBufferSize = 0,
+     .RxCallback = AUDIO_HandlePlayback,
+     .Type = USB_EP_ISOCHRONOUS},
+    {.EP = AUDIO_EP_FEEDBACK,
+     .RxBufferSize = 0,
+     .TxBufferSize = 3,
+     .Type = USB_EP_ISOCHRONOUS},
+    {.EP = AUDIO_EP_CAPTURE,
+     .RxBufferSize = 0,
+     .TxBufferSize = AUDIO_MAX_FRAMES * AUDIO_CAPTURE_FRAME,
+     .Type = USB_EP_ISOCHRONOUS}};
+
+static unsigned short *GetString(char index, short lcid, short *length) {
+    if (index == 1) {
+        *length = 20;
+        return u"Housemade";
+    } else if (index == 2) {
+        *length = 30;
+        return u"My Audio Codec";
+    } else if (index == 3) {
+        *length = 22;
+        return u"01234-6786";
+    } else if (index == 4) {
+        *length = 32;
+        return u"Audio Interface";
+    }
+
+    return 0;
+}
+
+USB_Implementation AUDIO_GetImplementation() {
+    USB_Implementation impl = {0};
+
+    unsigned short len = USB_BuildDescriptor(ConfigurationBuffer, sizeof(ConfigurationBuffer), 23,
+                                             (const void *[]){
+                                                 &ConfigDescriptor,
+                                                 &AudioFunction,
+                                                 &ControlInterface,
+                                                 &ControlHeader,
+                                                 &ClockSource,
+                                                 &PlayInput,
+                                                 &PlayVolume,
+                                                 &PlayOutput,
+                                                 &CaptureInput,
+                                                 &CaptureOutput,
+                                                 &PlayInterfaces[0],
+                                                 &PlayInterfaces[1],
+                                                 &PlayStream,
+                                                 &PlayFormat,
+                                                 &PlayEndpoints[0],
+                                                 &StreamEndpoint,
+                                                 &PlayEndpoints[1],
+                                                 &CaptureInterfaces[0],
+                                                 &CaptureInterfaces[1],
+                                                 &CaptureStream,
+                                                 &CaptureFormat,
+                                                 &CaptureEndpoint,
+                                                 &StreamEndpoint});
+
+    AUDIO_Init();
+
+    impl.DeviceDescriptor = &DeviceDescriptor;
+    impl.ConfigDescriptor = ConfigurationBuffer;
+    impl.ConfigDescriptorLength = len;
+
+    impl.Endpoints = EndpointConfigs;
+    impl.NumEndpoints = 3;
+    impl.NumInterfaces = 3;
+
+    impl.GetString = &GetString;
+    impl.SetupPacket_Handler = &AUDIO_SetupPacket;
+    impl.ResetInterface_Handler = &AUDIO_Reset;
+    impl.Sof_Handler = &AUDIO_Sof;
+    return impl;
+}
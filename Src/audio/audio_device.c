@@ -0,0 +1,343 @@
+#include "audio/audio_device.h"
+
+#define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
+
+// Q15 gain from 0 dB down to -60 dB in steps of 1 dB
+static const unsigned short VolumeTable[61] = {
+    32767, 29204, 26028, 23197, 20675, 18426, 16422, 14636, 13045, 11626, 10362, 9235, 8231, 7336, 6538, 5827,
+    5193, 4628, 4125, 3677, 3277, 2920, 2603, 2320, 2067, 1843, 1642, 1464, 1304, 1163, 1036, 923,
+    823, 734, 654, 583, 519, 463, 413, 368, 328, 292, 260, 232, 207, 184, 164, 146,
+    130, 116, 104, 92, 82, 73, 65, 58, 52, 46, 41, 37, 33};
+
+static int playRing[AUDIO_RING_FRAMES * 2];
+static int captureRing[AUDIO_RING_FRAMES * 2];
+static unsigned int playPacket[AUDIO_MAX_FRAMES];              // One OUT packet, L | R << 16 per frame
+static unsigned int capturePacket[(AUDIO_MAX_FRAMES + 1) / 2]; // One IN packet, two mono frames per word
+
+static unsigned short playRead = 0;  // Playback DMA position at the last update
+static unsigned short playWrite = 0; // Frame the next packet is written to
+static int playLevel = 0;            // Frames written but not yet taken by the DMA
+static char playActive = 0;          // Alternate setting 1 on the playback interface
+static char playStreaming = 0;       // Packets arrived since the last underrun
+static unsigned short captureRead = 0;
+static char captureActive = 0;
+
+static unsigned int feedbackFrames = 0; // Frames the SAI took in the current feedback period
+static unsigned short feedbackSofs = 0;
+static unsigned int feedback = AUDIO_NOMINAL_FRAMES << 14;
+static unsigned int lastSof = 0;
+
+static char mute = 0;
+static short volume = AUDIO_VOLUME_MAX;
+static unsigned int gain = 32767 | 32767 << 16; // Q15, left channel in the lower half
+
+static AUDIO_Stats stats = {0};
+static AUDIO_Stats snapshot;
+static unsigned char reply[14];
+
+static void AUDIO_UpdateGain() {
+    unsigned short g = mute ? 0 : VolumeTable[-volume / AUDIO_VOLUME_RES];
+    gain = g | g << 16;
+}
+
+static void AUDIO_ConvertPlayback(const unsigned int *source, int *target, short frames) {
+    // 16 bit samples to left aligned 32 bit slots. SMUAD with the gain of the other channel zeroed scales one half,
+    // the saturating doubling turns the Q30 product into Q31
+    unsigned int left = gain & 0x0000FFFF;
+    unsigned int right = gain & 0xFFFF0000;
+
+    for (short i = 0; i < frames; i++) {
+        int l = __SMUAD(source[i], left);
+        int r = __SMUAD(source[i], right);
+
+        target[i * 2] = __QADD(l, l);
+        target[i * 2 + 1] = __QADD(r, r);
+    }
+}
+
+static void AUDIO_UpdatePlayback() {
+    unsigned short position = AUDIO_Sai_PlaybackPosition();
+    unsigned short consumed = (position + AUDIO_RING_FRAMES - playRead) % AUDIO_RING_FRAMES;
+
+    // Silence what the DMA took, an underrun then plays zeros instead of the previous round of the ring
+    for (unsigned short i = playRead; i != position;) {
+        playRing[i * 2] = 0;
+        playRing[i * 2 + 1] = 0;
+
+        if (++i == AUDIO_RING_FRAMES) {
+            i = 0;
+        }
+    }
+
+    playRead = position;
+    playLevel -= consumed;
+    feedbackFrames += consumed;
+
+    if (playLevel < 0) {
+        // The SAI passed the last packet, continue a margin of silence behind it
+        if (playStreaming) {
+            stats.PlayUnderruns++;
+            playStreaming = 0;
+        }
+
+        playLevel = AUDIO_TARGET_FRAMES;
+        playWrite = (position + AUDIO_TARGET_FRAMES) % AUDIO_RING_FRAMES;
+    }
+}
+
+static void AUDIO_UpdateFeedback() {
+    // Frames per ms in 10.14 from what the SAI took over the period, pulled slightly towards the target fill level
+    if (feedbackFrames == 0) {
+        // No codec clock, announce the nominal rate
+        feedback = AUDIO_NOMINAL_FRAMES << 14;
+    } else {
+        int value = feedbackFrames << (14 - AUDIO_FEEDBACK_SHIFT);
+
+        if (playStreaming) {
+            value += (AUDIO_TARGET_FRAMES - stats.PlayLevel) << 7;
+        }
+
+        // Packets may only differ by one frame from the nominal size
+        if (value < (AUDIO_NOMINAL_FRAMES - 1) << 14) {
+            value = (AUDIO_NOMINAL_FRAMES - 1) << 14;
+        } else if (value > (AUDIO_NOMINAL_FRAMES + 1) << 14) {
+            value = (AUDIO_NOMINAL_FRAMES + 1) << 14;
+        }
+
+        feedback = value;
+    }
+
+    feedbackFrames = 0;
+    feedbackSofs = 0;
+    stats.Feedback = feedback;
+}
+
+static void AUDIO_UpdateCapture() {
+    unsigned short position = AUDIO_Sai_CapturePosition();
+    unsigned short available = (position + AUDIO_RING_FRAMES - captureRead) % AUDIO_RING_FRAMES;
+
+    if (!captureActive) {
+        captureRead = position;
+        return;
+    }
+
+    // SOFs were missed, drop the oldest frames to keep the latency at one packet
+    if (available > AUDIO_MAX_FRAMES + 8) {
+        stats.CaptureOverruns += available - AUDIO_NOMINAL_FRAMES;
+        captureRead = (position + AUDIO_RING_FRAMES - AUDIO_NOMINAL_FRAMES) % AUDIO_RING_FRAMES;
+        available = AUDIO_NOMINAL_FRAMES;
+    }
+
+    short frames = MIN(available, AUDIO_MAX_FRAMES);
+    unsigned short index = captureRead;
+    short i = 0;
+
+    // The upper halves of the left slots of two frames make one word of the packet
+    for (; i + 1 < frames; i += 2) {
+        unsigned short next = index + 1 == AUDIO_RING_FRAMES ? 0 : index + 1;
+        capturePacket[i / 2] = __PKHTB(captureRing[next * 2], captureRing[index * 2], 16);
+        index = next + 1 == AUDIO_RING_FRAMES ? 0 : next + 1;
+    }
+    if (i < frames) {
+        capturePacket[i / 2] = (unsigned int)captureRing[index * 2] >> 16;
+    }
+
+    captureRead = (captureRead + frames) % AUDIO_RING_FRAMES;
+    USB_TransmitIso(AUDIO_EP_CAPTURE, (unsigned char *)capturePacket, frames * AUDIO_CAPTURE_FRAME);
+
+    stats.CapturePackets++;
+    stats.CaptureFrames += frames;
+    if (frames < AUDIO_NOMINAL_FRAMES - 1) {
+        stats.CaptureShort++;
+    }
+}
+
+void AUDIO_Init() {
+    AUDIO_UpdateGain();
+    AUDIO_Sai_Init(playRing, captureRing);
+    lastSof = sys_cycles();
+}
+
+void AUDIO_HandlePlayback(unsigned char ep, short length) {
+    short bytes = sizeof(playPacket);
+    USB_Fetch(ep, (unsigned char *)playPacket, &bytes);
+    short frames = bytes / AUDIO_PLAY_FRAME;
+
+    AUDIO_UpdatePlayback();
+    stats.PlayLevel = playLevel;
+
+    if (!playActive || frames == 0) {
+        return;
+    }
+
+    if (playLevel + frames > AUDIO_RING_FRAMES) {
+        stats.PlayOverruns++;
+        return;
+    }
+
+    // The packet may wrap around the end of the ring
+    short first = MIN(frames, AUDIO_RING_FRAMES - playWrite);
+    AUDIO_ConvertPlayback(playPacket, &playRing[playWrite * 2], first);
+    AUDIO_ConvertPlayback(playPacket + first, playRing, frames - first);
+
+    playWrite = (playWrite + frames) % AUDIO_RING_FRAMES;
+    playLevel += frames;
+    playStreaming = 1;
+
+    stats.PlayPackets++;
+    stats.PlayFrames += frames;
+}
+
+void AUDIO_Sof(unsigned short frame) {
+    // The host keeps its frames within 500 ns, the rest is the latency of the USB interrupt
+    unsigned int now = sys_cycles();
+    unsigned int period = SystemCoreClock / 1000;
+    unsigned int elapsed = now - lastSof;
+    lastSof = now;
+
+    if (elapsed < 2 * period) {
+        unsigned int jitter = elapsed > period ? elapsed - period : period - elapsed;
+        stats.SofJitter = jitter * 1000 / (SystemCoreClock / 1000000);
+
+        if (stats.SofJitter > stats.SofMaxJitter) {
+            stats.SofMaxJitter = stats.SofJitter;
+        }
+    }
+
+    stats.SaiErrors += AUDIO_Sai_CheckErrors();
+    AUDIO_UpdatePlayback();
+
+    if (++feedbackSofs == 1 << AUDIO_FEEDBACK_SHIFT) {
+        AUDIO_UpdateFeedback();
+    }
+
+    // 10.14 in three bytes on full speed, queued every frame the host may poll
+    unsigned char value[3] = {feedback, feedback >> 8, feedback >> 16};
+    USB_TransmitIso(AUDIO_EP_FEEDBACK, value, sizeof(value));
+
+    AUDIO_UpdateCapture();
+}
+
+static void AUDIO_Put(unsigned char *target, int value, char bytes) {
+    for (int i = 0; i < bytes; i++) {
+        target[i] = value >> (i * 8);
+    }
+}
+
+static char AUDIO_Reply(USB_SETUP_PACKET *setup, short length) {
+    USB_Transmit(0, reply, MIN(length, setup->Length));
+    return USB_OK;
+}
+
+static char AUDIO_ClockRequest(USB_SETUP_PACKET *setup, const unsigned char *data, short length) {
+    unsigned char control = setup->Value >> 8;
+
+    if ((setup->RequestType & 0x80) == 0) {
+        // Only the one rate of the codec can be selected
+        if (setup->Request == AUDIO_REQUEST_CUR && control == AUDIO_CS_SAM_FREQ && length == 4 &&
+            (data[0] | data[1] << 8 | data[2] << 16 | data[3] << 24) == AUDIO_RATE) {
+            return USB_OK;
+        }
+
+        return USB_ERR;
+    }
+
+    if (setup->Request == AUDIO_REQUEST_CUR && control == AUDIO_CS_SAM_FREQ) {
+        AUDIO_Put(reply, AUDIO_RATE, 4);
+        return AUDIO_Reply(setup, 4);
+    } else if (setup->Request == AUDIO_REQUEST_RANGE && control == AUDIO_CS_SAM_FREQ) {
+        AUDIO_Put(reply, 1, 2);
+        AUDIO_Put(reply + 2, AUDIO_RATE, 4);
+        AUDIO_Put(reply + 6, AUDIO_RATE, 4);
+        AUDIO_Put(reply + 10, 0, 4);
+        return AUDIO_Reply(setup, 14);
+    } else if (setup->Request == AUDIO_REQUEST_CUR && control == AUDIO_CS_CLOCK_VALID) {
+        reply[0] = 1;
+        return AUDIO_Reply(setup, 1);
+    }
+
+    return USB_ERR;
+}
+
+static char AUDIO_VolumeRequest(USB_SETUP_PACKET *setup, const unsigned char *data, short length) {
+    unsigned char control = setup->Value >> 8;
+
+    // Only the master channel has controls
+    if ((setup->Value & 0xFF) != 0) {
+        return USB_ERR;
+    }
+
+    if ((setup->RequestType & 0x80) == 0) {
+        if (setup->Request != AUDIO_REQUEST_CUR) {
+            return USB_ERR;
+        }
+
+        if (control == AUDIO_FU_MUTE && length >= 1) {
+            mute = data[0] != 0;
+        } else if (control == AUDIO_FU_VOLUME && length >= 2) {
+            short value = data[0] | data[1] << 8;
+            volume = value < AUDIO_VOLUME_MIN ? AUDIO_VOLUME_MIN : value > AUDIO_VOLUME_MAX ? AUDIO_VOLUME_MAX : value;
+        } else {
+            return USB_ERR;
+        }
+
+        AUDIO_UpdateGain();
+        return USB_OK;
+    }
+
+    if (setup->Request == AUDIO_REQUEST_CUR && control == AUDIO_FU_MUTE) {
+        reply[0] = mute;
+        return AUDIO_Reply(setup, 1);
+    } else if (setup->Request == AUDIO_REQUEST_CUR && control == AUDIO_FU_VOLUME) {
+        AUDIO_Put(reply, volume, 2);
+        return AUDIO_Reply(setup, 2);
+    } else if (setup->Request == AUDIO_REQUEST_RANGE && control == AUDIO_FU_VOLUME) {
+        AUDIO_Put(reply, 1, 2);
+        AUDIO_Put(reply + 2, AUDIO_VOLUME_MIN, 2);
+        AUDIO_Put(reply + 4, AUDIO_VOLUME_MAX, 2);
+        AUDIO_Put(reply + 6, AUDIO_VOLUME_RES, 2);
+        return AUDIO_Reply(setup, 8);
+    }
+
+    return USB_ERR;
+}
+
+char AUDIO_SetupPacket(USB_SETUP_PACKET *setup, const unsigned char *data, short length) {
+    if ((setup->RequestType & 0x60) == 0x40) {
+        // Vendor request to the device, the counters for Tools/audio_stats.py
+        if (setup->Request == AUDIO_STATS_REQUEST && (setup->RequestType & 0x80) != 0) {
+            snapshot = stats;
+            if (setup->Value == 1) {
+                stats = (AUDIO_Stats){0};
+            }
+
+            USB_Transmit(0, (unsigned char *)&snapshot, MIN(sizeof(snapshot), setup->Length));
+            return USB_OK;
+        }
+
+        return USB_ERR;
+    }
+
+    // Class requests address an entity in the upper byte of wIndex
+    switch (setup->Index >> 8) {
+    case AUDIO_ID_CLOCK:
+        return AUDIO_ClockRequest(setup, data, length);
+    case AUDIO_ID_VOLUME:
+        return AUDIO_VolumeRequest(setup, data, length);
+    }
+
+    return USB_ERR;
+}
+
+void AUDIO_Reset(char interface, char alternateId) {
+    if (interface == 1) {
+        playActive = alternateId == 1;
+        playStreaming = 0;
+    } else if (interface == 2) {
+        captureActive = alternateId == 1;
+    }
+}
+
+const AUDIO_Stats *AUDIO_GetStats() {
+    return &stats;
+}
@@ -0,0 +1,93 @@
+#include "audio/audio_sai.h"
+
+#if !defined(STM32G441xx) && !defined(STM32G474xx)
+#error "The audio interface is only implemented for stm32g4"
+#endif
+
+#define AUDIO_PLAY_DMA DMA2_Channel1
+#define AUDIO_CAPTURE_DMA DMA2_Channel2
+// The DMAMUX channels of DMA2 follow the ones of DMA1, which has 8 channels on the stm32g474 and 6 on the stm32g441
+#if defined(STM32G474xx)
+#define AUDIO_PLAY_MUX DMAMUX1_Channel8
+#define AUDIO_CAPTURE_MUX DMAMUX1_Channel9
+#else
+#define AUDIO_PLAY_MUX DMAMUX1_Channel6
+#define AUDIO_CAPTURE_MUX DMAMUX1_Channel7
+#endif
+#define AUDIO_SAI1_A 108
+#define AUDIO_SAI1_B 109
+
+// I2S framing: 2 slots of 32 bit, FS low for the left channel and one bit ahead of the data
+#define AUDIO_SAI_FRCR ((63 << SAI_xFRCR_FRL_Pos) | (31 << SAI_xFRCR_FSALL_Pos) | SAI_xFRCR_FSDEF | SAI_xFRCR_FSOFF)
+#define AUDIO_SAI_SLOTR ((1 << SAI_xSLOTR_NBSLOT_Pos) | (0x3 << SAI_xSLOTR_SLOTEN_Pos))
+#define AUDIO_SAI_DS_32 (7 << SAI_xCR1_DS_Pos)
+
+static unsigned short AUDIO_Sai_Position(DMA_Channel_TypeDef *dma) {
+    // CNDTR counts the slots left until the ring wraps, a frame is complete once both of its slots moved
+    return (AUDIO_RING_FRAMES * 2 - dma->CNDTR) / 2;
+}
+
+void AUDIO_Sai_Init(int *playback, int *capture) {
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA2EN | RCC_AHB1ENR_DMAMUX1EN;
+    RCC->AHB2ENR |= RCC_AHB2ENR_GPIOAEN | RCC_AHB2ENR_GPIOBEN;
+    RCC->APB2ENR |= RCC_APB2ENR_SAI1EN;
+
+    // PA8 (SCK_A) & PA10 (SD_A) on AF14, PB9 (FS_A) on AF14, PB5 (SD_B) on AF12
+    GPIOA->MODER = (GPIOA->MODER & ~(GPIO_MODER_MODE8 | GPIO_MODER_MODE10)) | GPIO_MODER_MODE8_1 | GPIO_MODER_MODE10_1;
+    GPIOA->AFR[1] = (GPIOA->AFR[1] & ~(GPIO_AFRH_AFSEL8 | GPIO_AFRH_AFSEL10)) | (14 << GPIO_AFRH_AFSEL8_Pos) | (14 << GPIO_AFRH_AFSEL10_Pos);
+    GPIOA->OSPEEDR |= GPIO_OSPEEDR_OSPEED10_0;
+    GPIOB->MODER = (GPIOB->MODER & ~(GPIO_MODER_MODE5 | GPIO_MODER_MODE9)) | GPIO_MODER_MODE5_1 | GPIO_MODER_MODE9_1;
+    GPIOB->AFR[0] = (GPIOB->AFR[0] & ~GPIO_AFRL_AFSEL5) | (12 << GPIO_AFRL_AFSEL5_Pos);
+    GPIOB->AFR[1] = (GPIOB->AFR[1] & ~GPIO_AFRH_AFSEL9) | (14 << GPIO_AFRH_AFSEL9_Pos);
+
+    // Both rings run circular without interrupts, their positions are sampled on SOF & on every packet
+    AUDIO_PLAY_MUX->CCR = AUDIO_SAI1_A << DMAMUX_CxCR_DMAREQ_ID_Pos;
+    AUDIO_PLAY_DMA->CPAR = (unsigned int)&SAI1_Block_A->DR;
+    AUDIO_PLAY_DMA->CMAR = (unsigned int)playback;
+    AUDIO_PLAY_DMA->CNDTR = AUDIO_RING_FRAMES * 2;
+    AUDIO_PLAY_DMA->CCR = DMA_CCR_PL_1 | DMA_CCR_MSIZE_1 | DMA_CCR_PSIZE_1 | DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_DIR | DMA_CCR_EN;
+
+    AUDIO_CAPTURE_MUX->CCR = AUDIO_SAI1_B << DMAMUX_CxCR_DMAREQ_ID_Pos;
+    AUDIO_CAPTURE_DMA->CPAR = (unsigned int)&SAI1_Block_B->DR;
+    AUDIO_CAPTURE_DMA->CMAR = (unsigned int)capture;
+    AUDIO_CAPTURE_DMA->CNDTR = AUDIO_RING_FRAMES * 2;
+    AUDIO_CAPTURE_DMA->CCR = DMA_CCR_PL_1 | DMA_CCR_MSIZE_1 | DMA_CCR_PSIZE_1 | DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_EN;
+
+    // Block A: slave transmitter on the codec clocks, block B: slave receiver synchronous to block A
+    SAI1_Block_A->FRCR = AUDIO_SAI_FRCR;
+    SAI1_Block_A->SLOTR = AUDIO_SAI_SLOTR;
+    SAI1_Block_A->CR2 = SAI_xCR2_FTH_1;
+    SAI1_Block_A->CR1 = SAI_xCR1_MODE_1 | AUDIO_SAI_DS_32 | SAI_xCR1_DMAEN;
+
+    SAI1_Block_B->FRCR = AUDIO_SAI_FRCR;
+    SAI1_Block_B->SLOTR = AUDIO_SAI_SLOTR;
+    SAI1_Block_B->CR2 = SAI_xCR2_FTH_1;
+    SAI1_Block_B->CR1 = SAI_xCR1_MODE_1 | SAI_xCR1_MODE_0 | AUDIO_SAI_DS_32 | SAI_xCR1_SYNCEN_0 | SAI_xCR1_DMAEN;
+
+    // The synchronous block first, so it does not miss the first frame of block A
+    SAI1_Block_B->CR1 |= SAI_xCR1_SAIEN;
+    SAI1_Block_A->CR1 |= SAI_xCR1_SAIEN;
+}
+
+unsigned short AUDIO_Sai_PlaybackPosition() {
+    return AUDIO_Sai_Position(AUDIO_PLAY_DMA);
+}
+
+unsigned short AUDIO_Sai_CapturePosition() {
+    return AUDIO_Sai_Position(AUDIO_CAPTURE_DMA);
+}
+
+char AUDIO_Sai_CheckErrors() {
+    char errors = 0;
+
+    if ((SAI1_Block_A->SR & SAI_xSR_OVRUDR) != 0) {
+        SAI1_Block_A->CLRFR = SAI_xCLRFR_COVRUDR;
+        errors++;
+    }
+    if ((SAI1_Block_B->SR & SAI_xSR_OVRUDR) != 0) {
+        SAI1_Block_B->CLRFR = SAI_xCLRFR_COVRUDR;
+        errors++;
+    }
+
+    return errors;
+}
@@ -0,0 +1,41 @@
+#include "boot.h"
+
+// The core runs from the HSI16 out of reset until CLOCK_Init switched the clock
+#define BOOT_RESET_MHZ 16
+
+static unsigned int times[BOOT_PHASES];
+static unsigned int timebaseStart = 0; // us from reset to Timebase_Init
+
+void BOOT_Start() {
+#if (__CORTEX_M >= 3)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+void BOOT_Mark(BOOT_PHASE phase) {
+    if (times[phase] != 0) {
+        return;
+    }
+
+    switch (phase) {
+#if (__CORTEX_M >= 3)
+    case BOOT_MAIN:
+        times[phase] = DWT->CYCCNT / BOOT_RESET_MHZ;
+        break;
+    case BOOT_CLOCK:
+        // CLOCK_Init mostly waits for the oscillators at the reset clock, the few cycles after the switch are counted too long
+        timebaseStart = DWT->CYCCNT / BOOT_RESET_MHZ;
+        times[phase] = timebaseStart;
+        break;
+#endif
+    default:
+        times[phase] = timebaseStart + sys_now_us();
+        break;
+    }
+}
+
+const unsigned int *BOOT_GetTimes() {
+    return times;
+}
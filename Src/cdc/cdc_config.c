@@ -1,14 +1,14 @@
 #include "cdc/cdc_config.h"
 #include "cdc/cdc_device.h"
 
-// Example definition for a Virtual COM Port
+// Example definition for a Virtual COM Port, one ACM function per port grouped by an interface association
 static const USB_DESCRIPTOR_DEVICE DeviceDescriptor = {
     .Length = 18,
     .Type = 0x01,
-    .USBVersion = 0x0200,
-    .DeviceClass = 0x02,
-    .DeviceSubClass = 0x00,
-    .DeviceProtocol = 0x00,
+    .USBVersion = 0x0201, // 2.01 for the BOS descriptor (LPM)
+    .DeviceClass = 0xEF,
+    .DeviceSubClass = 0x02,
+    .DeviceProtocol = 0x01,
     .MaxPacketSize = 64,
     .VendorID = 0xDEAD,  // 0x0483,
     .ProductID = 0xBEEF, // 0x5740,
@@ -21,13 +21,24 @@ static const USB_DESCRIPTOR_DEVICE DeviceDescriptor = {
 static const USB_DESCRIPTOR_CONFIG ConfigDescriptor = {
     .Length = 9,
     .Type = 0x02,
-    .TotalLength = 62,
-    .Interfaces = 2,
+    .TotalLength = 9 + CDC_PORTS * CDC_FUNCTION_LENGTH,
+    .Interfaces = 2 * CDC_PORTS,
     .ConfigurationID = 1,
     .strConfiguration = 0,
-    .Attributes = (1 << 7),
+    .Attributes = (1 << 7) | (1 << 5), // Remote wakeup
     .MaxPower = 50};
 
+// Templates for the descriptors of port 0, the interface & endpoint numbers are adjusted for every port
+static const USB_FUNC_IAD CDCFunction = {
+    .Length = 8,
+    .DescriptorType = 0x0B,
+    .FirstInterface = 0,
+    .InterfaceCount = 2,
+    .Class = 0x02,
+    .SubClass = 0x02,
+    .Protocol = 0x01,
+    .strFunction = 0};
+
 static const USB_DESCRIPTOR_INTERFACE CDCManagementInterface = {
     .Length = 9,
     .Type = 0x04,
@@ -51,13 +62,6 @@ static const USB_DESC_FUNC_ACM CDCFuncACM = {
     .SubType = 0x02,
     .Capabilities = (1 << 1)};
 
-static const USB_DESC_FUNC_CallManagement CDCFuncCall = {
-    .Length = 5,
-    .Type = 0x24,
-    .SubType = 0x01,
-    .Capabilities = 0x00,
-    .DataInterface = 1};
-
 static const USB_DESC_FUNC_UNION1 CDCFuncUnion = {
     .Length = 5,
     .Type = 0x24,
@@ -99,36 +103,53 @@ static const USB_DESCRIPTOR_ENDPOINT CDCDataEndpoints[2] = {
      .Interval = 0x00}};
 
 // Buffer holding the complete descriptor (except the device one) in the correct order
-static char ConfigurationBuffer[62] = {0};
-
-static const USB_CONFIG_EP EndpointConfigs[2] = {
-    {.EP = 1,
-     .RxBufferSize = 0,
-     .TxBufferSize = 8,
-     .Type = USB_EP_INTERRUPT},
-    {.EP = 2,
-     .RxBufferSize = 64,
-     .TxBufferSize = 64,
-     .RxCallback = CDC_HandlePacket,
-     .Type = USB_EP_BULK}};
-
-static char *GetConfigDescriptor(short *length) {
-    if (ConfigurationBuffer[0] == 0) {
-        USB_BuildDescriptor(ConfigurationBuffer, sizeof(ConfigurationBuffer), 9,
-                            (const void *[]){
-                                &ConfigDescriptor,
-                                &CDCManagementInterface,
-                                &CDCFuncHeader,
-                                &CDCFuncACM,
-                                &CDCFuncUnion,
-                                &CDCNotificationEndpoint,
-                                &CDCDataInterface,
-                                &CDCDataEndpoints[0],
-                                &CDCDataEndpoints[1]});
-    }
+static char ConfigurationBuffer[9 + CDC_PORTS * CDC_FUNCTION_LENGTH] = {0};
+
+static USB_CONFIG_EP EndpointConfigs[2 * CDC_PORTS];
+
+unsigned short CDC_BuildFunction(unsigned char *buffer, unsigned short size, unsigned char port) {
+    USB_FUNC_IAD function = CDCFunction;
+    USB_DESCRIPTOR_INTERFACE management = CDCManagementInterface;
+    USB_DESC_FUNC_UNION1 funcUnion = CDCFuncUnion;
+    USB_DESCRIPTOR_ENDPOINT notification = CDCNotificationEndpoint;
+    USB_DESCRIPTOR_INTERFACE data = CDCDataInterface;
+    USB_DESCRIPTOR_ENDPOINT dataEndpoints[2] = {CDCDataEndpoints[0], CDCDataEndpoints[1]};
+
+    function.FirstInterface = CDC_PORT_INTERFACE(port);
+    management.InterfaceID = CDC_PORT_INTERFACE(port);
+    funcUnion.ControlInterface = CDC_PORT_INTERFACE(port);
+    funcUnion.SubInterface0 = CDC_PORT_INTERFACE(port) + 1;
+    data.InterfaceID = CDC_PORT_INTERFACE(port) + 1;
+    notification.Address = (1 << 7) | CDC_PORT_NOTIFY_EP(port);
+    dataEndpoints[0].Address = (1 << 7) | CDC_PORT_DATA_EP(port);
+    dataEndpoints[1].Address = CDC_PORT_DATA_EP(port);
+
+    return USB_BuildDescriptor(buffer, size, 9,
+                               (const void *[]){
+                                   &function,
+                                   &management,
+                                   &CDCFuncHeader,
+                                   &CDCFuncACM,
+                                   &funcUnion,
+                                   &notification,
+                                   &data,
+                                   &dataEndpoints[0],
+                                   &dataEndpoints[1]});
+}
 
-    *length = sizeof(ConfigurationBuffer);
-    return ConfigurationBuffer;
+void CDC_GetEndpoints(USB_CONFIG_EP *endpoints, unsigned char port) {
+    endpoints[0] = (USB_CONFIG_EP){
+        .EP = CDC_PORT_NOTIFY_EP(port),
+        .RxBufferSize = 0,
+        .TxBufferSize = 8,
+        .Type = USB_EP_INTERRUPT};
+    endpoints[1] = (USB_CONFIG_EP){
+        .EP = CDC_PORT_DATA_EP(port),
+        .RxBufferSize = 64,
+        .TxBufferSize = 64,
+        .RxCallback = CDC_HandlePacket,
+        .TxCallback = CDC_TransmitComplete,
+        .Type = USB_EP_BULK};
 }
 
 static unsigned short *GetString(char index, short lcid, short *length) {
@@ -149,27 +170,26 @@ static char SetupPacket_Handler(USB_SETUP_PACKET *setup, const unsigned char *da
 
 USB_Implementation CDC_GetImplementation() {
     USB_Implementation impl = {0};
-    unsigned short len = USB_BuildDescriptor(ConfigurationBuffer, sizeof(ConfigurationBuffer), 9,
-                                             (const void *[]){
-                                                 &ConfigDescriptor,
-                                                 &CDCManagementInterface,
-                                                 &CDCFuncHeader,
-                                                 &CDCFuncACM,
-                                                 &CDCFuncUnion,
-                                                 &CDCNotificationEndpoint,
-                                                 &CDCDataInterface,
-                                                 &CDCDataEndpoints[0],
-                                                 &CDCDataEndpoints[1]});
+    unsigned short len = USB_BuildDescriptor(ConfigurationBuffer, sizeof(ConfigurationBuffer), 1,
+                                             (const void *[]){&ConfigDescriptor});
+
+    CDC_Init();
+
+    for (int i = 0; i < CDC_PORTS; i++) {
+        len += CDC_BuildFunction(ConfigurationBuffer + len, sizeof(ConfigurationBuffer) - len, i);
+        CDC_GetEndpoints(&EndpointConfigs[2 * i], i);
+    }
 
     impl.DeviceDescriptor = &DeviceDescriptor;
     impl.ConfigDescriptor = ConfigurationBuffer;
     impl.ConfigDescriptorLength = len;
     impl.Endpoints = EndpointConfigs;
-    impl.NumEndpoints = 2;
-    impl.NumInterfaces = 2;
+    impl.NumEndpoints = 2 * CDC_PORTS;
+    impl.NumInterfaces = 2 * CDC_PORTS;
 
     impl.GetString = &GetString;
     impl.SetupPacket_Handler = &SetupPacket_Handler;
+    impl.RemapEndpoints_Handler = &CDC_RemapEndpoints;
 
     return impl;
-}
\ No newline at end of file
+}
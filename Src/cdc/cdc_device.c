@@ -1,31 +1,363 @@
 #include "cdc/cdc_device.h"
 
-static char buffer[64];
-static char lineCoding[7];
+#include <string.h>
+
+#define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
+
+#if (CDC_RX_BUFFER & (CDC_RX_BUFFER - 1)) != 0 || (CDC_TX_BUFFER & (CDC_TX_BUFFER - 1)) != 0
+#error "CDC_RX_BUFFER and CDC_TX_BUFFER have to be a power of two"
+#endif
+
+#if CDC_RX_BUFFER < CDC_PACKET_SIZE
+#error "CDC_RX_BUFFER has to hold at least one packet"
+#endif
+
+// Single producer / single consumer rings, Head is only written by the producer and Tail only by the consumer
+typedef struct {
+    char Data[CDC_RX_BUFFER];
+    volatile unsigned short Head;
+    volatile unsigned short Tail;
+    volatile short Pending; // Length of the packet held in the USB-SRAM while the endpoint NAKs, 0 if none
+    unsigned short DropTo;        // Head when CDC_Reset ran, the reader moves Tail there
+    volatile unsigned char Drops; // Incremented by CDC_Reset
+    unsigned char DropsSeen;      // Drops the reader already applied
+} CDC_RxRing;
+
+typedef struct {
+    char Data[CDC_TX_BUFFER];
+    volatile unsigned short Head;
+    volatile unsigned short Tail;
+    volatile unsigned short InFlight; // Bytes from Tail on, currently handed to USB_Transmit
+    unsigned short DropTo;            // Head when CDC_Reset ran during a transfer, Tail moves there once it is done
+    volatile char Drop;
+} CDC_TxRing;
+
+typedef struct {
+    unsigned char Interface; // Communication interface, the data interface follows
+    unsigned char DataEP;
+    unsigned char LineCoding[7];
+    CDC_RxRing Rx;
+    CDC_TxRing Tx;
+    void (*ReceiveHandler)(const char *data, short length);
+    char (*LineCodingHandler)(const CDC_LINECODING *coding);
+    void (*ResetHandler)();
+} CDC_Port;
+
+#define CDC_RING_USED(ring) ((unsigned short)((ring).Head - (ring).Tail))
+#define CDC_RING_FREE(ring, size) ((size) - CDC_RING_USED(ring))
+#define CDC_NOPORT 0xFF
+
+static char buffer[CDC_PACKET_SIZE];
+static CDC_Port ports[CDC_PORTS] = {0};
+
+// Route endpoints and interfaces to their port in O(1)
+static unsigned char portByEndpoint[USB_NumEndpoints];
+static unsigned char portByInterface[2 * CDC_PORTS + CDC_INTERFACE_BASE];
+
+static void CDC_StartTransmit(CDC_Port *port) {
+    // Send the contiguous part of the ring from Tail on, the rest follows from the TX-complete callback
+    unsigned short used = CDC_RING_USED(port->Tx);
+    unsigned short offset = port->Tx.Tail & (CDC_TX_BUFFER - 1);
+    unsigned short length = CDC_TX_BUFFER - offset;
+
+    if (length > used) {
+        length = used;
+    }
+
+    port->Tx.InFlight = length;
+    if (length > 0) {
+        USB_Transmit(port->DataEP, port->Tx.Data + offset, length);
+    }
+}
+
+static void CDC_ApplyReset(CDC_Port *port) {
+    // Tail belongs to the reader, CDC_Reset only records up to where the received data is dropped
+    unsigned int primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (port->Rx.DropsSeen != port->Rx.Drops) {
+        port->Rx.DropsSeen = port->Rx.Drops;
+        port->Rx.Tail = port->Rx.DropTo;
+    }
+
+    __set_PRIMASK(primask);
+}
+
+static void CDC_ReceivePacket(CDC_Port *port, short length) {
+    if (port->ReceiveHandler != 0) {
+        USB_Fetch(port->DataEP, buffer, &length);
+        port->ReceiveHandler(buffer, length);
+        return;
+    }
+
+    if (CDC_RING_FREE(port->Rx, CDC_RX_BUFFER) < length) {
+        // Leave the packet in the USB-SRAM and NAK the host until CDC_Read made room for it
+        port->Rx.Pending = length;
+        USB_PauseReceive(port->DataEP);
+        return;
+    }
+
+    unsigned short offset = port->Rx.Head & (CDC_RX_BUFFER - 1);
+    USB_Fetch(port->DataEP, buffer, &length);
+
+    short first = MIN(length, CDC_RX_BUFFER - offset);
+    memcpy(port->Rx.Data + offset, buffer, first);
+    memcpy(port->Rx.Data, buffer + first, length - first);
+    port->Rx.Head += length;
+}
+
+static void CDC_Route() {
+    for (int i = 0; i < USB_NumEndpoints; i++) {
+        portByEndpoint[i] = CDC_NOPORT;
+    }
+
+    for (int i = 0; i < sizeof(portByInterface); i++) {
+        portByInterface[i] = CDC_NOPORT;
+    }
+
+    for (int i = 0; i < CDC_PORTS; i++) {
+        portByEndpoint[ports[i].DataEP] = i;
+        portByInterface[ports[i].Interface] = i;
+        portByInterface[ports[i].Interface + 1] = i;
+    }
+}
+
+void CDC_Init() {
+    for (int i = 0; i < CDC_PORTS; i++) {
+        ports[i].Interface = CDC_PORT_INTERFACE(i);
+        ports[i].DataEP = CDC_PORT_DATA_EP(i);
+    }
+
+    CDC_Route();
+}
+
+void CDC_RemapEndpoints(const unsigned char *map) {
+    for (int i = 0; i < CDC_PORTS; i++) {
+        ports[i].DataEP = map[CDC_PORT_DATA_EP(i)];
+    }
+
+    CDC_Route();
+}
+
+void CDC_TransmitComplete(unsigned char ep, short length) {
+    if (portByEndpoint[ep] == CDC_NOPORT) {
+        return;
+    }
+
+    // CDC_Write may run in a higher priority interrupt and must not see InFlight before the next transfer is set up
+    CDC_Port *port = &ports[portByEndpoint[ep]];
+    unsigned int primask = __get_PRIMASK();
+    __disable_irq();
+
+    port->Tx.Tail += port->Tx.InFlight;
+    if (port->Tx.Drop) {
+        port->Tx.Drop = 0;
+        port->Tx.Tail = port->Tx.DropTo;
+    }
+    CDC_StartTransmit(port);
+
+    __set_PRIMASK(primask);
+}
+
+void CDC_SetReceiveHandler(unsigned char port, void (*handler)(const char *data, short length)) {
+    if (port < CDC_PORTS) {
+        ports[port].ReceiveHandler = handler;
+    }
+}
+
+void CDC_SetLineCodingHandler(unsigned char port, char (*handler)(const CDC_LINECODING *coding)) {
+    if (port < CDC_PORTS) {
+        ports[port].LineCodingHandler = handler;
+    }
+}
+
+void CDC_SetResetHandler(unsigned char port, void (*handler)()) {
+    if (port < CDC_PORTS) {
+        ports[port].ResetHandler = handler;
+    }
+}
 
 char CDC_SetupPacket(USB_SETUP_PACKET *setup, char *data, short length) {
+    if (setup->Index >= sizeof(portByInterface) || portByInterface[setup->Index] == CDC_NOPORT) {
+        return USB_ERR;
+    }
+
+    CDC_Port *port = &ports[portByInterface[setup->Index]];
+
     // Windows requires us to remember the line coding
     switch (setup->Request) {
     case CDC_CONFIG_CONTROLLINESTATE:
-        break;
+        // The port was (re)opened, nobody is interested in what is left from before
+        CDC_Reset(portByInterface[setup->Index]);
+        return USB_OK;
     case CDC_CONFIG_GETLINECODING:
-        USB_Transmit(0, lineCoding, 7);
-        break;
+        USB_Transmit(0, port->LineCoding, 7);
+        return USB_OK;
     case CDC_CONFIG_SETLINECODING:
+        if (port->LineCodingHandler != 0) {
+            CDC_LINECODING coding = {
+                .BaudRate = (unsigned char)data[0] | (unsigned char)data[1] << 8 | (unsigned char)data[2] << 16 | (unsigned char)data[3] << 24,
+                .StopBits = data[4],
+                .Parity = data[5],
+                .DataBits = data[6]};
+
+            // A refused line coding is stalled and GET_LINE_CODING keeps reporting the one in use
+            if (port->LineCodingHandler(&coding) != USB_OK) {
+                return USB_ERR;
+            }
+        }
+
         for (int i = 0; i < 7; i++) {
-            lineCoding[i] = data[i];
+            port->LineCoding[i] = data[i];
         }
         return USB_OK;
-        break;
     }
+
+    return USB_ERR;
 }
 
 void CDC_HandlePacket(unsigned char ep, short length) {
-    // Just mirror the text
-    USB_Fetch(2, buffer, &length);
+    if (portByEndpoint[ep] != CDC_NOPORT) {
+        CDC_ReceivePacket(&ports[portByEndpoint[ep]], length);
+    }
+}
+
+void CDC_Reset(unsigned char index) {
+    if (index >= CDC_PORTS) {
+        return;
+    }
+
+    CDC_Port *port = &ports[index];
+    unsigned int primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (port->ResetHandler != 0) {
+        // Blocks handed out by CDC_Peek are released first, they are gone with the ring
+        port->ResetHandler();
+    }
+
+    // Each side only moves its own index: Rx.Tail is left to the reader, Tx.Head to the writer. The block of a running
+    // transfer stays in the TX ring until it was sent
+    port->Rx.DropTo = port->Rx.Head;
+    port->Rx.Drops++;
 
-    // do NOT busy wait. We are still in the ISR, it will never clear.
-    if (!USB_IsTransmitPending(2)) {
-        USB_Transmit(2, buffer, length);
+    if (port->Tx.InFlight > 0) {
+        port->Tx.DropTo = port->Tx.Head;
+        port->Tx.Drop = 1;
+    } else {
+        port->Tx.Tail = port->Tx.Head;
     }
+
+    if (port->Rx.Pending > 0) {
+        port->Rx.Pending = 0;
+        USB_ResumeReceive(port->DataEP);
+    }
+
+    __set_PRIMASK(primask);
+}
+
+short CDC_Read(unsigned char index, char *data, short length) {
+    if (index >= CDC_PORTS) {
+        return 0;
+    }
+
+    CDC_Port *port = &ports[index];
+    CDC_ApplyReset(port);
+
+    unsigned short used = CDC_RING_USED(port->Rx);
+    unsigned short offset = port->Rx.Tail & (CDC_RX_BUFFER - 1);
+
+    length = MIN(length, used);
+
+    short first = MIN(length, CDC_RX_BUFFER - offset);
+    memcpy(data, port->Rx.Data + offset, first);
+    memcpy(data + first, port->Rx.Data, length - first);
+    CDC_Consume(index, length);
+
+    return length;
+}
+
+const char *CDC_Peek(unsigned char index, short *length) {
+    if (index >= CDC_PORTS) {
+        *length = 0;
+        return 0;
+    }
+
+    CDC_Port *port = &ports[index];
+    CDC_ApplyReset(port);
+
+    unsigned short used = CDC_RING_USED(port->Rx);
+    unsigned short offset = port->Rx.Tail & (CDC_RX_BUFFER - 1);
+
+    *length = MIN(used, CDC_RX_BUFFER - offset);
+    return port->Rx.Data + offset;
+}
+
+void CDC_Consume(unsigned char index, short length) {
+    if (index >= CDC_PORTS) {
+        return;
+    }
+
+    CDC_Port *port = &ports[index];
+    port->Rx.Tail += length;
+
+    if (port->Rx.Pending > 0 && CDC_RING_FREE(port->Rx, CDC_RX_BUFFER) >= port->Rx.Pending) {
+        // Take the held packet first, then let the host send the next one
+        unsigned int primask = __get_PRIMASK();
+        __disable_irq();
+
+        // CDC_Reset may have released the packet meanwhile
+        short pending = port->Rx.Pending;
+        if (pending > 0) {
+            port->Rx.Pending = 0;
+            CDC_ReceivePacket(port, pending);
+            USB_ResumeReceive(port->DataEP);
+        }
+
+        __set_PRIMASK(primask);
+    }
+}
+
+short CDC_Available(unsigned char index) {
+    if (index >= CDC_PORTS) {
+        return 0;
+    }
+
+    CDC_ApplyReset(&ports[index]);
+    return CDC_RING_USED(ports[index].Rx);
+}
+
+short CDC_Write(unsigned char index, const char *data, short length) {
+    if (index >= CDC_PORTS) {
+        return 0;
+    }
+
+    CDC_Port *port = &ports[index];
+    unsigned short offset = port->Tx.Head & (CDC_TX_BUFFER - 1);
+
+    length = MIN(length, CDC_RING_FREE(port->Tx, CDC_TX_BUFFER));
+
+    short first = MIN(length, CDC_TX_BUFFER - offset);
+    memcpy(port->Tx.Data + offset, data, first);
+    memcpy(port->Tx.Data, data + first, length - first);
+    port->Tx.Head += length;
+
+    // Only kick off a transfer if the TX-complete callback is not already draining the ring
+    unsigned int primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (port->Tx.InFlight == 0) {
+        CDC_StartTransmit(port);
+    }
+
+    __set_PRIMASK(primask);
+    return length;
+}
+
+short CDC_WriteSpace(unsigned char index) {
+    if (index >= CDC_PORTS) {
+        return 0;
+    }
+
+    return CDC_RING_FREE(ports[index].Tx, CDC_TX_BUFFER);
 }
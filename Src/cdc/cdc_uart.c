@@ -0,0 +1,190 @@
+#include "cdc/cdc_uart.h"
+
+#if !defined(STM32G441xx) && !defined(STM32G474xx)
+#error "The CDC to UART bridge is only implemented for stm32g4"
+#endif
+
+#define CDC_UART UART4
+#define CDC_UART_RX DMA1_Channel4
+#define CDC_UART_TX DMA1_Channel5
+#define CDC_UART_RX_MUX DMAMUX1_Channel3
+#define CDC_UART_TX_MUX DMAMUX1_Channel4
+#define CDC_UART4_RX 30
+#define CDC_UART4_TX 31
+
+static char rxDma[CDC_UART_RX_DMA];
+static unsigned short rxPosition = 0;      // First byte in rxDma not yet passed on to the host
+static volatile unsigned short txSize = 0; // Bytes currently sent from the CDC RX ring by DMA
+static CDC_UartStats stats = {0};
+
+static void CDC_Uart_Receive() {
+    // Everything between the last position and the DMA pointer is new, possibly wrapping around the buffer end
+    unsigned short position = CDC_UART_RX_DMA - CDC_UART_RX->CNDTR;
+
+    while (rxPosition != position) {
+        unsigned short end = position > rxPosition ? position : CDC_UART_RX_DMA;
+        short length = end - rxPosition;
+        short queued = CDC_Write(CDC_UART_PORT, rxDma + rxPosition, length);
+
+        stats.RxBytes += queued;
+        stats.Dropped += length - queued;
+        rxPosition = end == CDC_UART_RX_DMA ? 0 : end;
+    }
+}
+
+static void CDC_Uart_Transmit() {
+    // Send straight out of the CDC ring, it is released once the DMA is done
+    unsigned int primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (txSize == 0) {
+        short length;
+        const char *data = CDC_Peek(CDC_UART_PORT, &length);
+
+        if (length > 0) {
+            txSize = length;
+            CDC_UART_TX->CCR &= ~DMA_CCR_EN;
+            CDC_UART_TX->CMAR = (unsigned int)data;
+            CDC_UART_TX->CNDTR = length;
+            CDC_UART_TX->CCR |= DMA_CCR_EN;
+        }
+    }
+
+    __set_PRIMASK(primask);
+}
+
+static char CDC_Uart_LineCoding(const CDC_LINECODING *coding) {
+    unsigned int clock = SystemCoreClock >> APBPrescTable[(RCC->CFGR & RCC_CFGR_PPRE1_Msk) >> RCC_CFGR_PPRE1_Pos];
+    unsigned int cr1 = CDC_UART->CR1 & ~(USART_CR1_UE | USART_CR1_M0 | USART_CR1_M1 | USART_CR1_PCE | USART_CR1_PS);
+    unsigned int cr2 = CDC_UART->CR2 & ~USART_CR2_STOP;
+
+    // Only 7 or 8 data bits with none, odd or even parity map to the USART word. Mark / space parity and 5 or 6 data
+    // bits are refused and the UART keeps running as before
+    if (coding->BaudRate == 0 || coding->Parity > 2 || (coding->DataBits != 7 && coding->DataBits != 8)) {
+        return USB_ERR;
+    }
+
+    // The parity bit is part of the word: 7 data bits + parity = 8 bit word, 8 + parity = 9
+    char bits = coding->DataBits + (coding->Parity != 0 ? 1 : 0);
+    if (bits == 9) {
+        cr1 |= USART_CR1_M0;
+    } else if (bits == 7) {
+        cr1 |= USART_CR1_M1;
+    }
+
+    if (coding->Parity == 1) {
+        cr1 |= USART_CR1_PCE | USART_CR1_PS;
+    } else if (coding->Parity == 2) {
+        cr1 |= USART_CR1_PCE;
+    }
+
+    if (coding->StopBits == 1) {
+        cr2 |= USART_CR2_STOP_0 | USART_CR2_STOP_1;
+    } else if (coding->StopBits == 2) {
+        cr2 |= USART_CR2_STOP_1;
+    }
+
+    // Above clock / 16 (4.49 MBaud at 71.875MHz) switch to 8x oversampling, BRR[3] has to be 0 then
+    unsigned int div = (clock + coding->BaudRate / 2) / coding->BaudRate;
+    if (div < 16) {
+        cr1 |= USART_CR1_OVER8;
+        div = (2 * clock + coding->BaudRate / 2) / coding->BaudRate;
+        div = (div & ~0x0F) | ((div & 0x0F) >> 1);
+    } else {
+        cr1 &= ~USART_CR1_OVER8;
+    }
+
+    CDC_UART->CR1 &= ~USART_CR1_UE;
+    CDC_UART->BRR = div;
+    CDC_UART->CR2 = cr2;
+    CDC_UART->CR1 = cr1 | USART_CR1_UE;
+    return USB_OK;
+}
+
+void UART4_IRQHandler() {
+    unsigned int isr = CDC_UART->ISR;
+
+    if ((isr & USART_ISR_ORE) != 0) {
+        stats.Overruns++;
+    }
+    if ((isr & (USART_ISR_FE | USART_ISR_NE | USART_ISR_PE)) != 0) {
+        stats.Framing++;
+    }
+
+    CDC_UART->ICR = USART_ICR_IDLECF | USART_ICR_ORECF | USART_ICR_FECF | USART_ICR_NECF | USART_ICR_PECF;
+    CDC_Uart_Receive();
+}
+
+void DMA1_Channel4_IRQHandler() {
+    // Half & full transfer of the circular RX buffer, so a continuous stream is forwarded without waiting for idle
+    DMA1->IFCR = DMA_IFCR_CGIF4;
+    CDC_Uart_Receive();
+}
+
+void DMA1_Channel5_IRQHandler() {
+    DMA1->IFCR = DMA_IFCR_CGIF5;
+
+    stats.TxBytes += txSize;
+    CDC_Consume(CDC_UART_PORT, txSize);
+    txSize = 0;
+    CDC_Uart_Transmit();
+}
+
+static void CDC_Uart_Reset() {
+    // The RX ring is about to be cleared, stop sending the block taken from it. Runs with interrupts disabled
+    CDC_UART_TX->CCR &= ~DMA_CCR_EN;
+    DMA1->IFCR = DMA_IFCR_CGIF5;
+    NVIC_ClearPendingIRQ(DMA1_Channel5_IRQn);
+
+    if (txSize > 0) {
+        stats.TxBytes += txSize - CDC_UART_TX->CNDTR;
+        txSize = 0;
+    }
+}
+
+void CDC_Uart_Init() {
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN | RCC_AHB1ENR_DMAMUX1EN;
+    RCC->AHB2ENR |= RCC_AHB2ENR_GPIOCEN;
+    RCC->APB1ENR1 |= RCC_APB1ENR1_UART4EN;
+
+    // PC10 (TX) & PC11 (RX) as AF5, pull-up on RX so an open line does not flood framing errors
+    GPIOC->MODER = (GPIOC->MODER & ~(GPIO_MODER_MODE10 | GPIO_MODER_MODE11)) | GPIO_MODER_MODE10_1 | GPIO_MODER_MODE11_1;
+    GPIOC->AFR[1] = (GPIOC->AFR[1] & ~(GPIO_AFRH_AFSEL10 | GPIO_AFRH_AFSEL11)) | (5 << GPIO_AFRH_AFSEL10_Pos) | (5 << GPIO_AFRH_AFSEL11_Pos);
+    GPIOC->PUPDR = (GPIOC->PUPDR & ~GPIO_PUPDR_PUPD11) | GPIO_PUPDR_PUPD11_0;
+    GPIOC->OSPEEDR |= GPIO_OSPEEDR_OSPEED10;
+
+    // RX: circular into rxDma, TX: one contiguous block of the CDC ring at a time
+    CDC_UART_RX_MUX->CCR = CDC_UART4_RX << DMAMUX_CxCR_DMAREQ_ID_Pos;
+    CDC_UART_RX->CPAR = (unsigned int)&CDC_UART->RDR;
+    CDC_UART_RX->CMAR = (unsigned int)rxDma;
+    CDC_UART_RX->CNDTR = CDC_UART_RX_DMA;
+    CDC_UART_RX->CCR = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_HTIE | DMA_CCR_TCIE | DMA_CCR_EN;
+
+    CDC_UART_TX_MUX->CCR = CDC_UART4_TX << DMAMUX_CxCR_DMAREQ_ID_Pos;
+    CDC_UART_TX->CPAR = (unsigned int)&CDC_UART->TDR;
+    CDC_UART_TX->CCR = DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_TCIE;
+
+    CDC_UART->CR3 = USART_CR3_DMAR | USART_CR3_DMAT | USART_CR3_EIE;
+    CDC_UART->CR1 = USART_CR1_IDLEIE | USART_CR1_PEIE | USART_CR1_RE | USART_CR1_TE;
+
+    CDC_LINECODING coding = {.BaudRate = 115200, .StopBits = 0, .Parity = 0, .DataBits = 8};
+    CDC_Uart_LineCoding(&coding);
+    CDC_SetLineCodingHandler(CDC_UART_PORT, &CDC_Uart_LineCoding);
+    CDC_SetResetHandler(CDC_UART_PORT, &CDC_Uart_Reset);
+
+    // Above the USB interrupt, the handlers are short and the RX DMA must never lap rxPosition
+    NVIC_SetPriority(UART4_IRQn, 4);
+    NVIC_SetPriority(DMA1_Channel4_IRQn, 4);
+    NVIC_SetPriority(DMA1_Channel5_IRQn, 4);
+    NVIC_EnableIRQ(UART4_IRQn);
+    NVIC_EnableIRQ(DMA1_Channel4_IRQn);
+    NVIC_EnableIRQ(DMA1_Channel5_IRQn);
+}
+
+void CDC_Uart_Loop() {
+    CDC_Uart_Transmit();
+}
+
+const CDC_UartStats *CDC_Uart_GetStats() {
+    return &stats;
+}
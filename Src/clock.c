@@ -0,0 +1,162 @@
+#include "clock.h"
+
+static CLOCK_INFO info;
+
+static void CLOCK_InitUsb();
+
+#if defined(STM32G441xx) || defined(STM32G474xx)
+
+// PLL from the 25 MHz HSE, R = 2
+#if CLOCK_PROFILE == CLOCK_PROFILE_PERFORMANCE
+#define CLOCK_PLLM 5                  // 5 MHz
+#define CLOCK_PLLN 68                 // VCO 340 MHz, SYSCLK 170 MHz
+#define CLOCK_HPRE RCC_CFGR_HPRE_DIV1 // HCLK 170 MHz
+#define CLOCK_LATENCY FLASH_ACR_LATENCY_4WS
+#define CLOCK_BOOST 1
+#elif CLOCK_PROFILE == CLOCK_PROFILE_BALANCED
+#define CLOCK_PLLM 2                  // 12.5 MHz
+#define CLOCK_PLLN 23                 // VCO 287.5 MHz, SYSCLK 143.75 MHz
+#define CLOCK_HPRE RCC_CFGR_HPRE_DIV2 // HCLK 71.875 MHz
+#define CLOCK_LATENCY FLASH_ACR_LATENCY_2WS
+#define CLOCK_BOOST 0
+#elif CLOCK_PROFILE == CLOCK_PROFILE_LOW
+#define CLOCK_LATENCY FLASH_ACR_LATENCY_0WS // HSE 25 MHz, no PLL
+#define CLOCK_BOOST 0
+#else
+#error "Unknown CLOCK_PROFILE"
+#endif
+
+void CLOCK_Init() {
+    RCC->APB1ENR1 |= RCC_APB1ENR1_PWREN;
+
+    RCC->CR |= RCC_CR_HSEON;
+    while (!(RCC->CR & RCC_CR_HSERDY)) {
+    }
+
+    // Boost has to be on before the clock exceeds 150 MHz, range 1 (reset default) is needed for USB in every profile
+    if (CLOCK_BOOST) {
+        PWR->CR5 &= ~PWR_CR5_R1MODE;
+    }
+
+    // Wait states first, the new clock must never run with too few of them
+    FLASH->ACR = (FLASH->ACR & ~FLASH_ACR_LATENCY) | CLOCK_LATENCY | FLASH_ACR_PRFTEN | FLASH_ACR_ICEN | FLASH_ACR_DCEN;
+    while ((FLASH->ACR & FLASH_ACR_LATENCY) != CLOCK_LATENCY) {
+    }
+
+#if CLOCK_PROFILE == CLOCK_PROFILE_LOW
+    RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | RCC_CFGR_SW_HSE;
+    while ((RCC->CFGR & RCC_CFGR_SWS_Msk) != RCC_CFGR_SWS_HSE) {
+    }
+#else
+    RCC->CR &= ~RCC_CR_PLLON;
+    while (RCC->CR & RCC_CR_PLLRDY) {
+    }
+    RCC->PLLCFGR = RCC_PLLCFGR_PLLSRC_HSE | ((CLOCK_PLLM - 1) << RCC_PLLCFGR_PLLM_Pos) | (CLOCK_PLLN << RCC_PLLCFGR_PLLN_Pos) | RCC_PLLCFGR_PLLREN;
+    RCC->CR |= RCC_CR_PLLON;
+    while (!(RCC->CR & RCC_CR_PLLRDY)) {
+    }
+
+    // Switching directly to more than 80 MHz needs an intermediate AHB/2 step of at least 1us
+    RCC->CFGR = (RCC->CFGR & ~(RCC_CFGR_SW | RCC_CFGR_HPRE)) | RCC_CFGR_HPRE_DIV2 | RCC_CFGR_SW_PLL;
+    while ((RCC->CFGR & RCC_CFGR_SWS_Msk) != RCC_CFGR_SWS_PLL) {
+    }
+
+    if (CLOCK_HPRE != RCC_CFGR_HPRE_DIV2) {
+        for (volatile int i = 0; i < 100; i++) {
+        }
+
+        RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_HPRE) | CLOCK_HPRE;
+    }
+#endif
+
+    CLOCK_InitUsb();
+
+    // Enable IO Clock for USB & Port
+    RCC->AHB2ENR |= RCC_AHB2ENR_GPIOAEN;
+    RCC->APB1ENR1 |= RCC_APB1ENR1_USBEN;
+
+    SystemCoreClockUpdate();
+
+    info.Profile = CLOCK_PROFILE;
+    info.FlashLatency = CLOCK_LATENCY;
+    info.Boost = CLOCK_BOOST;
+    info.Caches = 1;
+    info.CoreClock = SystemCoreClock;
+}
+
+static void CLOCK_InitUsb() {
+    // The PLL can't derive exactly 48 MHz from the 25 MHz HSE next to the system clock, use the HSI48 trimmed to the host SOFs
+    RCC->CRRCR |= RCC_CRRCR_HSI48ON;
+    while (!(RCC->CRRCR & RCC_CRRCR_HSI48RDY)) {
+    }
+
+    RCC->APB1ENR1 |= RCC_APB1ENR1_CRSEN;
+    CRS->CR = 0;
+    CRS->CFGR = (CRS->CFGR & ~CRS_CFGR_SYNCSRC) | CRS_CFGR_SYNCSRC_1; // USB SOF
+    CRS->CR |= CRS_CR_AUTOTRIMEN | CRS_CR_CEN;
+
+    // Select HSI48 as USB clock
+    RCC->CCIPR &= ~RCC_CCIPR_CLK48SEL;
+}
+
+#elif defined(STM32F042x6)
+
+void CLOCK_Init() {
+    CLOCK_InitUsb();
+
+#if CLOCK_PROFILE == CLOCK_PROFILE_PERFORMANCE
+    // 48 MHz need one wait state. The HSI48 is taken through the PLL (HSI48 / 2 * 2), SystemCoreClockUpdate does not know it as direct source
+    FLASH->ACR = FLASH_ACR_LATENCY | FLASH_ACR_PRFTBE;
+    while (!(FLASH->ACR & FLASH_ACR_LATENCY)) {
+    }
+
+    RCC->CFGR2 = RCC_CFGR2_PREDIV_DIV2;
+    RCC->CFGR = (RCC->CFGR & ~(RCC_CFGR_PLLSRC | RCC_CFGR_PLLMUL)) | RCC_CFGR_PLLSRC_HSI48_PREDIV | RCC_CFGR_PLLMUL2;
+    RCC->CR |= RCC_CR_PLLON;
+    while (!(RCC->CR & RCC_CR_PLLRDY)) {
+    }
+
+    RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | RCC_CFGR_SW_PLL;
+    while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_PLL) {
+    }
+
+    info.FlashLatency = 1;
+    info.Caches = 1;
+#endif
+
+    // enable GPIOA and USB clocks
+    RCC->AHBENR |= RCC_AHBENR_GPIOAEN;
+    RCC->APB1ENR |= RCC_APB1ENR_USBEN;
+
+    SystemCoreClockUpdate();
+
+    info.Profile = CLOCK_PROFILE;
+    info.CoreClock = SystemCoreClock;
+}
+
+static void CLOCK_InitUsb() {
+    // enable HSI48
+    RCC->CR2 |= RCC_CR2_HSI48ON;
+    while (!(RCC->CR2 & RCC_CR2_HSI48RDY)) {};
+
+    // enable CRS for USB-sync
+    RCC->APB1ENR |= RCC_APB1ENR_CRSEN;
+    // reset CRS config
+    CRS->CR = 0;
+    CRS->CFGR = 0;
+    // automatic trimming
+    CRS->CFGR |= CRS_CFGR_SYNCSRC_1;    // USB SOF
+    CRS->CR |= CRS_CR_AUTOTRIMEN | CRS_CR_CEN;
+
+    // select HSI48 as USB clock source
+    RCC->CFGR3 &= ~RCC_CFGR3_USBSW;
+    RCC->CFGR3 |= RCC_CFGR3_USBSW_HSI48;
+}
+
+#else
+#error "Unsupported MCU"
+#endif
+
+const CLOCK_INFO *CLOCK_GetInfo() {
+    return &info;
+}
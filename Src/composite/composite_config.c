@@ -0,0 +1,301 @@
+#include "composite/composite_config.h"
+
+// USB-SRAM left for endpoint buffers besides the BTable and EP0
+#define COMPOSITE_SRAM_SIZE (1024 - 64 - 128)
+#define COMPOSITE_NONE 0xFF
+
+typedef struct {
+    USB_Implementation Impl;
+    unsigned char FirstInterface;
+    unsigned char EndpointMap[USB_NumEndpoints];
+} COMPOSITE_Function;
+
+static USB_DESCRIPTOR_DEVICE DeviceDescriptor;
+static unsigned char ConfigurationBuffer[COMPOSITE_MAX_DESCRIPTOR];
+static USB_CONFIG_EP EndpointConfigs[USB_NumEndpoints - 1];
+
+static COMPOSITE_Function functions[COMPOSITE_MAX_FUNCTIONS];
+static unsigned char functionCount = 0;
+
+// Owning function of every interface & endpoint, so setup packets are routed without searching
+static unsigned char interfaceOwner[COMPOSITE_MAX_INTERFACES];
+static unsigned char endpointOwner[USB_NumEndpoints];
+
+static unsigned short COMPOSITE_CopyFunction(COMPOSITE_Function *function, unsigned char *buffer, unsigned short size) {
+    // Copy the class descriptors behind the configuration descriptor and move interfaces & endpoints
+    const unsigned char *source = function->Impl.ConfigDescriptor;
+    unsigned short sourceLength = function->Impl.ConfigDescriptorLength;
+    unsigned char base = function->FirstInterface;
+    unsigned short offset = 0;
+    char associated = 0;
+
+    for (unsigned short i = 9; i < sourceLength && source[i] > 0; i += source[i]) {
+        if (source[i + 1] == 0x0B) {
+            associated = 1;
+        }
+    }
+
+    for (unsigned short i = 9; i < sourceLength && source[i] > 0; i += source[i]) {
+        unsigned char length = source[i];
+        unsigned char *target = buffer + offset;
+
+        if (!associated && function->Impl.NumInterfaces > 1 && source[i + 1] == 0x04) {
+            // Group the interfaces of this function, using the class of its first interface
+            USB_FUNC_IAD iad = {
+                .Length = 8,
+                .DescriptorType = 0x0B,
+                .FirstInterface = base,
+                .InterfaceCount = function->Impl.NumInterfaces,
+                .Class = source[i + 5],
+                .SubClass = source[i + 6],
+                .Protocol = source[i + 7],
+                .strFunction = source[i + 8]};
+
+            if (offset + iad.Length > size) {
+                return 0;
+            }
+
+            offset += USB_BuildDescriptor(target, size - offset, 1, (const void *[]){&iad});
+            target = buffer + offset;
+            associated = 1;
+        }
+
+        if (offset + length > size) {
+            return 0;
+        }
+
+        for (int b = 0; b < length; b++) {
+            target[b] = source[i + b];
+        }
+
+        switch (target[1]) {
+        case 0x04: // Interface
+            target[2] += base;
+            break;
+        case 0x0B: // Interface association
+            target[2] += base;
+            break;
+        case 0x05: // Endpoint
+            target[2] = (target[2] & 0x80) | function->EndpointMap[target[2] & 0x0F];
+            break;
+        case CS_INTERFACE:
+            if (target[2] == FUNC_UNION) {
+                for (int b = 3; b < length; b++) {
+                    target[b] += base;
+                }
+            } else if (target[2] == FUNC_CALL) {
+                target[4] += base;
+            }
+            break;
+        }
+
+        offset += length;
+    }
+
+    return offset;
+}
+
+static unsigned char COMPOSITE_GetOwner(USB_SETUP_PACKET *setup) {
+    switch (setup->RequestType & 0x1F) {
+    case 0x01: // Interface
+        return (setup->Index & 0xFF) < COMPOSITE_MAX_INTERFACES ? interfaceOwner[setup->Index & 0xFF] : COMPOSITE_NONE;
+    case 0x02: // Endpoint
+        return endpointOwner[setup->Index & 0x0F];
+    }
+
+    return 0;
+}
+
+static char COMPOSITE_SetupPacket(USB_SETUP_PACKET *setup, const unsigned char *data, short length) {
+    unsigned char owner = COMPOSITE_GetOwner(setup);
+    unsigned short index = setup->Index;
+
+    if (owner == COMPOSITE_NONE || functions[owner].Impl.SetupPacket_Handler == 0) {
+        return USB_ERR;
+    }
+
+    // The function only knows its own interface numbers
+    if ((setup->RequestType & 0x1F) == 0x01) {
+        setup->Index -= functions[owner].FirstInterface;
+    }
+
+    char result = functions[owner].Impl.SetupPacket_Handler(setup, data, length);
+    setup->Index = index;
+
+    return result;
+}
+
+static char COMPOSITE_ControlData(USB_SETUP_PACKET *setup, const unsigned char *data, short length, unsigned short offset) {
+    unsigned char owner = COMPOSITE_GetOwner(setup);
+    unsigned short index = setup->Index;
+
+    if (owner == COMPOSITE_NONE || functions[owner].Impl.ControlData_Handler == 0) {
+        return USB_ERR;
+    }
+
+    if ((setup->RequestType & 0x1F) == 0x01) {
+        setup->Index -= functions[owner].FirstInterface;
+    }
+
+    char result = functions[owner].Impl.ControlData_Handler(setup, data, length, offset);
+    setup->Index = index;
+
+    return result;
+}
+
+static void COMPOSITE_ResetInterface(char interface, char alternateId) {
+    if (interface < COMPOSITE_MAX_INTERFACES && interfaceOwner[interface] != COMPOSITE_NONE) {
+        COMPOSITE_Function *function = &functions[interfaceOwner[interface]];
+
+        if (function->Impl.ResetInterface_Handler != 0) {
+            function->Impl.ResetInterface_Handler(interface - function->FirstInterface, alternateId);
+        }
+    }
+}
+
+static unsigned short *COMPOSITE_GetString(char index, short lcid, short *length) {
+    // String indices are shared, the first function knowing the index wins
+    for (int i = 0; i < functionCount; i++) {
+        if (functions[i].Impl.GetString != 0) {
+            unsigned short *string = functions[i].Impl.GetString(index, lcid, length);
+
+            if (string != 0) {
+                return string;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void COMPOSITE_Suspend() {
+    for (int i = 0; i < functionCount; i++) {
+        if (functions[i].Impl.Suspend_Handler != 0) {
+            functions[i].Impl.Suspend_Handler();
+        }
+    }
+}
+
+static void COMPOSITE_Sof(unsigned short frame) {
+    for (int i = 0; i < functionCount; i++) {
+        if (functions[i].Impl.Sof_Handler != 0) {
+            functions[i].Impl.Sof_Handler(frame);
+        }
+    }
+}
+
+static void COMPOSITE_Wakeup() {
+    for (int i = 0; i < functionCount; i++) {
+        if (functions[i].Impl.Wakeup_Handler != 0) {
+            functions[i].Impl.Wakeup_Handler();
+        }
+    }
+}
+
+USB_Implementation COMPOSITE_GetImplementation(const USB_Implementation *implementations, unsigned char count) {
+    USB_Implementation impl = {0};
+    USB_DESCRIPTOR_CONFIG config = *(const USB_DESCRIPTOR_CONFIG *)implementations[0].ConfigDescriptor;
+    unsigned short length = 9;
+    unsigned short sram = 0;
+    unsigned char interfaces = 0;
+    unsigned char endpoints = 0;
+
+    functionCount = 0;
+    for (int i = 0; i < COMPOSITE_MAX_INTERFACES; i++) {
+        interfaceOwner[i] = COMPOSITE_NONE;
+    }
+    for (int i = 0; i < USB_NumEndpoints; i++) {
+        endpointOwner[i] = COMPOSITE_NONE;
+    }
+
+    for (int f = 0; f < count && functionCount < COMPOSITE_MAX_FUNCTIONS; f++) {
+        COMPOSITE_Function *function = &functions[functionCount];
+        const USB_Implementation *source = &implementations[f];
+        unsigned short functionSram = 0;
+
+        for (int e = 0; e < source->NumEndpoints; e++) {
+            unsigned short size = ((source->Endpoints[e].RxBufferSize + 1) & ~1) + ((source->Endpoints[e].TxBufferSize + 1) & ~1);
+
+            // Isochronous endpoints take a double buffer
+            if ((source->Endpoints[e].Type & USB_EP_TYPE_MASK) == USB_EP_ISOCHRONOUS) {
+                size *= 2;
+            }
+
+            functionSram += size;
+        }
+
+        if (endpoints + source->NumEndpoints > USB_NumEndpoints - 1 || interfaces + source->NumInterfaces > COMPOSITE_MAX_INTERFACES ||
+            sram + functionSram > COMPOSITE_SRAM_SIZE) {
+            continue;
+        }
+
+        function->Impl = *source;
+        function->FirstInterface = interfaces;
+
+        // Endpoints are handed out in order, EP0 stays where it is
+        for (int e = 0; e < USB_NumEndpoints; e++) {
+            function->EndpointMap[e] = e;
+        }
+        for (int e = 0; e < source->NumEndpoints; e++) {
+            function->EndpointMap[source->Endpoints[e].EP] = endpoints + e + 1;
+        }
+
+        unsigned short added = COMPOSITE_CopyFunction(function, ConfigurationBuffer + length, sizeof(ConfigurationBuffer) - length);
+        if (added == 0) {
+            continue;
+        }
+
+        for (int e = 0; e < source->NumEndpoints; e++) {
+            EndpointConfigs[endpoints + e] = source->Endpoints[e];
+            EndpointConfigs[endpoints + e].EP = endpoints + e + 1;
+            endpointOwner[endpoints + e + 1] = functionCount;
+        }
+        for (int n = 0; n < source->NumInterfaces; n++) {
+            interfaceOwner[interfaces + n] = functionCount;
+        }
+
+        if (source->RemapEndpoints_Handler != 0) {
+            source->RemapEndpoints_Handler(function->EndpointMap);
+        }
+
+        length += added;
+        sram += functionSram;
+        interfaces += source->NumInterfaces;
+        endpoints += source->NumEndpoints;
+        functionCount++;
+    }
+
+    config.TotalLength = length;
+    config.Interfaces = interfaces;
+    USB_BuildDescriptor(ConfigurationBuffer, 9, 1, (const void *[]){&config});
+
+    // Functions are described by interface associations
+    DeviceDescriptor = *implementations[0].DeviceDescriptor;
+    DeviceDescriptor.DeviceClass = 0xEF;
+    DeviceDescriptor.DeviceSubClass = 0x02;
+    DeviceDescriptor.DeviceProtocol = 0x01;
+
+    impl.DeviceDescriptor = &DeviceDescriptor;
+    impl.ConfigDescriptor = ConfigurationBuffer;
+    impl.ConfigDescriptorLength = length;
+
+    impl.Endpoints = EndpointConfigs;
+    impl.NumEndpoints = endpoints;
+    impl.NumInterfaces = interfaces;
+
+    impl.GetString = &COMPOSITE_GetString;
+    impl.SetupPacket_Handler = &COMPOSITE_SetupPacket;
+    impl.ControlData_Handler = &COMPOSITE_ControlData;
+    impl.ResetInterface_Handler = &COMPOSITE_ResetInterface;
+    impl.Suspend_Handler = &COMPOSITE_Suspend;
+    impl.Wakeup_Handler = &COMPOSITE_Wakeup;
+
+    // Only take the SOF interrupt if one of the functions wants it
+    for (int i = 0; i < functionCount; i++) {
+        if (functions[i].Impl.Sof_Handler != 0) {
+            impl.Sof_Handler = &COMPOSITE_Sof;
+        }
+    }
+
+    return impl;
+}
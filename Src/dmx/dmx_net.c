@@ -0,0 +1,116 @@
+#include "dmx/dmx_net.h"
+#include "ncm/ncm_netif.h"
+
+#include <string.h>
+
+#define ARTNET_OPDMX 0x5000
+#define ARTNET_HEADER 18
+
+#define SACN_VECTOR_ROOT_DATA 0x00000004
+#define SACN_VECTOR_FRAMING_DATA 0x00000002
+#define SACN_VECTOR_DMP_SET 0x02
+#define SACN_OPTION_PREVIEW 0x80
+#define SACN_OPTION_TERMINATED 0x40
+#define SACN_HEADER 126
+
+static DMX_NetStats stats = {0};
+
+static const char artnetId[8] = {'A', 'r', 't', '-', 'N', 'e', 't', 0};
+static const char sacnId[12] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0};
+
+static unsigned int DMX_ReadBE32(const unsigned char *data) {
+    return data[0] << 24 | data[1] << 16 | data[2] << 8 | data[3];
+}
+
+static char DMX_Store(unsigned int slot, const char *channels, unsigned short length) {
+    unsigned char *frame = DMX_Universe_BeginWrite(slot, DMX_WRITER_NET);
+
+    if (frame == 0) {
+        // HID or an Enttec message is writing the slot
+        stats.Busy++;
+        return 0;
+    }
+
+    if (length > DMX_CHANNELS) {
+        length = DMX_CHANNELS;
+    }
+
+    memcpy(frame, channels, length);
+    memset(frame + length, 0, DMX_CHANNELS - length);
+    DMX_Universe_EndWrite(slot, DMX_WRITER_NET, length);
+    return 1;
+}
+
+static u8_t DMX_ArtNetInput(const ip4_addr_t *src, const char *payload, short length) {
+    const unsigned char *data = (const unsigned char *)payload;
+
+    if (length < ARTNET_HEADER || memcmp(data, artnetId, sizeof(artnetId)) != 0) {
+        stats.Invalid++;
+        return 1;
+    }
+
+    if ((data[8] | data[9] << 8) != ARTNET_OPDMX) {
+        // ArtPoll & co. are answered by lwIP based code, if any
+        return 0;
+    }
+
+    unsigned short portAddress = (data[15] & 0x7F) << 8 | data[14];
+    unsigned short channels = data[16] << 8 | data[17];
+
+    if (channels > length - ARTNET_HEADER || channels > DMX_CHANNELS) {
+        stats.Invalid++;
+        return 1;
+    }
+
+    unsigned int slot = (unsigned short)(portAddress - DMX_ARTNET_BASE);
+    if (slot >= DMX_UNIVERSE_COUNT) {
+        stats.Ignored++;
+        return 1;
+    }
+
+    if (DMX_Store(slot, payload + ARTNET_HEADER, channels)) {
+        stats.ArtDmx++;
+    }
+    return 1;
+}
+
+static u8_t DMX_SacnInput(const ip4_addr_t *src, const char *payload, short length) {
+    const unsigned char *data = (const unsigned char *)payload;
+
+    // Root, framing and DMP layer of an E1.31 data packet, all fields at fixed offsets
+    if (length < SACN_HEADER || memcmp(data + 4, sacnId, sizeof(sacnId)) != 0 ||
+        DMX_ReadBE32(data + 18) != SACN_VECTOR_ROOT_DATA ||
+        DMX_ReadBE32(data + 40) != SACN_VECTOR_FRAMING_DATA ||
+        data[117] != SACN_VECTOR_DMP_SET) {
+        stats.Invalid++;
+        return 1;
+    }
+
+    unsigned short universe = data[113] << 8 | data[114];
+    unsigned short count = data[123] << 8 | data[124];
+
+    if (count < 1 || count - 1 > length - SACN_HEADER || count - 1 > DMX_CHANNELS) {
+        stats.Invalid++;
+        return 1;
+    }
+
+    unsigned int slot = (unsigned short)(universe - DMX_SACN_BASE);
+    if ((data[112] & (SACN_OPTION_PREVIEW | SACN_OPTION_TERMINATED)) != 0 || data[125] != 0x00 || slot >= DMX_UNIVERSE_COUNT) {
+        stats.Ignored++;
+        return 1;
+    }
+
+    if (DMX_Store(slot, payload + SACN_HEADER, count - 1)) {
+        stats.Sacn++;
+    }
+    return 1;
+}
+
+void DMX_Net_Init() {
+    ncm_netif_register_udp(DMX_ARTNET_PORT, DMX_ArtNetInput);
+    ncm_netif_register_udp(DMX_SACN_PORT, DMX_SacnInput);
+}
+
+const DMX_NetStats *DMX_Net_GetStats() {
+    return &stats;
+}
@@ -0,0 +1,166 @@
+#include "dmx/dmx_output.h"
+
+#if !defined(STM32G441xx) && !defined(STM32G474xx)
+#error "The DMX output is only implemented for stm32g4"
+#endif
+
+#define DMX_TX_USART1 25
+#define DMX_TX_USART2 27
+#define DMX_TX_USART3 29
+
+typedef enum {
+    DMX_PORT_BREAK, // 0x00 at DMX_BREAK_BAUD is being sent
+    DMX_PORT_DATA,  // start code & channels are being sent by the DMA
+} DMX_PortState;
+
+typedef struct {
+    USART_TypeDef *Usart;
+    DMA_Channel_TypeDef *Dma;
+    DMAMUX_Channel_TypeDef *DmaMux;
+    unsigned char Request;
+    char Apb2; // USART1 is clocked from APB2, the others from APB1
+    IRQn_Type Irq;
+} DMX_PortConfig;
+
+typedef struct {
+    volatile DMX_PortState State;
+    unsigned short BreakBrr;
+    unsigned short DataBrr;
+    DMX_OutputStats Stats;
+} DMX_Port;
+
+static const DMX_PortConfig portConfig[3] = {
+    {USART1, DMA1_Channel1, DMAMUX1_Channel0, DMX_TX_USART1, 1, USART1_IRQn},
+    {USART2, DMA1_Channel2, DMAMUX1_Channel1, DMX_TX_USART2, 0, USART2_IRQn},
+    {USART3, DMA1_Channel3, DMAMUX1_Channel2, DMX_TX_USART3, 0, USART3_IRQn},
+};
+
+#define DMX_PORTS ((DMX_OUTPUT_PORTS) < (DMX_UNIVERSE_COUNT) ? (DMX_OUTPUT_PORTS) : (DMX_UNIVERSE_COUNT))
+
+static DMX_Port ports[DMX_PORTS];
+
+static void DMX_SetBaud(const DMX_PortConfig *config, unsigned short brr) {
+    // BRR can only be changed while the USART is disabled. Enabling TE again queues an idle frame, extending the MAB
+    config->Usart->CR1 &= ~USART_CR1_UE;
+    config->Usart->BRR = brr;
+    config->Usart->CR1 |= USART_CR1_UE | USART_CR1_TE;
+}
+
+static void DMX_StartBreak(unsigned char port) {
+    const DMX_PortConfig *config = &portConfig[port];
+
+    ports[port].State = DMX_PORT_BREAK;
+    DMX_SetBaud(config, ports[port].BreakBrr);
+    config->Usart->TDR = 0x00;
+}
+
+static void DMX_StartData(unsigned char port) {
+    const DMX_PortConfig *config = &portConfig[port];
+    unsigned short length;
+
+    // Take over the latest frame, the DMA reads it in place until the next frame starts
+    if (DMX_Universe_HasUpdate(port)) {
+        ports[port].Stats.Updates++;
+    }
+    const unsigned char *frame = DMX_Universe_Read(port, &length);
+
+    ports[port].State = DMX_PORT_DATA;
+    DMX_SetBaud(config, ports[port].DataBrr);
+
+    // Start code first, the DMA only feeds the channels once it moved on to the shift register
+    config->Usart->TDR = 0x00;
+
+    config->Dma->CCR &= ~DMA_CCR_EN;
+    config->Dma->CMAR = (unsigned int)frame;
+    config->Dma->CNDTR = DMX_CHANNELS;
+    config->Dma->CCR |= DMA_CCR_EN;
+}
+
+static void DMX_HandleIRQ(unsigned char port) {
+    const DMX_PortConfig *config = &portConfig[port];
+
+    if ((config->Usart->ISR & USART_ISR_TC) == 0) {
+        return;
+    }
+
+    config->Usart->ICR = USART_ICR_TCCF;
+
+    if (ports[port].State == DMX_PORT_BREAK) {
+        DMX_StartData(port);
+    } else if (config->Dma->CNDTR == 0) {
+        // TC may also show up if the DMA falls behind for a slot, the frame is only done once everything was sent
+        unsigned int now = sys_now();
+
+        ports[port].Stats.Frames++;
+        ports[port].Stats.PeriodMs = now - ports[port].Stats.LastFrameMs;
+        ports[port].Stats.LastFrameMs = now;
+
+        DMX_StartBreak(port);
+    }
+}
+
+void USART1_IRQHandler() {
+    DMX_HandleIRQ(0);
+}
+
+#if DMX_PORTS > 1
+void USART2_IRQHandler() {
+    DMX_HandleIRQ(1);
+}
+#endif
+
+#if DMX_PORTS > 2
+void USART3_IRQHandler() {
+    DMX_HandleIRQ(2);
+}
+#endif
+
+void DMX_Output_Init() {
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN | RCC_AHB1ENR_DMAMUX1EN;
+    RCC->AHB2ENR |= RCC_AHB2ENR_GPIOAEN | RCC_AHB2ENR_GPIOBEN;
+    RCC->APB2ENR |= RCC_APB2ENR_USART1EN;
+    RCC->APB1ENR1 |= RCC_APB1ENR1_USART2EN | RCC_APB1ENR1_USART3EN;
+
+    // TX pins as AF7: PA9, PA2 & PB10
+    GPIOA->MODER = (GPIOA->MODER & ~(GPIO_MODER_MODE9 | GPIO_MODER_MODE2)) | GPIO_MODER_MODE9_1 | GPIO_MODER_MODE2_1;
+    GPIOA->AFR[1] = (GPIOA->AFR[1] & ~GPIO_AFRH_AFSEL9) | (7 << GPIO_AFRH_AFSEL9_Pos);
+    GPIOA->AFR[0] = (GPIOA->AFR[0] & ~GPIO_AFRL_AFSEL2) | (7 << GPIO_AFRL_AFSEL2_Pos);
+    GPIOB->MODER = (GPIOB->MODER & ~GPIO_MODER_MODE10) | GPIO_MODER_MODE10_1;
+    GPIOB->AFR[1] = (GPIOB->AFR[1] & ~GPIO_AFRH_AFSEL10) | (7 << GPIO_AFRH_AFSEL10_Pos);
+
+    unsigned int apb1 = SystemCoreClock >> APBPrescTable[(RCC->CFGR & RCC_CFGR_PPRE1_Msk) >> RCC_CFGR_PPRE1_Pos];
+    unsigned int apb2 = SystemCoreClock >> APBPrescTable[(RCC->CFGR & RCC_CFGR_PPRE2_Msk) >> RCC_CFGR_PPRE2_Pos];
+
+    for (int i = 0; i < DMX_PORTS; i++) {
+        const DMX_PortConfig *config = &portConfig[i];
+        unsigned int clock = config->Apb2 ? apb2 : apb1;
+
+        ports[i].BreakBrr = (clock + DMX_BREAK_BAUD / 2) / DMX_BREAK_BAUD;
+        ports[i].DataBrr = (clock + DMX_DATA_BAUD / 2) / DMX_DATA_BAUD;
+
+        // 8N2, the DMA feeds TDR during the data phase
+        config->Usart->CR1 = 0;
+        config->Usart->CR2 = USART_CR2_STOP_1;
+        config->Usart->CR3 = USART_CR3_DMAT;
+
+        config->DmaMux->CCR = config->Request << DMAMUX_CxCR_DMAREQ_ID_Pos;
+        config->Dma->CPAR = (unsigned int)&config->Usart->TDR;
+        config->Dma->CCR = DMA_CCR_MINC | DMA_CCR_DIR;
+
+        config->Usart->CR1 = USART_CR1_TCIE;
+
+        NVIC_SetPriority(config->Irq, 4);
+        NVIC_EnableIRQ(config->Irq);
+
+        ports[i].Stats.LastFrameMs = sys_now();
+        DMX_StartBreak(i);
+    }
+}
+
+const DMX_OutputStats *DMX_Output_GetStats(unsigned char port) {
+    if (port >= DMX_PORTS) {
+        return 0;
+    }
+
+    return &ports[port].Stats;
+}
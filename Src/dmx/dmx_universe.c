@@ -0,0 +1,147 @@
+#include "dmx/dmx_universe.h"
+
+#include <string.h>
+
+static DMX_Universe universes[DMX_UNIVERSE_COUNT];
+
+static unsigned char DMX_Exchange(volatile unsigned char *target, unsigned char value) {
+#if __CORTEX_M >= 3
+    unsigned char previous;
+
+    do {
+        previous = __LDREXB(target);
+    } while (__STREXB(value, target) != 0);
+
+    return previous;
+#else
+    unsigned int primask = __get_PRIMASK();
+    __disable_irq();
+
+    unsigned char previous = *target;
+    *target = value;
+
+    __set_PRIMASK(primask);
+    return previous;
+#endif
+}
+
+static char DMX_Claim(DMX_Universe *u, DMX_Writer writer) {
+    // Test & set of Writer and Claimed together, only a few instructions with the interrupts masked
+    unsigned int primask = __get_PRIMASK();
+    __disable_irq();
+
+    char claimed = u->Writer == writer || u->Writer == DMX_WRITER_NONE || sys_now() - u->Claimed >= DMX_WRITER_TIMEOUT;
+
+    if (claimed) {
+        if (u->Writer != writer) {
+            // A writer that timed out may have left Frames[Back] half written
+            u->Prepared = 0;
+            u->Writer = writer;
+        }
+        u->Claimed = sys_now();
+    }
+
+    __set_PRIMASK(primask);
+    return claimed;
+}
+
+void DMX_Universe_Init() {
+    for (int i = 0; i < DMX_UNIVERSE_COUNT; i++) {
+        universes[i].Front = 0;
+        universes[i].Middle = 1;
+        universes[i].Back = 2;
+        universes[i].Latest = 0;
+        universes[i].Prepared = 0;
+        universes[i].Updates = 0;
+        universes[i].LastUpdate = 0;
+        universes[i].Writer = DMX_WRITER_NONE;
+        universes[i].Claimed = 0;
+
+        for (int j = 0; j < 3; j++) {
+            universes[i].Length[j] = 0;
+        }
+    }
+}
+
+unsigned char *DMX_Universe_BeginWrite(unsigned char universe, DMX_Writer writer) {
+    if (universe >= DMX_UNIVERSE_COUNT || !DMX_Claim(&universes[universe], writer)) {
+        return 0;
+    }
+
+    return universes[universe].Frames[universes[universe].Back];
+}
+
+unsigned char *DMX_Universe_BeginUpdate(unsigned char universe, DMX_Writer writer) {
+    if (universe >= DMX_UNIVERSE_COUNT || !DMX_Claim(&universes[universe], writer)) {
+        return 0;
+    }
+
+    DMX_Universe *u = &universes[universe];
+
+    if (!u->Prepared) {
+        // The latest frame may be read concurrently, but it is never written until it comes back as Back
+        memcpy(u->Frames[u->Back], u->Frames[u->Latest], DMX_CHANNELS);
+        u->Length[u->Back] = u->Length[u->Latest];
+        u->Prepared = 1;
+    }
+
+    return u->Frames[u->Back];
+}
+
+void DMX_Universe_EndWrite(unsigned char universe, DMX_Writer writer, unsigned short length) {
+    if (!DMX_Universe_IsWriter(universe, writer)) {
+        return;
+    }
+
+    DMX_Universe *u = &universes[universe];
+    u->Length[u->Back] = length;
+    u->Updates++;
+    u->LastUpdate = sys_now();
+
+    // Swap the written frame in as the fresh spare, continue on whatever the spare was
+    u->Latest = u->Back;
+    u->Prepared = 0;
+    u->Back = DMX_Exchange(&u->Middle, u->Back | DMX_FRESH) & ~DMX_FRESH;
+    u->Writer = DMX_WRITER_NONE;
+}
+
+void DMX_Universe_Abort(unsigned char universe, DMX_Writer writer) {
+    if (!DMX_Universe_IsWriter(universe, writer)) {
+        return;
+    }
+
+    universes[universe].Prepared = 0;
+    universes[universe].Writer = DMX_WRITER_NONE;
+}
+
+char DMX_Universe_IsWriter(unsigned char universe, DMX_Writer writer) {
+    return universe < DMX_UNIVERSE_COUNT && universes[universe].Writer == writer;
+}
+
+const unsigned char *DMX_Universe_Read(unsigned char universe, unsigned short *length) {
+    if (universe >= DMX_UNIVERSE_COUNT) {
+        *length = 0;
+        return 0;
+    }
+
+    DMX_Universe *u = &universes[universe];
+
+    if (u->Middle & DMX_FRESH) {
+        u->Front = DMX_Exchange(&u->Middle, u->Front) & ~DMX_FRESH;
+    }
+
+    *length = u->Length[u->Front];
+    return u->Frames[u->Front];
+}
+
+char DMX_Universe_HasUpdate(unsigned char universe) {
+    return universe < DMX_UNIVERSE_COUNT && (universes[universe].Middle & DMX_FRESH) != 0;
+}
+
+const DMX_Universe *DMX_Universe_Get(unsigned char universe) {
+    if (universe >= DMX_UNIVERSE_COUNT) {
+        return 0;
+    }
+
+    return &universes[universe];
+}
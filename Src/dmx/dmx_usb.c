@@ -0,0 +1,210 @@
+#include "dmx/dmx_usb.h"
+#include "cdc/cdc_device.h"
+#include "hid/hid_device.h"
+
+#include <string.h>
+
+typedef enum {
+    DMX_ENTTEC_IDLE,
+    DMX_ENTTEC_LABEL,
+    DMX_ENTTEC_LENGTHLO,
+    DMX_ENTTEC_LENGTHHI,
+    DMX_ENTTEC_DATA,
+    DMX_ENTTEC_TRAILER,
+} DMX_EnttecState;
+
+static struct {
+    DMX_EnttecState State;
+    unsigned char Label;
+    unsigned short Length;
+    unsigned short Received;
+    unsigned char *Frame; // Universe frame the channels of a SENDDMX message go to, slot 0 is claimed while set
+} enttec = {0};
+
+static unsigned short hidLength[DMX_UNIVERSE_COUNT]; // Channels of the frame HID collects while it holds the slot
+static DMX_HidStatus hidStatus;
+
+static void DMX_HidReport(const char *report, short length) {
+    if (length < 2) {
+        return;
+    }
+
+    unsigned char universe = ((unsigned char)report[0] >> 4) & 0x07;
+    unsigned short offset = (report[0] & 0x0F) * DMX_HID_BLOCK;
+
+    if (universe >= DMX_UNIVERSE_COUNT) {
+        return;
+    }
+
+    // The slot stays claimed from the first block to the commit, so the output never sends a partly updated frame
+    char started = DMX_Universe_IsWriter(universe, DMX_WRITER_HID);
+    unsigned char *frame = DMX_Universe_BeginUpdate(universe, DMX_WRITER_HID);
+
+    if (frame == 0) {
+        // Art-Net, sACN or an Enttec message is writing the slot
+        return;
+    }
+
+    if (!started) {
+        const DMX_Universe *u = DMX_Universe_Get(universe);
+        hidLength[universe] = u->Length[u->Back];
+    }
+
+    length--;
+    if (length > DMX_HID_BLOCK) {
+        length = DMX_HID_BLOCK;
+    }
+    memcpy(frame + offset, report + 1, length);
+
+    if (offset + length > hidLength[universe]) {
+        hidLength[universe] = offset + length;
+    }
+
+    if ((report[0] & DMX_HID_COMMIT) != 0) {
+        DMX_Universe_EndWrite(universe, DMX_WRITER_HID, hidLength[universe]);
+    }
+}
+
+static const char *DMX_HidGetReport(unsigned char type, unsigned char id, short *length) {
+    const DMX_Universe *u = DMX_Universe_Get(id);
+
+    if (type != DMX_HID_FEATURE || u == 0) {
+        return 0;
+    }
+
+    // Writers in the main loop can not go on while this runs in the USB-ISR, so the latest frame stays as it is
+    const unsigned char *frame = u->Frames[u->Latest];
+    unsigned short sum1 = 0, sum2 = 0;
+
+    hidStatus.Updates = u->Updates;
+    hidStatus.Length = u->Length[u->Latest];
+    for (int i = 0; i < hidStatus.Length; i++) {
+        sum1 = (sum1 + frame[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    hidStatus.Checksum = sum2 << 8 | sum1;
+
+    *length = sizeof(hidStatus);
+    return (const char *)&hidStatus;
+}
+
+static void DMX_EnttecReply(unsigned char label, const char *data, unsigned short length) {
+    // Replies go through the CDC TX ring, a reply that does not fit completely is left out
+    char reply[16];
+
+    if (CDC_WriteSpace(0) < length + 5) {
+        return;
+    }
+
+    reply[0] = DMX_ENTTEC_START;
+    reply[1] = label;
+    reply[2] = length & 0xFF;
+    reply[3] = length >> 8;
+    memcpy(reply + 4, data, length);
+    reply[4 + length] = DMX_ENTTEC_END;
+
+    CDC_Write(0, reply, length + 5);
+}
+
+static void DMX_EnttecRelease() {
+    if (enttec.Frame != 0) {
+        DMX_Universe_Abort(0, DMX_WRITER_ENTTEC);
+        enttec.Frame = 0;
+    }
+}
+
+static void DMX_EnttecMessage() {
+    switch (enttec.Label) {
+    case DMX_ENTTEC_SENDDMX:
+        if (enttec.Frame != 0 && enttec.Received > 0) {
+            // The start code is not stored
+            DMX_Universe_EndWrite(0, DMX_WRITER_ENTTEC, enttec.Received - 1);
+            enttec.Frame = 0;
+        }
+        break;
+    case DMX_ENTTEC_GETPARAMS: {
+        // Firmware 1.0, break & MAB in 10.67us units, refresh as fast as possible
+        const char params[5] = {0x00, 0x01, 9, 1, 0};
+        DMX_EnttecReply(DMX_ENTTEC_GETPARAMS, params, sizeof(params));
+        break;
+    }
+    case DMX_ENTTEC_GETSERIAL: {
+        const char serial[4] = {0x01, 0x00, 0x00, 0x00};
+        DMX_EnttecReply(DMX_ENTTEC_GETSERIAL, serial, sizeof(serial));
+        break;
+    }
+    }
+}
+
+static void DMX_EnttecReceive(const char *data, short length) {
+    if (enttec.Frame != 0 && !DMX_Universe_IsWriter(0, DMX_WRITER_ENTTEC)) {
+        // The message stalled for DMX_WRITER_TIMEOUT and another input took over slot 0, drop the rest of it
+        enttec.Frame = 0;
+    }
+
+    for (short i = 0; i < length; i++) {
+        unsigned char c = data[i];
+
+        switch (enttec.State) {
+        case DMX_ENTTEC_IDLE:
+            if (c == DMX_ENTTEC_START) {
+                enttec.State = DMX_ENTTEC_LABEL;
+            }
+            break;
+        case DMX_ENTTEC_LABEL:
+            enttec.Label = c;
+            enttec.State = DMX_ENTTEC_LENGTHLO;
+            break;
+        case DMX_ENTTEC_LENGTHLO:
+            enttec.Length = c;
+            enttec.State = DMX_ENTTEC_LENGTHHI;
+            break;
+        case DMX_ENTTEC_LENGTHHI:
+            enttec.Length |= c << 8;
+            enttec.Received = 0;
+
+            if (enttec.Label == DMX_ENTTEC_SENDDMX) {
+                // Slot 0 stays claimed until the trailer, a message arriving while another input writes is dropped
+                enttec.Frame = DMX_Universe_BeginWrite(0, DMX_WRITER_ENTTEC);
+                if (enttec.Frame != 0) {
+                    memset(enttec.Frame, 0, DMX_CHANNELS);
+                }
+            }
+
+            enttec.State = enttec.Length > 0 ? DMX_ENTTEC_DATA : DMX_ENTTEC_TRAILER;
+            break;
+        case DMX_ENTTEC_DATA:
+            // Channel data is written as it arrives, a message may span several packets
+            if (enttec.Frame != 0 && enttec.Received > 0 && enttec.Received <= DMX_CHANNELS) {
+                enttec.Frame[enttec.Received - 1] = c;
+            }
+
+            enttec.Received++;
+            if (enttec.Received == enttec.Length) {
+                enttec.State = DMX_ENTTEC_TRAILER;
+            }
+            break;
+        case DMX_ENTTEC_TRAILER:
+            if (c == DMX_ENTTEC_END) {
+                if (enttec.Received > DMX_CHANNELS + 1) {
+                    enttec.Received = DMX_CHANNELS + 1;
+                }
+
+                DMX_EnttecMessage();
+            }
+
+            DMX_EnttecRelease();
+            enttec.State = DMX_ENTTEC_IDLE;
+            break;
+        }
+    }
+}
+
+void DMX_Usb_Init() {
+    HID_SetReportHandler(&DMX_HidReport);
+    HID_SetGetReportHandler(&DMX_HidGetReport);
+#ifndef CDC_UART
+    // The CDC interface belongs to the UART bridge if it is built in
+    CDC_SetReceiveHandler(0, &DMX_EnttecReceive);
+#endif
+}
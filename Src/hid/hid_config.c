@@ -4,7 +4,7 @@
 static const USB_DESCRIPTOR_DEVICE DeviceDescriptor = {
     .Length = 18,
     .Type = 0x01,
-    .USBVersion = 0x0200,
+    .USBVersion = 0x0201, // 2.01 for the BOS descriptor (LPM)
     .DeviceClass = 0x00,
     .DeviceSubClass = 0x00,
     .DeviceProtocol = 0x00,
@@ -24,7 +24,7 @@ static const USB_DESCRIPTOR_CONFIG ConfigDescriptor = {
     .Interfaces = 1,
     .ConfigurationID = 1,
     .strConfiguration = 0,
-    .Attributes = (1 << 7),
+    .Attributes = (1 << 7) | (1 << 5), // Remote wakeup
     .MaxPower = 50};
 
 static const USB_DESCRIPTOR_INTERFACE HIDInterface = {
@@ -138,6 +138,11 @@ static unsigned short *GetString(char index, short lcid, short *length) {
     return 0;
 }
 
+const char *HID_GetReportDescriptor(short *length) {
+    *length = sizeof(HIDConfigurationBuffer);
+    return HIDConfigurationBuffer;
+}
+
 USB_Implementation HID_GetImplementation() {
     USB_Implementation impl = {0};
     
@@ -159,5 +164,6 @@ USB_Implementation HID_GetImplementation() {
     impl.NumInterfaces = 1;
 
     impl.GetString = &GetString;
+    impl.SetupPacket_Handler = &HID_SetupPacket;
     return impl;
 }
\ No newline at end of file
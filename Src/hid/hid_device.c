@@ -1,11 +1,59 @@
 #include "hid/hid_device.h"
+#include "hid/hid_config.h"
+
+#define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
 
 static char buffer[33];
+static void (*reportHandler)(const char *report, short length) = 0;
+static const char *(*getReportHandler)(unsigned char type, unsigned char id, short *length) = 0;
+
+void HID_SetReportHandler(void (*handler)(const char *report, short length)) {
+    reportHandler = handler;
+}
+
+void HID_SetGetReportHandler(const char *(*handler)(unsigned char type, unsigned char id, short *length)) {
+    getReportHandler = handler;
+}
 
 void HID_HandlePacket(unsigned char ep, short length) {
-    USB_Fetch(1, buffer, &length);
+    length = sizeof(buffer);
+    USB_Fetch(ep, buffer, &length);
+
+    if (reportHandler != 0) {
+        reportHandler(buffer, length);
+    }
 }
 
 char HID_SetupPacket(USB_SETUP_PACKET *setup, char *data, short length) {
+    if ((setup->RequestType & 0x60) == 0) {
+        // Standard request on the interface, only the report descriptor is handled here
+        if (setup->Request == HID_CONFIG_GETDESCRIPTOR && setup->DescriptorType == 0x22) {
+            short descriptorLength;
+            const char *descriptor = HID_GetReportDescriptor(&descriptorLength);
+
+            USB_Transmit(0, descriptor, MIN(descriptorLength, setup->Length));
+            return USB_OK;
+        }
+
+        return USB_ERR;
+    }
+
+    switch (setup->Request) {
+    case HID_CLASS_SETIDLE:
+        // Reports are only sent on change anyway
+        return USB_OK;
+    case HID_CLASS_GETREPORT:
+        if (getReportHandler != 0) {
+            short reportLength;
+            const char *report = getReportHandler(setup->Value >> 8, setup->Value & 0xFF, &reportLength);
+
+            if (report != 0) {
+                USB_Transmit(0, (const unsigned char *)report, MIN(reportLength, setup->Length));
+                return USB_OK;
+            }
+        }
+        return USB_ERR;
+    }
+
     return USB_ERR;
-}
\ No newline at end of file
+}
@@ -0,0 +1,131 @@
+#include "log/log.h"
+
+#if (LOG_BUFFER & (LOG_BUFFER - 1)) != 0
+#error "LOG_BUFFER has to be a power of two"
+#endif
+
+// Record: header (valid flag, argument count, format ID), cycle timestamp, arguments
+#define LOG_VALID 0x80000000
+#define LOG_HEADER(id, count) (LOG_VALID | ((count) << 16) | ((id) & 0xFFFF))
+#define LOG_LENGTH(header) (2 + (((header) >> 16) & 0x07))
+
+// Producers reserve their words by moving Head, the header is written last and marks the record as complete.
+// The consumer clears the words again before it releases them by moving Tail, so stale data never looks like a header
+static volatile unsigned int ring[LOG_BUFFER];
+static volatile unsigned int head = 0;
+static volatile unsigned int tail = 0;
+
+static unsigned int batch[LOG_BATCH / 4];
+static unsigned int reportedDrops = 0;
+static LOG_Stats stats = {0};
+
+static char LOG_Reserve(unsigned int length, unsigned int *start) {
+#if (__CORTEX_M >= 3)
+    unsigned int position;
+
+    do {
+        position = __LDREXW(&head);
+
+        if (position - tail + length > LOG_BUFFER) {
+            __CLREX();
+            return 0;
+        }
+    } while (__STREXW(position + length, &head) != 0);
+
+    *start = position;
+    return 1;
+#else
+    // No exclusive access on the Cortex-M0, the reservation is short enough to simply mask interrupts
+    unsigned int primask = __get_PRIMASK();
+    __disable_irq();
+
+    unsigned int position = head;
+    char result = position - tail + length <= LOG_BUFFER;
+
+    if (result) {
+        head = position + length;
+    }
+
+    __set_PRIMASK(primask);
+    *start = position;
+    return result;
+#endif
+}
+
+void LOG_Write(unsigned int id, unsigned char count, const unsigned int *args) {
+    unsigned int length = 2 + count;
+    unsigned int start;
+
+    if (!LOG_Reserve(length, &start)) {
+        stats.Dropped++;
+        return;
+    }
+
+    ring[(start + 1) & (LOG_BUFFER - 1)] = sys_cycles();
+    for (int i = 0; i < count; i++) {
+        ring[(start + 2 + i) & (LOG_BUFFER - 1)] = args[i];
+    }
+
+    __DMB();
+    ring[start & (LOG_BUFFER - 1)] = LOG_HEADER(id, count);
+}
+
+void LOG_Flush() {
+    // Batch header: magic, length of the records in bytes, records lost since the last batch, core clock
+    const unsigned int headerLength = 4;
+    unsigned int length = headerLength;
+    unsigned int position = tail;
+    unsigned int usage = head - position;
+
+    if (usage > stats.MaxUsage) {
+        stats.MaxUsage = usage;
+    }
+
+    short space = CDC_WriteSpace(LOG_CDC_PORT);
+    if (space > LOG_BATCH) {
+        space = LOG_BATCH;
+    }
+
+    while (position != head) {
+        unsigned int header = ring[position & (LOG_BUFFER - 1)];
+
+        // Reserved but not written yet, records are sent in order
+        if ((header & LOG_VALID) == 0) {
+            break;
+        }
+
+        unsigned int recordLength = LOG_LENGTH(header);
+        if ((length + recordLength) * 4 > space) {
+            break;
+        }
+
+        for (int i = 0; i < recordLength; i++) {
+            batch[length + i] = ring[(position + i) & (LOG_BUFFER - 1)];
+            ring[(position + i) & (LOG_BUFFER - 1)] = 0;
+        }
+
+        position += recordLength;
+        length += recordLength;
+        stats.Records++;
+    }
+
+    if (length == headerLength) {
+        return;
+    }
+
+    // Released only now, so producers cannot reuse words before they are cleared
+    tail = position;
+
+    batch[0] = LOG_MAGIC;
+    batch[1] = (length - headerLength) * 4;
+    batch[2] = stats.Dropped - reportedDrops;
+    batch[3] = SystemCoreClock;
+    reportedDrops += batch[2];
+
+    CDC_Write(LOG_CDC_PORT, (const char *)batch, length * 4);
+    stats.Batches++;
+}
+
+const LOG_Stats *LOG_GetStats() {
+    return &stats;
+}
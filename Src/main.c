@@ -1,87 +1,160 @@
 #include "usb.h"
 
+#ifdef USB_AUDIO
+#include "audio/audio_config.h"
+#endif
+#ifdef USB_MIDI
+#include "midi/midi_config.h"
+#include "midi/midi_device.h"
+#endif
+#include "boot.h"
+#include "clock.h"
+
+#ifndef NCM_SLIM
 #include "cdc/cdc_config.h"
+#include "cdc/cdc_device.h"
 #include "hid/hid_config.h"
+#endif
+#ifdef CDC_UART
+#include "cdc/cdc_uart.h"
+#endif
+#include "log/log.h"
+#ifdef USB_COMPOSITE
+#include "composite/composite_config.h"
+#endif
 #include "ncm/ncm_config.h"
+#ifdef PROFILER
+#include "profile/profiler.h"
+#endif
+#ifdef DMX_NET
+#include "dmx/dmx_net.h"
+#endif
+#ifdef DMX_OUTPUT
+#include "dmx/dmx_output.h"
+#include "dmx/dmx_usb.h"
+#endif
 
-static void InitClock();
+#ifndef NCM_SLIM
+static void Loopback();
+#endif
+#ifdef USB_MIDI
+static void MidiLoopback(unsigned int event);
+#endif
 
 /**
  * @brief  The application entry point.
  * @retval int
  */
 int main(void) {
-    InitClock();
+    BOOT_Mark(BOOT_MAIN);
+    CLOCK_Init();
     Systick_Init();
+    Timebase_Init();
+    BOOT_Mark(BOOT_CLOCK);
+    Cycles_Init();
+#ifdef PROFILER
+    PROFILER_Init();
+#endif
 
+#ifndef NCM_SLIM
+    // The slim build (stm32f042_ncm) only links NCM
     USB_Implementation cdc = CDC_GetImplementation();
     USB_Implementation hid = HID_GetImplementation();
-    /* too large for stm32f0xx implementation
+#endif
+#if defined(DMX_NET) || defined(DMX_OUTPUT)
+    DMX_Universe_Init();
+#endif
+#ifdef CDC_UART
+    CDC_Uart_Init();
+#endif
+#ifdef DMX_OUTPUT
+    DMX_Usb_Init();
+    DMX_Output_Init();
+#endif
+#if defined(USB_COMPOSITE)
+    // CDC, HID & NCM side by side in one configuration
     USB_Implementation ncm = NCM_GetImplementation();
+    USB_Init(COMPOSITE_GetImplementation((USB_Implementation[]){cdc, hid, ncm}, 3));
     NCM_Init();
+#ifdef DMX_NET
+    DMX_Net_Init();
+#endif
+#elif defined(NCM_BENCHMARK) || defined(NCM_SLIM)
+    // The benchmark and the slim stm32f0xx build (stm32f042_ncm) run on the NCM interface
+    USB_Implementation ncm = NCM_GetImplementation();
+    USB_Init(ncm);
+    NCM_Init();
+#ifdef DMX_NET
+    DMX_Net_Init();
+#endif
+#elif defined(USB_AUDIO)
+    // Speaker & microphone on the codec at SAI1, streamed by the SOF & isochronous callbacks
+    USB_Init(AUDIO_GetImplementation());
+#elif defined(USB_MIDI)
+    // Echo every event for Tools/midi_bench.py, applications set their own handler and queue with MIDI_Send
+    USB_Implementation midi = MIDI_GetImplementation();
+    MIDI_SetReceiveHandler(MidiLoopback);
+    USB_Init(midi);
+#else
+    /* stm32f0xx needs the slim build, see the stm32f042_ncm target
+    USB_Implementation ncm = NCM_GetImplementation();
     USB_Init(ncm);
+    NCM_Init();
     */
     USB_Init(cdc);
+#endif
+
+    LOG_Print("main: running at %u Hz, clock profile %u", SystemCoreClock, CLOCK_GetInfo()->Profile);
 
     while (1) {
-    	/* too large for stm32f0xx implementation
+#if defined(USB_COMPOSITE) || defined(NCM_BENCHMARK) || defined(NCM_SLIM)
+        NCM_Loop();
+#else
+    	/* stm32f0xx needs the slim build, see the stm32f042_ncm target
         NCM_Loop();
         */
+#endif
+#if !defined(NCM_BENCHMARK) && !defined(NCM_SLIM) && !defined(USB_AUDIO) && !defined(USB_MIDI)
+#ifdef CDC_UART
+        CDC_Uart_Loop();
+#else
+        Loopback();
+#endif
+#endif
+#ifdef LOG
+        LOG_Flush();
+#endif
     }
 }
 
-static void InitClock() {
-
-#if defined(STM32G441xx) || defined(STM32G474xx)
-
-    RCC->CR |= RCC_CR_HSEON;
+#ifndef NCM_SLIM
+static void Loopback() {
+    // Mirror the text on every port, only read as much as can be written back so nothing gets lost
+    char data[64];
 
-    // Configure PLL (R=143.75, Q=47.92)
-    RCC->CR &= ~RCC_CR_PLLON;
-    while (RCC->CR & RCC_CR_PLLRDY) {
-    }
-    RCC->PLLCFGR |= RCC_PLLCFGR_PLLSRC_HSE | RCC_PLLCFGR_PLLM_0 | (23 << RCC_PLLCFGR_PLLN_Pos) | RCC_PLLCFGR_PLLQ_1;
-    RCC->PLLCFGR |= RCC_PLLCFGR_PLLREN | RCC_PLLCFGR_PLLQEN;
-    RCC->CR |= RCC_CR_PLLON;
-
-    // Select PLL as main clock, AHB/2
-    RCC->CFGR |= RCC_CFGR_HPRE_3 | RCC_CFGR_SW_PLL;
+    for (int port = 0; port < CDC_PORTS; port++) {
+#ifdef LOG
+        if (port == LOG_CDC_PORT) {
+            continue;
+        }
+#endif
 
-    // Select USB Clock as PLLQ
-    RCC->CCIPR = RCC_CCIPR_CLK48SEL_1;
+        short length = CDC_WriteSpace(port);
 
-    // Enable IO Clock for USB & Port
-    RCC->AHB2ENR |= RCC_AHB2ENR_GPIOAEN;
-    RCC->APB1ENR1 |= RCC_APB1ENR1_USBEN;
+        if (length > sizeof(data)) {
+            length = sizeof(data);
+        }
 
-    while ((RCC->CFGR & RCC_CFGR_SWS_Msk) != RCC_CFGR_SWS_PLL) {
+        length = CDC_Read(port, data, length);
+        if (length > 0) {
+            CDC_Write(port, data, length);
+        }
     }
-
-#elif defined(STM32F042x6)
-    // enable HSI48
-    RCC->CR2 |= RCC_CR2_HSI48ON;
-    while (!(RCC->CR2 & RCC_CR2_HSI48RDY)) {};
-
-    // enable CRS for USB-sync
-    RCC->APB1ENR |= RCC_APB1ENR_CRSEN;
-    // reset CRS config
-    CRS->CR = 0;
-    CRS->CFGR = 0;
-    // automatic trimming
-    CRS->CFGR |= CRS_CFGR_SYNCSRC_1;    // USB SOF
-    CRS->CR |= CRS_CR_AUTOTRIMEN | CRS_CR_CEN;
-
-    // select HSI48 as USB clock source
-    RCC->CFGR3 &= ~RCC_CFGR3_USBSW;
-    RCC->CFGR3 |= RCC_CFGR3_USBSW_HSI48;
-
-    // enable GPIOA and USB clocks
-    RCC->AHBENR |= RCC_AHBENR_GPIOAEN;
-    RCC->APB1ENR |= RCC_APB1ENR_USBEN;
-
-#else
-#error "Unsupported MCU"
+}
 #endif
 
-    SystemCoreClockUpdate();
+#ifdef USB_MIDI
+static void MidiLoopback(unsigned int event) {
+    MIDI_Send(event);
 }
+#endif
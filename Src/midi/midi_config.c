@@ -0,0 +1,203 @@
+#include "midi/midi_config.h"
+#include "midi/midi_device.h"
+
+// MIDI 1.0 function: an empty audio control interface and a MIDI streaming interface with one cable in each direction.
+// Embedded jacks connect the bulk endpoints to the external jacks (ports) of the device
+#define MIDI_JACK_IN_EMBEDDED 1
+#define MIDI_JACK_IN_EXTERNAL 2
+#define MIDI_JACK_OUT_EMBEDDED 3
+#define MIDI_JACK_OUT_EXTERNAL 4
+
+static const USB_DESCRIPTOR_DEVICE DeviceDescriptor = {
+    .Length = 18,
+    .Type = 0x01,
+    .USBVersion = 0x0201, // 2.01 for the BOS descriptor (LPM)
+    .DeviceClass = 0x00,
+    .DeviceSubClass = 0x00,
+    .DeviceProtocol = 0x00,
+    .MaxPacketSize = 64,
+    .VendorID = 0xDEAD,
+    .ProductID = 0xBEEF,
+    .DeviceVersion = 0x0100,
+    .strManufacturer = 1,
+    .strProduct = 2,
+    .strSerialNumber = 3,
+    .Configurations = 1};
+
+static const USB_DESCRIPTOR_CONFIG ConfigDescriptor = {
+    .Length = 9,
+    .Type = 0x02,
+    .TotalLength = 101,
+    .Interfaces = 2,
+    .ConfigurationID = 1,
+    .strConfiguration = 0,
+    .Attributes = (1 << 7) | (1 << 5), // Remote wakeup
+    .MaxPower = 50};
+
+static const USB_DESCRIPTOR_INTERFACE ControlInterface = {
+    .Length = 9,
+    .Type = 0x04,
+    .InterfaceID = 0,
+    .AlternateID = 0,
+    .Endpoints = 0,
+    .Class = 0x01,
+    .SubClass = 0x01,
+    .Protocol = 0x00,
+    .strInterface = 0};
+
+static const USB_DESC_AUDIO1_HEADER1 ControlHeader = {
+    .Length = 9,
+    .Type = CS_INTERFACE,
+    .SubType = AC_HEADER,
+    .ADCVersion = 0x0100,
+    .TotalLength = 9,
+    .InCollection = 1,
+    .Interface0 = 1};
+
+static const USB_DESCRIPTOR_INTERFACE StreamingInterface = {
+    .Length = 9,
+    .Type = 0x04,
+    .InterfaceID = 1,
+    .AlternateID = 0,
+    .Endpoints = 2,
+    .Class = 0x01,
+    .SubClass = 0x03,
+    .Protocol = 0x00,
+    .strInterface = 4};
+
+static const USB_DESC_MIDI_HEADER StreamingHeader = {
+    .Length = 7,
+    .Type = CS_INTERFACE,
+    .SubType = MS_HEADER,
+    .MSCVersion = 0x0100,
+    .TotalLength = 65};
+
+static const USB_DESC_MIDI_IN_JACK InJacks[2] = {
+    {.Length = 6,
+     .Type = CS_INTERFACE,
+     .SubType = MIDI_IN_JACK,
+     .JackType = JACK_EMBEDDED,
+     .JackID = MIDI_JACK_IN_EMBEDDED,
+     .strJack = 0},
+    {.Length = 6,
+     .Type = CS_INTERFACE,
+     .SubType = MIDI_IN_JACK,
+     .JackType = JACK_EXTERNAL,
+     .JackID = MIDI_JACK_IN_EXTERNAL,
+     .strJack = 0}};
+
+static const USB_DESC_MIDI_OUT_JACK1 OutJacks[2] = {
+    {.Length = 9,
+     .Type = CS_INTERFACE,
+     .SubType = MIDI_OUT_JACK,
+     .JackType = JACK_EMBEDDED,
+     .JackID = MIDI_JACK_OUT_EMBEDDED,
+     .InputPins = 1,
+     .SourceID = MIDI_JACK_IN_EXTERNAL,
+     .SourcePin = 1,
+     .strJack = 0},
+    {.Length = 9,
+     .Type = CS_INTERFACE,
+     .SubType = MIDI_OUT_JACK,
+     .JackType = JACK_EXTERNAL,
+     .JackID = MIDI_JACK_OUT_EXTERNAL,
+     .InputPins = 1,
+     .SourceID = MIDI_JACK_IN_EMBEDDED,
+     .SourcePin = 1,
+     .strJack = 0}};
+
+static const USB_DESCRIPTOR_ENDPOINT_AUDIO StreamingEndpoints[2] = {
+    {.Length = 9,
+     .Type = 0x05,
+     .Address = MIDI_EP,
+     .Attributes = 0x02,
+     .MaxPacketSize = MIDI_PACKET_SIZE,
+     .Interval = 0x00,
+     .Refresh = 0,
+     .SynchAddress = 0},
+    {.Length = 9,
+     .Type = 0x05,
+     .Address = (1 << 7) | MIDI_EP,
+     .Attributes = 0x02,
+     .MaxPacketSize = MIDI_PACKET_SIZE,
+     .Interval = 0x00,
+     .Refresh = 0,
+     .SynchAddress = 0}};
+
+// The OUT endpoint feeds the embedded IN jack, the IN endpoint is fed by the embedded OUT jack
+static const USB_DESC_MIDI_ENDPOINT1 StreamingJacks[2] = {
+    {.Length = 5,
+     .Type = CS_ENDPOINT,
+     .SubType = MS_GENERAL,
+     .EmbeddedJacks = 1,
+     .JackID = MIDI_JACK_IN_EMBEDDED},
+    {.Length = 5,
+     .Type = CS_ENDPOINT,
+     .SubType = MS_GENERAL,
+     .EmbeddedJacks = 1,
+     .JackID = MIDI_JACK_OUT_EMBEDDED}};
+
+// Buffer holding the complete descriptor (except the device one) in the correct order
+static char ConfigurationBuffer[101] = {0};
+
+static const USB_CONFIG_EP EndpointConfigs[1] = {
+    {.EP = MIDI_EP,
+     .RxBufferSize = MIDI_PACKET_SIZE,
+     .TxBufferSize = MIDI_PACKET_SIZE,
+     .RxCallback = MIDI_HandlePacket,
+     .TxCallback = MIDI_TransmitComplete,
+     .Type = USB_EP_BULK}};
+
+static unsigned short *GetString(char index, short lcid, short *length) {
+    if (index == 1) {
+        *length = 20;
+        return u"Housemade";
+    } else if (index == 2) {
+        *length = 38;
+        return u"My MIDI Controller";
+    } else if (index == 3) {
+        *length = 22;
+        return u"01234-6786";
+    } else if (index == 4) {
+        *length = 30;
+        return u"MIDI Interface";
+    }
+
+    return 0;
+}
+
+USB_Implementation MIDI_GetImplementation() {
+    USB_Implementation impl = {0};
+
+    unsigned short len = USB_BuildDescriptor(ConfigurationBuffer, sizeof(ConfigurationBuffer), 13,
+                                             (const void *[]){
+                                                 &ConfigDescriptor,
+                                                 &ControlInterface,
+                                                 &ControlHeader,
+                                                 &StreamingInterface,
+                                                 &StreamingHeader,
+                                                 &InJacks[0],
+                                                 &InJacks[1],
+                                                 &OutJacks[0],
+                                                 &OutJacks[1],
+                                                 &StreamingEndpoints[0],
+                                                 &StreamingJacks[0],
+                                                 &StreamingEndpoints[1],
+                                                 &StreamingJacks[1]});
+
+    MIDI_Init();
+
+    impl.DeviceDescriptor = &DeviceDescriptor;
+    impl.ConfigDescriptor = ConfigurationBuffer;
+    impl.ConfigDescriptorLength = len;
+
+    impl.Endpoints = EndpointConfigs;
+    impl.NumEndpoints = 1;
+    impl.NumInterfaces = 2;
+
+    impl.GetString = &GetString;
+    impl.SetupPacket_Handler = &MIDI_SetupPacket;
+    impl.Suspend_Handler = &MIDI_Suspend;
+    impl.Wakeup_Handler = &MIDI_Wakeup;
+    return impl;
+}
@@ -0,0 +1,224 @@
+#include "midi/midi_device.h"
+
+#define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
+
+#if (MIDI_QUEUE & (MIDI_QUEUE - 1)) != 0
+#error "MIDI_QUEUE has to be a power of two"
+#endif
+
+// Producers reserve a slot by moving Head and store their event in it, the consumer takes the events in order until it
+// reaches a slot that is still 0. It clears the slots before it releases them by moving Tail, as the binary log does
+static volatile unsigned int queue[MIDI_QUEUE];
+static volatile unsigned int head = 0;
+static volatile unsigned int tail = 0;
+
+static unsigned int packet[MIDI_PACKET_EVENTS];
+static unsigned int received[MIDI_PACKET_EVENTS];
+static TIMER flushTimer;
+static void (*receiveHandler)(unsigned int event) = 0;
+
+static MIDI_Stats stats = {0};
+static MIDI_Stats snapshot;
+
+static char MIDI_Reserve(unsigned int *slot) {
+#if (__CORTEX_M >= 3)
+    unsigned int position;
+
+    do {
+        position = __LDREXW(&head);
+
+        if (position - tail >= MIDI_QUEUE) {
+            __CLREX();
+            return 0;
+        }
+    } while (__STREXW(position + 1, &head) != 0);
+
+    *slot = position;
+    return 1;
+#else
+    // No exclusive access on the Cortex-M0, the reservation is short enough to simply mask interrupts
+    unsigned int primask = __get_PRIMASK();
+    __disable_irq();
+
+    unsigned int position = head;
+    char result = position - tail < MIDI_QUEUE;
+
+    if (result) {
+        head = position + 1;
+    }
+
+    __set_PRIMASK(primask);
+    *slot = position;
+    return result;
+#endif
+}
+
+// The consumers are the flush timer and the TX-complete callback, both run at the priority of the USB interrupts
+static short MIDI_SendPacket() {
+    unsigned int position = tail;
+    unsigned int queued = head - position;
+    short count = 0;
+
+    if (queued > stats.MaxQueued) {
+        stats.MaxQueued = queued;
+    }
+
+    while (count < MIDI_PACKET_EVENTS && position != head) {
+        volatile unsigned int *slot = &queue[position & (MIDI_QUEUE - 1)];
+
+        // Reserved but not written yet, events are sent in order
+        if (*slot == 0) {
+            break;
+        }
+
+        packet[count++] = *slot;
+        *slot = 0;
+        position++;
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    tail = position;
+    stats.TxPackets++;
+    stats.TxEvents += count;
+
+    USB_Transmit(MIDI_EP, (unsigned char *)packet, count * 4);
+    return count;
+}
+
+static void MIDI_Flush(void *arg) {
+    if (!USB_IsConfigured() || USB_IsTransmitPending(MIDI_EP)) {
+        return;
+    }
+
+    // The timer keeps running in L1 sleep, queued events wake the host if it allowed that
+    if (USB_IsSuspended()) {
+        if (head != tail) {
+            USB_RemoteWakeup();
+        }
+        return;
+    }
+
+    if (MIDI_SendPacket() > 0) {
+        stats.TxFlushed++;
+    }
+}
+
+void MIDI_Init() {
+    head = 0;
+    tail = 0;
+
+    TIMER_Start(&flushTimer, MIDI_FLUSH_US, MIDI_FLUSH_US, MIDI_Flush, 0);
+}
+
+char MIDI_Send(unsigned int event) {
+    unsigned int slot;
+
+    if (event == 0) {
+        return USB_ERR;
+    }
+
+    if (!MIDI_Reserve(&slot)) {
+        stats.Dropped++;
+        return USB_ERR;
+    }
+
+    // Storing the event is what makes it visible to the consumer
+    queue[slot & (MIDI_QUEUE - 1)] = event;
+    return USB_OK;
+}
+
+char MIDI_SendMessage(unsigned char cable, unsigned char status, unsigned char data1, unsigned char data2) {
+    unsigned char cin;
+
+    if (status < 0x80) {
+        return USB_ERR;
+    } else if (status < 0xF0) {
+        // Channel messages use their upper nibble, program change & channel pressure have one data byte
+        cin = status >> 4;
+        if (cin == 0x0C || cin == 0x0D) {
+            data2 = 0;
+        }
+    } else if (status >= 0xF8) {
+        // Real time, single byte
+        cin = 0x0F;
+        data1 = 0;
+        data2 = 0;
+    } else if (status == 0xF2) {
+        cin = 0x03;
+    } else if (status == 0xF1 || status == 0xF3) {
+        cin = 0x02;
+        data2 = 0;
+    } else if (status == 0xF6) {
+        cin = 0x05;
+        data1 = 0;
+        data2 = 0;
+    } else {
+        // SysEx has to be split into event packets by the caller
+        return USB_ERR;
+    }
+
+    return MIDI_Send(MIDI_EVENT(cable, cin, status, data1, data2));
+}
+
+unsigned short MIDI_SendSpace() {
+    return MIDI_QUEUE - (head - tail);
+}
+
+void MIDI_SetReceiveHandler(void (*handler)(unsigned int event)) {
+    receiveHandler = handler;
+}
+
+const MIDI_Stats *MIDI_GetStats() {
+    return &stats;
+}
+
+void MIDI_HandlePacket(unsigned char ep, short length) {
+    length = sizeof(received);
+    USB_Fetch(ep, (unsigned char *)received, &length);
+    stats.RxPackets++;
+
+    for (short i = 0; i < length / 4; i++) {
+        // Some hosts pad the packet with empty events
+        if (received[i] == 0) {
+            continue;
+        }
+
+        stats.RxEvents++;
+        if (receiveHandler != 0) {
+            receiveHandler(received[i]);
+        }
+    }
+}
+
+void MIDI_TransmitComplete(unsigned char ep, short length) {
+    // Under load the next packet is full already, it goes out right away instead of the trailing empty packet
+    if (head - tail >= MIDI_PACKET_EVENTS && MIDI_SendPacket() == MIDI_PACKET_EVENTS) {
+        stats.TxFull++;
+    }
+}
+
+void MIDI_Suspend() {
+    TIMER_Stop(&flushTimer);
+}
+
+void MIDI_Wakeup() {
+    TIMER_Start(&flushTimer, MIDI_FLUSH_US, MIDI_FLUSH_US, MIDI_Flush, 0);
+}
+
+char MIDI_SetupPacket(USB_SETUP_PACKET *setup, const unsigned char *data, short length) {
+    // Neither the audio control nor the MIDI streaming interface have class requests, only the counters are read
+    if ((setup->RequestType & 0x60) == 0x40 && (setup->RequestType & 0x80) != 0 && setup->Request == MIDI_STATS_REQUEST) {
+        snapshot = stats;
+        if (setup->Value == 1) {
+            stats = (MIDI_Stats){0};
+        }
+
+        USB_Transmit(0, (unsigned char *)&snapshot, MIN(sizeof(snapshot), setup->Length));
+        return USB_OK;
+    }
+
+    return USB_ERR;
+}
@@ -0,0 +1,161 @@
+#include "ncm/ncm_bench.h"
+#include "clock.h"
+#include "lwip/apps/lwiperf.h"
+#include "lwip/netif.h"
+#include "lwip/udp.h"
+#include "ncm/ncm_netif.h"
+
+#include <string.h>
+
+NCM_BenchStats ncmBenchStats = {0};
+
+#define NCM_BENCH_MEMORY_RUNS 4
+#define NCM_BENCH_MEMSET 0xFF
+
+static const unsigned short memorySizes[] = {4, 16, 64, 256, 1514};
+static const unsigned char memoryOffsets[][2] = {{0, 0}, {0, 1}, {0, 2}, {1, 0}, {1, 1}, {3, 1}, {2, NCM_BENCH_MEMSET}, {0, NCM_BENCH_MEMSET}};
+static NCM_BenchMemory memoryTable[sizeof(memorySizes) / sizeof(memorySizes[0]) * sizeof(memoryOffsets) / sizeof(memoryOffsets[0])];
+static unsigned char memorySource[1536 + 4];
+static unsigned char memoryTarget[1536 + 4];
+
+static void Bench_IperfReport(void *arg, enum lwiperf_report_type report_type,
+                              const ip_addr_t *local_addr, u16_t local_port, const ip_addr_t *remote_addr, u16_t remote_port,
+                              u32_t bytes_transferred, u32_t ms_duration, u32_t bandwidth_kbitpsec) {
+    ncmBenchStats.IperfBytes = bytes_transferred;
+    ncmBenchStats.IperfMs = ms_duration;
+    ncmBenchStats.IperfKbps = bandwidth_kbitpsec;
+}
+
+static void Bench_EchoRecv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
+    ncmBenchStats.UdpEchoed++;
+    udp_sendto(pcb, p, addr, port);
+    pbuf_free(p);
+}
+
+static void Bench_SinkRecv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
+    ncmBenchStats.UdpSunk++;
+    ncmBenchStats.UdpSinkBytes += p->tot_len;
+    pbuf_free(p);
+}
+
+__attribute__((noinline, optimize("no-tree-loop-distribute-patterns"))) static void Bench_ByteLoop(unsigned char *dst, const unsigned char *src, int length, char set) {
+    for (int i = 0; i < length; i++) {
+        dst[i] = set ? 0x5A : src[i];
+    }
+}
+
+static unsigned int Bench_Measure(unsigned char *dst, const unsigned char *src, int length, char set, char reference) {
+    unsigned int best = 0xFFFFFFFF;
+
+    // Interrupts would only add noise, the whole table takes well below a millisecond per row
+    for (int run = 0; run < NCM_BENCH_MEMORY_RUNS; run++) {
+        __disable_irq();
+        unsigned int start = sys_cycles();
+
+        if (reference) {
+            Bench_ByteLoop(dst, src, length, set);
+        } else if (set) {
+            memset(dst, 0x5A, length);
+        } else {
+            memcpy(dst, src, length);
+        }
+
+        unsigned int cycles = sys_cycles() - start;
+        __enable_irq();
+
+        if (cycles < best) {
+            best = cycles;
+        }
+    }
+
+    return best;
+}
+
+static void Bench_Memory(struct udp_pcb *pcb, const ip_addr_t *addr, u16_t port) {
+    NCM_BenchMemory *row = memoryTable;
+
+    for (int s = 0; s < sizeof(memorySizes) / sizeof(memorySizes[0]); s++) {
+        for (int o = 0; o < sizeof(memoryOffsets) / sizeof(memoryOffsets[0]); o++, row++) {
+            unsigned char *dst = memoryTarget + memoryOffsets[o][0];
+            const unsigned char *src = memorySource + (memoryOffsets[o][1] & 0x03);
+            char set = memoryOffsets[o][1] == NCM_BENCH_MEMSET;
+
+            row->Size = memorySizes[s];
+            row->DstOffset = memoryOffsets[o][0];
+            row->SrcOffset = memoryOffsets[o][1];
+            row->Cycles = Bench_Measure(dst, src, memorySizes[s], set, 0);
+            row->ByteCycles = Bench_Measure(dst, src, memorySizes[s], set, 1);
+        }
+    }
+
+    struct pbuf *reply = pbuf_alloc(PBUF_TRANSPORT, sizeof(memoryTable), PBUF_RAM);
+    if (reply != NULL) {
+        pbuf_take(reply, memoryTable, sizeof(memoryTable));
+        udp_sendto(pcb, reply, addr, port);
+        pbuf_free(reply);
+    }
+}
+
+static void Bench_StatsRecv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
+    // Any datagram requests a snapshot, one starting with 'R' resets the counters afterwards.
+    // 'M' measures memcpy & memset instead
+    char command = 0;
+    pbuf_copy_partial(p, &command, 1, 0);
+    pbuf_free(p);
+
+    if (command == 'M') {
+        Bench_Memory(pcb, addr, port);
+        return;
+    }
+
+    ncmBenchStats.Uptime = sys_now();
+    ncmBenchStats.CoreClock = SystemCoreClock;
+    ncmBenchStats.ClockProfile = CLOCK_GetInfo()->Profile;
+    ncmBenchStats.FlashLatency = CLOCK_GetInfo()->FlashLatency;
+
+    struct pbuf *reply = pbuf_alloc(PBUF_TRANSPORT, sizeof(NCM_BenchStats), PBUF_RAM);
+    if (reply != NULL) {
+        pbuf_take(reply, &ncmBenchStats, sizeof(NCM_BenchStats));
+        udp_sendto(pcb, reply, addr, port);
+        pbuf_free(reply);
+    }
+
+    if (command == 'R') {
+        memset(&ncmBenchStats, 0, sizeof(NCM_BenchStats));
+    }
+}
+
+static void Bench_RawEcho(const struct eth_hdr *header, const char *payload, short length) {
+    struct eth_hdr reply;
+
+    ncm_netif_raw_header(&reply, &header->src, NCM_BENCH_ETHERTYPE);
+    if (ncm_netif_send_raw(&reply, payload, length, 1) == ERR_OK) {
+        ncmBenchStats.RawEchoed++;
+    }
+}
+
+static void Bench_Bind(u16_t port, udp_recv_fn recv) {
+    struct udp_pcb *pcb = udp_new();
+
+    if (pcb != NULL) {
+        udp_bind(pcb, IP_ANY_TYPE, port);
+        udp_recv(pcb, recv, NULL);
+    }
+}
+
+void NCM_Bench_Init(struct netif *netif) {
+    lwiperf_start_tcp_server_default(Bench_IperfReport, NULL);
+    Bench_Bind(NCM_BENCH_ECHO_PORT, Bench_EchoRecv);
+    Bench_Bind(NCM_BENCH_SINK_PORT, Bench_SinkRecv);
+    Bench_Bind(NCM_BENCH_STATS_PORT, Bench_StatsRecv);
+    ncm_netif_register_ethertype(NCM_BENCH_ETHERTYPE, Bench_RawEcho);
+}
+
+void NCM_Bench_IsrDone(unsigned int cycles) {
+    ncmBenchStats.IsrCalls++;
+    ncmBenchStats.IsrCycles += cycles;
+
+    if (cycles > ncmBenchStats.IsrMaxCycles) {
+        ncmBenchStats.IsrMaxCycles = cycles;
+    }
+}
@@ -1,8 +1,10 @@
 #include "ncm/ncm_config.h"
+#include "boot.h"
 #include "lwip/autoip.h"
 #include "lwip/init.h"
 #include "lwip/netif.h"
 #include "lwip/timeouts.h"
+#include "ncm/ncm_bench.h"
 #include "ncm/ncm_device.h"
 #include "ncm/ncm_netif.h"
 
@@ -10,7 +12,7 @@
 static const USB_DESCRIPTOR_DEVICE DeviceDescriptor = {
     .Length = 18,
     .Type = 0x01,
-    .USBVersion = 0x0200,
+    .USBVersion = 0x0201, // 2.01 for the BOS descriptor (LPM)
     .DeviceClass = 0x02,
     .DeviceSubClass = 0x00,
     .DeviceProtocol = 0x00,
@@ -30,7 +32,7 @@ static const USB_DESCRIPTOR_CONFIG ConfigDescriptor = {
     .Interfaces = 2,
     .ConfigurationID = 1,
     .strConfiguration = 0,
-    .Attributes = (1 << 7),
+    .Attributes = (1 << 7) | (1 << 5), // Remote wakeup
     .MaxPower = 50};
 
 static const USB_DESCRIPTOR_INTERFACE NCMInterface = {
@@ -61,7 +63,7 @@ static const USB_DESC_FUNC_ECM FuncETH = {
     .Length = 13,
     .Type = CS_INTERFACE,
     .SubType = FUNC_ECM,
-    .MaxSegmentSize = 1514,
+    .MaxSegmentSize = NET_FRAME_SIZE,
     .strMacAddress = 20};
 
 static const USB_DESC_FUNC_NCM FuncNCM = {
@@ -151,7 +153,7 @@ static unsigned short *GetString(char index, short lcid, short *length) {
 
 static char HandleClassSetup(USB_SETUP_PACKET *setup, const unsigned char *data, short length) {
     // Route the setup packets based on the Interface / Class Index
-    NCM_SetupPacket(setup, data, length);
+    return NCM_SetupPacket(setup, data, length);
 }
 
 static void ResetClass(char interface, char alternateId) {
@@ -187,14 +189,21 @@ USB_Implementation NCM_GetImplementation() {
     impl.GetString = &GetString;
     impl.ResetInterface_Handler = &ResetClass;
     impl.SetupPacket_Handler = &HandleClassSetup;
+    impl.RemapEndpoints_Handler = &NCM_RemapEndpoints;
 
     return impl;
 }
 
 // NCM features
 static struct netif ncm_if;
+static char networkUp = 0;
 
 void NCM_Init() {
+    // Only what the USB side needs, the network follows once the host configured the device
+    NCM_InitBuffers();
+}
+
+static void NCM_InitNetwork() {
     lwip_init();
 
     netif_add(&ncm_if, IP4_ADDR_ANY, IP4_ADDR_ANY, IP4_ADDR_ANY, NULL, ncm_netif_init, netif_input);
@@ -202,9 +211,24 @@ void NCM_Init() {
     netif_set_up(&ncm_if);
 
     autoip_start(&ncm_if);
+
+#ifdef NCM_BENCHMARK
+    NCM_Bench_Init(&ncm_if);
+#endif
+
+    networkUp = 1;
+    BOOT_Mark(BOOT_NETWORK);
 }
 
 void NCM_Loop() {
+    if (!networkUp) {
+        if (!USB_IsConfigured()) {
+            return;
+        }
+
+        NCM_InitNetwork();
+    }
+
     ncm_netif_poll(&ncm_if);
     sys_check_timeouts();
 
@@ -1,24 +1,18 @@
 #include "ncm/ncm_device.h"
+#include "ncm/ncm_bench.h"
+#include "log/log.h"
 
 #define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
 
-static char buffers[6][2048] = {};
+#if NCM_TX_PMA
+// The TX NTBs are allocated in the USB-SRAM behind the endpoint buffers and sent from there without copying
+static char buffers[NCM_NTB_RX_COUNT][NCM_NTB_SIZE] __ALIGNED(4) __NOINIT;
+#else
+static char buffers[NCM_NTB_RX_COUNT + NCM_NTB_TX_COUNT][NCM_NTB_SIZE] __ALIGNED(4) __NOINIT;
+#endif
 
-static NCM_BufferInfo txDef[3] = {
-    {.buffer = buffers[0],
-     .next = &txDef[1]},
-    {.buffer = buffers[1],
-     .next = &txDef[2]},
-    {.buffer = buffers[2],
-     .next = &txDef[0]}};
-
-static NCM_BufferInfo rxDef[3] = {
-    {.buffer = buffers[3],
-     .next = &rxDef[1]},
-    {.buffer = buffers[4],
-     .next = &rxDef[2]},
-    {.buffer = buffers[5],
-     .next = &rxDef[0]}};
+static NCM_BufferInfo txDef[NCM_NTB_TX_COUNT];
+static NCM_BufferInfo rxDef[NCM_NTB_RX_COUNT];
 
 static NCM_BufferInfo *tx = &txDef[0];
 static NCM_BufferInfo *rx = &rxDef[0];
@@ -31,25 +25,60 @@ static NCM_RX_BufferInfo activeRxBuffer = {
 
 static USB_NTB_INPUT_SIZE ntbInputSize = {
     .NtbInMaxDatagrams = 0,
-    .NtbInMaxSize = 2048,
+    .NtbInMaxSize = NCM_NTB_SIZE,
 };
 
 static const USB_NTB_PARAMS ntb_params = {
     .Length = 0x1C,
     .NtbFormatsSupported = 0b01,
-    .NtbInMaxSize = 2048,
+    .NtbInMaxSize = NCM_NTB_SIZE,
     .NdpInDivisor = 1,
     .NdpInPayloadRemainder = 0,
     .NdpInAlignment = 4,
 
-    .NtbOutMaxSize = 2048,
+    .NtbOutMaxSize = NCM_NTB_SIZE,
     .NdpOutDivisior = 1,
     .NdpOutPayloadRemainder = 0,
     .NdpOutAlignment = 4,
 
-    .NtbOutMaxDatagrams = 10};
+    .NtbOutMaxDatagrams = NCM_NTB_MAX_DATAGRAMS};
+
+// Endpoints as declared in ncm_config.c, unless moved by the composite layer
+static unsigned char notifyEp = 1;
+static unsigned char dataEp = 2;
+
+// Set while an NTB is handed to the USB core
+static volatile char txBusy = 0;
+// Set while the bulk OUT endpoint is held in NAK because no NTB buffer is free
+static volatile char rxPaused = 0;
 
 static void NCM_TransmitNextBuffer();
+static void NCM_ReceivePacket(unsigned char ep, short length);
+static void NCM_ReleaseRxBuffer(NCM_BufferInfo *buffer);
+
+void NCM_InitBuffers() {
+    // Link the NTB buffers of each direction into a ring
+    for (int i = 0; i < NCM_NTB_TX_COUNT; i++) {
+#if NCM_TX_PMA
+        txDef[i].buffer = (char *)USB_AllocateSRAM(NCM_NTB_SIZE);
+        if (txDef[i].buffer == 0) {
+            LOG_Print("ncm: TX NTB %u does not fit into the USB-SRAM", i);
+        }
+#else
+        txDef[i].buffer = buffers[NCM_NTB_RX_COUNT + i];
+#endif
+        txDef[i].status = NCM_BUF_UNUSED;
+        txDef[i].references = 0;
+        txDef[i].next = &txDef[(i + 1) % NCM_NTB_TX_COUNT];
+    }
+
+    for (int i = 0; i < NCM_NTB_RX_COUNT; i++) {
+        rxDef[i].buffer = buffers[i];
+        rxDef[i].status = NCM_BUF_UNUSED;
+        rxDef[i].references = 0;
+        rxDef[i].next = &rxDef[(i + 1) % NCM_NTB_RX_COUNT];
+    }
+}
 
 char NCM_SetupPacket(USB_SETUP_PACKET *setup, char *data, short length) {
     switch (setup->Request) {
@@ -87,14 +116,31 @@ char NCM_SetupPacket(USB_SETUP_PACKET *setup, char *data, short length) {
     return USB_ERR;
 }
 
-void NCM_HandlePacket(unsigned char ep, short length) {
-    if (ep == 2) {
-        while (rx->status == NCM_BUF_LOCKED) {
-            rx = rx->next;
+void NCM_RemapEndpoints(const unsigned char *map) {
+    notifyEp = map[1];
+    dataEp = map[2];
+}
+
+__RAMFUNC void NCM_HandlePacket(unsigned char ep, short length) {
+#ifdef NCM_BENCHMARK
+    unsigned int start = sys_cycles();
+    NCM_ReceivePacket(ep, length);
+    NCM_Bench_IsrDone(sys_cycles() - start);
+#else
+    NCM_ReceivePacket(ep, length);
+#endif
+}
+
+__RAMFUNC static void NCM_ReceivePacket(unsigned char ep, short length) {
+    if (ep == dataEp) {
+        if (rx->status != NCM_BUF_UNUSED) {
+            // All NTB buffers are still in use. Leave the packet in the USB-SRAM and NAK the host until one is released
+            rxPaused = 1;
+            USB_PauseReceive(ep);
+            return;
         }
 
-        rx->status = NCM_BUF_UNUSED;
-        short received = 2048 - rx->offset;
+        short received = NCM_NTB_SIZE - rx->offset;
         USB_Fetch(ep, rx->buffer + rx->offset, &received);
 
         NCM_NTB_HEADER_16 *header = (NCM_NTB_HEADER_16 *)(rx->buffer + rx->offset);
@@ -109,7 +155,7 @@ void NCM_HandlePacket(unsigned char ep, short length) {
             // Try Detect broken packages
             if (header->Signature[0] == 'N' && header->Signature[1] == 'C' && header->Signature[2] == 'M' && header->Signature[3] == 'H') {
                 rx->offset = 0;
-                NCM_HandlePacket(ep, length);
+                NCM_ReceivePacket(ep, length);
                 return;
             }
         }
@@ -125,8 +171,10 @@ void NCM_HandlePacket(unsigned char ep, short length) {
                 rx->status = NCM_BUF_READY;
                 rx->offset = 0;
                 rx = rx->next;
+                NCM_BENCH_COUNT(RxNtbs, 1);
             }
         } else if (rx->offset >= rx->length) {
+            NCM_BENCH_COUNT(RxNtbs, 1);
             rx->status = NCM_BUF_READY;
             rx->offset = 0;
             rx = rx->next;
@@ -134,14 +182,14 @@ void NCM_HandlePacket(unsigned char ep, short length) {
     }
 }
 
-char *NCM_GetNextRxDatagramBuffer(short *length) {
+__RAMFUNC char *NCM_GetNextRxDatagramBuffer(short *length) {
     if (activeRxBuffer.ndp != 0 && (activeRxBuffer.datagramm == 0 || activeRxBuffer.datagramm->DatagramLength == 0 || activeRxBuffer.datagramm->DatagramOffset == 0)) {
         if (activeRxBuffer.ndp->NextNdpOffset == 0) {
             activeRxBuffer.ndp = 0;
             activeRxBuffer.datagramm = 0;
-            activeRxBuffer.buffer->status = NCM_BUF_UNUSED;
+            NCM_ReleaseRxBuffer(activeRxBuffer.buffer);
         } else {
-            activeRxBuffer.ndp = (NCM_NTB_POINTER_16 *)activeRxBuffer.buffer->buffer + activeRxBuffer.ndp->NextNdpOffset;
+            activeRxBuffer.ndp = (NCM_NTB_POINTER_16 *)(activeRxBuffer.buffer->buffer + activeRxBuffer.ndp->NextNdpOffset);
             activeRxBuffer.datagramm = (NCM_NTB_DATAPOINTER_16 *)(activeRxBuffer.ndp + 1);
         }
     }
@@ -168,6 +216,7 @@ char *NCM_GetNextRxDatagramBuffer(short *length) {
             // Broken ndp reference
             activeRxBuffer.ndp = 0;
             activeRxBuffer.datagramm = 0;
+            NCM_ReleaseRxBuffer(activeRxBuffer.buffer);
             *length = 0;
             return 0;
         }
@@ -176,6 +225,7 @@ char *NCM_GetNextRxDatagramBuffer(short *length) {
             // Broken link, skip this ndp
             activeRxBuffer.ndp = 0;
             activeRxBuffer.datagramm = 0;
+            NCM_ReleaseRxBuffer(activeRxBuffer.buffer);
 
             *length = 0;
             return 0;
@@ -191,6 +241,8 @@ char *NCM_GetNextRxDatagramBuffer(short *length) {
             return 0;
         }
 
+        NCM_BENCH_COUNT(RxDatagrams, 1);
+        activeRxBuffer.buffer->references++;
         *length = datagramm->DatagramLength;
         return activeRxBuffer.buffer->buffer + datagramm->DatagramOffset;
     } else {
@@ -199,24 +251,65 @@ char *NCM_GetNextRxDatagramBuffer(short *length) {
     }
 }
 
+void NCM_ReleaseRxDatagram(const char *datagram) {
+    for (int i = 0; i < NCM_NTB_RX_COUNT; i++) {
+        if (datagram >= rxDef[i].buffer && datagram < rxDef[i].buffer + NCM_NTB_SIZE) {
+            if (rxDef[i].references > 0) {
+                rxDef[i].references--;
+            }
+
+            if (rxDef[i].status == NCM_BUF_DRAINING) {
+                NCM_ReleaseRxBuffer(&rxDef[i]);
+            }
+            return;
+        }
+    }
+}
+
+static void NCM_ReleaseRxBuffer(NCM_BufferInfo *buffer) {
+    // All datagrams are parsed, but the buffer can only be reused once every datagram is released
+    if (buffer->references > 0) {
+        buffer->status = NCM_BUF_DRAINING;
+        return;
+    }
+
+    buffer->status = NCM_BUF_UNUSED;
+
+    if (rxPaused) {
+        // The endpoint is NAKed, so the ISR won't touch the rx state. Fetch the pending packet and continue
+        rxPaused = 0;
+        NCM_ReceivePacket(dataEp, 0);
+
+        if (!rxPaused) {
+            USB_ResumeReceive(dataEp);
+        }
+    }
+}
+
 char *NCM_GetNextTxDatagramBuffer(short length) {
     // check size constraints
-    char maxDatagrams = MIN(10, ntbInputSize.NtbInMaxDatagrams);
+    char maxDatagrams = MIN(NCM_NTB_MAX_DATAGRAMS, ntbInputSize.NtbInMaxDatagrams);
     if (maxDatagrams == 0) {
-        maxDatagrams = 10;
+        maxDatagrams = NCM_NTB_MAX_DATAGRAMS;
     }
 
-    short maxLength = ntbInputSize.NtbInMaxSize;
+    short maxLength = MIN(NCM_NTB_SIZE, ntbInputSize.NtbInMaxSize);
 
     if (activeTxBuffer.offset == 0) {
         activeTxBuffer.offset = sizeof(NCM_NTB_HEADER_16);
     }
 
-    if (activeTxBuffer.offset + length + sizeof(NCM_NTB_POINTER_16) + (activeTxBuffer.datagramCount + 2) * sizeof(NCM_NTB_DATAPOINTER_16) > maxLength ||
+    if (activeTxBuffer.offset + length + 3 + sizeof(NCM_NTB_POINTER_16) + (activeTxBuffer.datagramCount + 2) * sizeof(NCM_NTB_DATAPOINTER_16) > maxLength ||
         activeTxBuffer.datagramCount + 1 > maxDatagrams) {
         NCM_FlushTx();
     }
 
+    if (activeTxBuffer.buffer->status != NCM_BUF_UNUSED || activeTxBuffer.buffer->buffer == 0 ||
+        activeTxBuffer.offset + length + 3 + sizeof(NCM_NTB_POINTER_16) + 2 * sizeof(NCM_NTB_DATAPOINTER_16) > maxLength) {
+        // Every NTB is queued or on the wire, the NTB got no USB-SRAM, or the datagram is too large for an NTB at all
+        return 0;
+    }
+
     // Record Datagram
     activeTxBuffer.datagrams[activeTxBuffer.datagramCount].DatagramLength = length;
     activeTxBuffer.datagrams[activeTxBuffer.datagramCount].DatagramOffset = activeTxBuffer.offset;
@@ -229,16 +322,11 @@ void NCM_FlushTx() {
     if (activeTxBuffer.datagramCount > 0 && activeTxBuffer.buffer->status == NCM_BUF_UNUSED) {
         unsigned short offset = (activeTxBuffer.offset + (4 - 1)) & -4;
 
-        NCM_NTB_HEADER_16 *header = (NCM_NTB_HEADER_16 *)activeTxBuffer.buffer->buffer;
-        NCM_NTB_POINTER_16 *ndp = (NCM_NTB_POINTER_16 *)(activeTxBuffer.buffer->buffer + offset);
-
-        header->NdpOffset = offset;
-        header->HeaderLength = sizeof(NCM_NTB_HEADER_16);
-        header->Sequence = activeTxBuffer.sequence;
-        header->Signature[0] = 'N';
-        header->Signature[1] = 'C';
-        header->Signature[2] = 'M';
-        header->Signature[3] = 'H';
+        // Build header & NDP aside and copy them into the NTB, it may be located in the USB-SRAM
+        NCM_NTB_HEADER_16 header;
+        char ndpBuffer[sizeof(NCM_NTB_POINTER_16) + (NCM_NTB_MAX_DATAGRAMS + 1) * sizeof(NCM_NTB_DATAPOINTER_16)];
+        NCM_NTB_POINTER_16 *ndp = (NCM_NTB_POINTER_16 *)ndpBuffer;
+        NCM_NTB_DATAPOINTER_16 *datagrams = (NCM_NTB_DATAPOINTER_16 *)(ndp + 1);
 
         ndp->NextNdpOffset = 0;
         ndp->Length = sizeof(NCM_NTB_POINTER_16) + sizeof(NCM_NTB_DATAPOINTER_16) * (activeTxBuffer.datagramCount + 1);
@@ -247,45 +335,57 @@ void NCM_FlushTx() {
         ndp->Signature[2] = 'M';
         ndp->Signature[3] = '0';
 
-        offset += sizeof(NCM_NTB_POINTER_16);
-
         for (int i = 0; i < activeTxBuffer.datagramCount; i++) {
-            NCM_NTB_DATAPOINTER_16 *datagram = (NCM_NTB_DATAPOINTER_16 *)((char *)header + offset);
-
-            (*datagram) = activeTxBuffer.datagrams[i];
-            offset += sizeof(NCM_NTB_DATAPOINTER_16);
+            datagrams[i] = activeTxBuffer.datagrams[i];
         }
 
-        NCM_NTB_DATAPOINTER_16 *terminator = (NCM_NTB_DATAPOINTER_16 *)((char *)header + offset);
-        terminator->DatagramLength = 0;
-        terminator->DatagramOffset = 0;
-        offset += sizeof(NCM_NTB_DATAPOINTER_16);
-        header->BlockLength = offset;
-        activeTxBuffer.buffer->length = offset;
+        datagrams[activeTxBuffer.datagramCount].DatagramLength = 0;
+        datagrams[activeTxBuffer.datagramCount].DatagramOffset = 0;
+
+        header.NdpOffset = offset;
+        header.HeaderLength = sizeof(NCM_NTB_HEADER_16);
+        header.Sequence = activeTxBuffer.sequence;
+        header.BlockLength = offset + ndp->Length;
+        header.Signature[0] = 'N';
+        header.Signature[1] = 'C';
+        header.Signature[2] = 'M';
+        header.Signature[3] = 'H';
+
+        NCM_CopyToTx(activeTxBuffer.buffer->buffer, &header, sizeof(NCM_NTB_HEADER_16));
+        NCM_CopyToTx(activeTxBuffer.buffer->buffer + offset, ndpBuffer, ndp->Length);
+
+        NCM_BENCH_COUNT(TxNtbs, 1);
+        NCM_BENCH_COUNT(TxDatagrams, activeTxBuffer.datagramCount);
 
         activeTxBuffer.offset = sizeof(NCM_NTB_HEADER_16);
         activeTxBuffer.datagramCount = 0;
         activeTxBuffer.sequence++;
         activeTxBuffer.buffer->status = NCM_BUF_READY;
-        activeTxBuffer.buffer->length = header->BlockLength;
+        activeTxBuffer.buffer->length = header.BlockLength;
 
-        do {
-            activeTxBuffer.buffer = activeTxBuffer.buffer->next;
-        } while (activeTxBuffer.buffer->status == NCM_BUF_LOCKED);
+        // Continue with the next buffer. If it is still queued, the next datagram waits for it
+        activeTxBuffer.buffer = activeTxBuffer.buffer->next;
 
-        NCM_TransmitNextBuffer();
+        unsigned int primask = __get_PRIMASK();
+        __disable_irq();
+        if (!txBusy) {
+            NCM_TransmitNextBuffer();
+        }
+        __set_PRIMASK(primask);
     }
 }
 
 void NCM_BufferTransmitted(unsigned char ep, short length) {
-    NCM_TransmitNextBuffer();
-}
-
-static void NCM_TransmitNextBuffer() {
     if (tx->status == NCM_BUF_LOCKED) {
         tx->status = NCM_BUF_UNUSED;
     }
 
+    txBusy = 0;
+    NCM_TransmitNextBuffer();
+}
+
+static void NCM_TransmitNextBuffer() {
+    // NTBs are filled in ring order, so the oldest ready one follows the last one sent
     NCM_BufferInfo *temp = tx;
 
     do {
@@ -294,8 +394,9 @@ static void NCM_TransmitNextBuffer() {
 
     if (tx->status == NCM_BUF_READY) {
         tx->status = NCM_BUF_LOCKED;
+        txBusy = 1;
 
-        USB_Transmit(2, tx->buffer, tx->length);
+        USB_Transmit(dataEp, tx->buffer, tx->length);
     }
 }
 
@@ -338,7 +439,7 @@ static NCM_CtrlTxInfo *nextTransmission = {0};
 
 static void NCM_ControlTransmission() {
     if (nextTransmission != 0) {
-        USB_Transmit(1, nextTransmission->buffer, nextTransmission->length);
+        USB_Transmit(notifyEp, nextTransmission->buffer, nextTransmission->length);
         nextTransmission = nextTransmission->next;
     }
 }
@@ -350,8 +451,16 @@ void NCM_Reset(char interface, char alternateId) {
         } else if (alternateId == 0) {
             // Reset Network
             nextTransmission = 0;
+
+            // Drop all queued NTBs, the host won't read them anymore
+            for (int i = 0; i < NCM_NTB_TX_COUNT; i++) {
+                txDef[i].status = NCM_BUF_UNUSED;
+            }
+            activeTxBuffer.offset = 0;
+            activeTxBuffer.datagramCount = 0;
+            txBusy = 0;
             ntbInputSize.NtbInMaxDatagrams = 0;
-            ntbInputSize.NtbInMaxSize = 2048;
+            ntbInputSize.NtbInMaxSize = NCM_NTB_SIZE;
         }
     }
 }
@@ -1,50 +1,293 @@
 #include "ncm/ncm_netif.h"
 #include "ncm/ncm_device.h"
+#include "ncm/ncm_bench.h"
 
-#include <netif/ethernet.h>
 #include <lwip/etharp.h>
 //#include <lwip/apps/dhcp_server.h>
 
 static struct netif netif;
 static const short hwaddr[6] = {0x12, 0x54, 0xF9, 0xD9, 0x1F, 0x18};
 
+struct ncm_ethertype {
+    u16_t type; // network byte order, to compare against the frame directly
+    ncm_netif_ethertype_fn handler;
+};
+
+static struct ncm_ethertype ethertypes[NCM_NETIF_MAX_ETHERTYPES];
+static u8_t ethertype_count = 0;
+
+struct ncm_udp_port {
+    u16_t port; // network byte order
+    ncm_netif_udp_fn handler;
+};
+
+static struct ncm_udp_port udp_ports[NCM_NETIF_MAX_UDP_PORTS];
+static u8_t udp_port_count = 0;
+
+#if NCM_RX_ZEROCOPY
+// A pbuf referencing a datagram inside the NTB, the NTB is released once lwIP frees it
+struct ncm_rx_pbuf {
+    struct pbuf_custom p;
+    char *datagram;
+};
+
+static struct ncm_rx_pbuf rx_pbufs[NET_RX_PBUFS];
+
+static void ncm_netif_free_rx(struct pbuf *p) {
+    struct ncm_rx_pbuf *rx_pbuf = (struct ncm_rx_pbuf *)p;
+
+    NCM_ReleaseRxDatagram(rx_pbuf->datagram);
+    rx_pbuf->datagram = 0;
+}
+
+static struct ncm_rx_pbuf *ncm_netif_get_rx_pbuf() {
+    for (int i = 0; i < NET_RX_PBUFS; i++) {
+        if (rx_pbufs[i].datagram == 0) {
+            return &rx_pbufs[i];
+        }
+    }
+
+    return NULL;
+}
+#endif
+
 static err_t ncm_netif_output(struct netif *netif, struct pbuf *p) {
     struct pbuf *q;
     short offset = 0;
     char *buffer = NCM_GetNextTxDatagramBuffer(p->tot_len);
 
+    if(buffer == 0) {
+        return ERR_MEM;
+    }
+
+    NCM_BENCH_BEGIN(start);
     for(q = p; q != NULL; q = q->next) {
-        memcpy(buffer + offset, q->payload, q->len);
+        NCM_CopyToTx(buffer + offset, q->payload, q->len);
         offset += q->len;
 
         if(q->len == q->tot_len) {
             break;
         }
     }
+    NCM_BENCH_END(start, CopyCycles);
+    NCM_BENCH_COUNT(CopyBytes, offset);
+
+    return ERR_OK;
+}
+
+err_t ncm_netif_register_ethertype(u16_t type, ncm_netif_ethertype_fn handler) {
+    u16_t netType = lwip_htons(type);
+
+    for(int i = 0; i < ethertype_count; i++) {
+        if(ethertypes[i].type == netType) {
+            if(handler != 0) {
+                ethertypes[i].handler = handler;
+            } else {
+                ethertypes[i] = ethertypes[--ethertype_count];
+            }
+            return ERR_OK;
+        }
+    }
+
+    if(handler == 0) {
+        return ERR_OK;
+    }
+
+    if(ethertype_count >= NCM_NETIF_MAX_ETHERTYPES) {
+        return ERR_MEM;
+    }
+
+    ethertypes[ethertype_count].type = netType;
+    ethertypes[ethertype_count].handler = handler;
+    ethertype_count++;
+
+    return ERR_OK;
+}
+
+err_t ncm_netif_register_udp(u16_t port, ncm_netif_udp_fn handler) {
+    u16_t netPort = lwip_htons(port);
+
+    for(int i = 0; i < udp_port_count; i++) {
+        if(udp_ports[i].port == netPort) {
+            if(handler != 0) {
+                udp_ports[i].handler = handler;
+            } else {
+                udp_ports[i] = udp_ports[--udp_port_count];
+            }
+            return ERR_OK;
+        }
+    }
+
+    if(handler == 0) {
+        return ERR_OK;
+    }
+
+    if(udp_port_count >= NCM_NETIF_MAX_UDP_PORTS) {
+        return ERR_MEM;
+    }
+
+    udp_ports[udp_port_count].port = netPort;
+    udp_ports[udp_port_count].handler = handler;
+    udp_port_count++;
+
+    return ERR_OK;
+}
+
+void ncm_netif_raw_header(struct eth_hdr *header, const struct eth_addr *dest, u16_t type) {
+    for(int i = 0; i < ETHARP_HWADDR_LEN; i++) {
+        header->dest.addr[i] = dest->addr[i];
+        header->src.addr[i] = hwaddr[i];
+    }
+
+    header->type = lwip_htons(type);
+}
+
+err_t ncm_netif_send_raw(const struct eth_hdr *header, const void *payload, short length, char flush) {
+    char *buffer = NCM_GetNextTxDatagramBuffer(SIZEOF_ETH_HDR + length);
+
+    if(buffer == 0) {
+        return ERR_MEM;
+    }
+
+    NCM_CopyToTx(buffer, header, SIZEOF_ETH_HDR);
+    NCM_CopyToTx(buffer + SIZEOF_ETH_HDR, payload, length);
+
+    if(flush) {
+        NCM_FlushTx();
+    }
+
+    return ERR_OK;
+}
+
+static u8_t ncm_netif_input_udp(const char *frame, short length) {
+    // Only look as deep into the IPv4 header as needed to find the port
+    const u8_t *ip = (const u8_t *)frame;
+    short ipLength = (ip[0] & 0x0F) * 4;
+
+    if((ip[0] >> 4) != 4 || ipLength < 20 || length < ipLength + 8 || ip[9] != 17) {
+        return 0;
+    }
+
+    // Fragments (MF set or an offset) go through the reassembly in lwIP
+    if(((ip[6] << 8 | ip[7]) & 0x3FFF) != 0) {
+        return 0;
+    }
+
+    short totalLength = ip[2] << 8 | ip[3];
+    if(totalLength > length || totalLength < ipLength + 8) {
+        return 0;
+    }
+
+    // Only datagrams lwIP would accept as well: to our address, broadcast or multicast (sACN). Frames for other hosts
+    // on the link are left to lwIP, which drops them
+    ip4_addr_t dest;
+    memcpy(&dest.addr, ip + 16, sizeof(dest.addr));
+
+    if(!ip4_addr_ismulticast(&dest) && !ip4_addr_isbroadcast(&dest, &netif) &&
+       (ip4_addr_isany_val(*netif_ip4_addr(&netif)) || ip4_addr_get_u32(&dest) != ip4_addr_get_u32(netif_ip4_addr(&netif)))) {
+        return 0;
+    }
+
+    const u8_t *udp = ip + ipLength;
+    u16_t port;
+    short udpLength = udp[4] << 8 | udp[5];
+
+    if(udpLength < 8 || udpLength > totalLength - ipLength) {
+        return 0;
+    }
+
+    memcpy(&port, udp + 2, sizeof(port));
+
+    for(int i = 0; i < udp_port_count; i++) {
+        if(udp_ports[i].port == port) {
+            ip4_addr_t src;
+            memcpy(&src.addr, ip + 12, sizeof(src.addr));
+
+            return udp_ports[i].handler(&src, (const char *)udp + 8, udpLength - 8);
+        }
+    }
+
+    return 0;
+}
+
+static u8_t ncm_netif_input_raw(char *datagram, short length) {
+    // Registered EtherTypes and UDP ports are handled in place and never reach lwIP
+    if((ethertype_count == 0 && udp_port_count == 0) || length < SIZEOF_ETH_HDR) {
+        return 0;
+    }
+
+    const struct eth_hdr *header = (const struct eth_hdr *)datagram;
+
+    for(int i = 0; i < ethertype_count; i++) {
+        if(ethertypes[i].type == header->type) {
+            ethertypes[i].handler(header, datagram + SIZEOF_ETH_HDR, length - SIZEOF_ETH_HDR);
+            NCM_ReleaseRxDatagram(datagram);
+            return 1;
+        }
+    }
+
+    if(udp_port_count > 0 && header->type == PP_HTONS(ETHTYPE_IP) &&
+       ncm_netif_input_udp(datagram + SIZEOF_ETH_HDR, length - SIZEOF_ETH_HDR)) {
+        NCM_ReleaseRxDatagram(datagram);
+        return 1;
+    }
+
+    return 0;
 }
 
 void ncm_netif_poll(struct netif *netif) {
     short length = 0;
-    short offset = 0;
     char *datagram;
-    struct pbuf *p, *q;
+    struct pbuf *p;
+
+#if NCM_RX_ZEROCOPY
+    struct ncm_rx_pbuf *rx_pbuf = ncm_netif_get_rx_pbuf();
+
+    if(rx_pbuf == NULL) {
+        // Every datagram is still held by lwIP, leave the rest in the NTB
+        return;
+    }
+
+    datagram = NCM_GetNextRxDatagramBuffer(&length);
+
+    if(datagram != 0 && length > 0 && !ncm_netif_input_raw(datagram, length)) {
+        rx_pbuf->datagram = datagram;
+        rx_pbuf->p.custom_free_function = ncm_netif_free_rx;
+        p = pbuf_alloced_custom(PBUF_RAW, length, PBUF_REF, &rx_pbuf->p, datagram, length);
+
+        if(netif->input(p, netif) != ERR_OK) {
+            pbuf_free(p);
+        }
+    }
+#else
+    short offset = 0;
+    struct pbuf *q;
 
     datagram = NCM_GetNextRxDatagramBuffer(&length);
 
-    if(datagram != 0 && length > 0) {
+    if(datagram != 0 && length > 0 && !ncm_netif_input_raw(datagram, length)) {
         p = pbuf_alloc(PBUF_RAW, length, PBUF_POOL);
 
         if(p != NULL) {
+            NCM_BENCH_BEGIN(start);
             for(q = p; q != NULL && offset < length; q = q->next) {
                 memcpy(q->payload, datagram + offset, q->len);
                 offset += q->len;
             }
+            NCM_BENCH_END(start, CopyCycles);
+            NCM_BENCH_COUNT(CopyBytes, length);
 
             if(netif->input(p, netif) != ERR_OK) {
                 pbuf_free(p);
             }
+        } else {
+            NCM_BENCH_COUNT(RxDrops, 1);
         }
+
+        // The datagram was copied or dropped, the NTB can be reused
+        NCM_ReleaseRxDatagram(datagram);
     }
+#endif
 }
 
 err_t ncm_netif_init(struct netif *netif) {
@@ -60,7 +303,7 @@ err_t ncm_netif_init(struct netif *netif) {
     netif->name[0] = 'e';
     netif->name[0] = '0';
 
-    netif->mtu = 1500;
+    netif->mtu = NET_MTU;
 
     netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP;
 
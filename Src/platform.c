@@ -2,8 +2,23 @@
 
 static volatile uint32_t globalTime_ms = 0;
 
+// TIM2 runs at the timer clock, which is not a whole number of MHz on every MCU (71.875 MHz on the stm32g4).
+// It is extended to 64 bit by counting the wraps and scaled by fixed point factors
+static volatile uint32_t timebaseHigh = 0;
+static volatile uint32_t timebaseLast = 0;
+static uint32_t usPerWrap = 0;         // Microseconds per 2^32 ticks
+static uint32_t usPerWrapFraction = 0; // and its fraction in 1/2^32, so the clock does not drift over time
+static uint32_t ticksPerUs = 0;        // Ticks per microsecond, 16.16 fixed point
+
 void SysTick_Handler() {
     globalTime_ms++;
+
+    // Wraps at the earliest after ~60s, so checking every millisecond catches all of them
+    uint32_t ticks = TIM2->CNT;
+    if (ticks < timebaseLast) {
+        timebaseHigh++;
+    }
+    timebaseLast = ticks;
 }
 
 unsigned int sys_jiffies() {
@@ -21,25 +36,207 @@ void delay_ms(unsigned int ms) {
     }
 }
 
-void *memcpy(void *destination, const void *source, size_t num) {
-    if ((uintptr_t)destination % sizeof(long) == 0 &&
-        (uintptr_t)source % sizeof(long) == 0 &&
-        num % sizeof(long) == 0) {
+// Words that may alias any other type, the unaligned variant is only used where the core supports unaligned LDR / STR (Cortex-M3 and up)
+typedef uint32_t __attribute__((may_alias)) Word;
+typedef uint32_t __attribute__((may_alias, aligned(1))) UnalignedWord;
 
-        long *lsrc = (long *)source;
-        long *ldst = (long *)destination;
+// Keep GCC from turning the loops below into calls to memcpy / memset themselves
+__RAMFUNC __attribute__((optimize("no-tree-loop-distribute-patterns"))) void *memcpy(void *destination, const void *source, size_t num) {
+    uint8_t *dst = destination;
+    const uint8_t *src = source;
 
-        for (int i = 0; i < num / sizeof(long); i++) {
-            ldst[i] = lsrc[i];
+    if (num >= 8) {
+        // Align the destination, the source may stay misaligned
+        while ((uintptr_t)dst & 3) {
+            *dst++ = *src++;
+            num--;
         }
-    } else {
-        char *csrc = (char *)source;
-        char *cdst = (char *)destination;
 
-        for (int i = 0; i < num; i++) {
-            cdst[i] = csrc[i];
+        Word *wdst = (Word *)dst;
+
+        if (((uintptr_t)src & 3) == 0) {
+            // Four words per round, compiled to LDM / STM
+            const Word *wsrc = (const Word *)src;
+
+            for (; num >= 16; num -= 16) {
+                uint32_t a = wsrc[0], b = wsrc[1], c = wsrc[2], d = wsrc[3];
+                wdst[0] = a;
+                wdst[1] = b;
+                wdst[2] = c;
+                wdst[3] = d;
+                wsrc += 4;
+                wdst += 4;
+            }
+
+            for (; num >= 4; num -= 4) {
+                *wdst++ = *wsrc++;
+            }
+
+            src = (const uint8_t *)wsrc;
+        } else {
+#if (__CORTEX_M >= 3)
+            // Unaligned LDR costs one extra cycle, still far less than four byte accesses
+            const UnalignedWord *wsrc = (const UnalignedWord *)src;
+
+            for (; num >= 16; num -= 16) {
+                uint32_t a = wsrc[0], b = wsrc[1], c = wsrc[2], d = wsrc[3];
+                wdst[0] = a;
+                wdst[1] = b;
+                wdst[2] = c;
+                wdst[3] = d;
+                wsrc += 4;
+                wdst += 4;
+            }
+
+            for (; num >= 4; num -= 4) {
+                *wdst++ = *wsrc++;
+            }
+
+            src = (const uint8_t *)wsrc;
+#else
+            // The Cortex-M0 faults on unaligned words, so read aligned ones and merge them.
+            // The last word read holds the last byte needed, nothing beyond the source is touched
+            unsigned int shift = ((uintptr_t)src & 3) * 8;
+            const Word *wsrc = (const Word *)((uintptr_t)src & ~3);
+            uint32_t previous = *wsrc++;
+
+            for (; num >= 4; num -= 4) {
+                uint32_t next = *wsrc++;
+                *wdst++ = (previous >> shift) | (next << (32 - shift));
+                previous = next;
+            }
+
+            src = (const uint8_t *)wsrc - 4 + shift / 8;
+#endif
+        }
+
+        dst = (uint8_t *)wdst;
+    }
+
+    while (num--) {
+        *dst++ = *src++;
+    }
+
+    return destination;
+}
+
+__attribute__((optimize("no-tree-loop-distribute-patterns"))) void *memset(void *ptr, int value, size_t num) {
+    uint8_t *dst = ptr;
+
+    if (num >= 8) {
+        while ((uintptr_t)dst & 3) {
+            *dst++ = value;
+            num--;
+        }
+
+        uint32_t word = (uint8_t)value * 0x01010101u;
+        Word *wdst = (Word *)dst;
+
+        for (; num >= 16; num -= 16) {
+            wdst[0] = word;
+            wdst[1] = word;
+            wdst[2] = word;
+            wdst[3] = word;
+            wdst += 4;
         }
+
+        for (; num >= 4; num -= 4) {
+            *wdst++ = word;
+        }
+
+        dst = (uint8_t *)wdst;
     }
+
+    while (num--) {
+        *dst++ = value;
+    }
+
+    return ptr;
+}
+
+void Timebase_Init() {
+#if defined(STM32G441xx) || defined(STM32G474xx)
+    RCC->APB1ENR1 |= RCC_APB1ENR1_TIM2EN;
+    uint32_t presc = APBPrescTable[(RCC->CFGR & RCC_CFGR_PPRE1_Msk) >> RCC_CFGR_PPRE1_Pos];
+#elif defined(STM32F042x6)
+    RCC->APB1ENR |= RCC_APB1ENR_TIM2EN;
+    uint32_t ppre = (RCC->CFGR & RCC_CFGR_PPRE) >> 8;
+    uint32_t presc = (ppre & 0x04) ? (ppre & 0x03) + 1 : 0;
+#endif
+
+    // The timers run at twice the APB clock if it is divided
+    uint32_t clock = (SystemCoreClock >> presc) * (presc > 0 ? 2 : 1);
+
+    usPerWrap = ((uint64_t)1000000 << 32) / clock;
+    usPerWrapFraction = ((((uint64_t)1000000 << 32) % clock) << 32) / clock;
+    ticksPerUs = ((uint64_t)clock << 16) / 1000000;
+
+    TIM2->CR1 = 0;
+    TIM2->PSC = 0;
+    TIM2->ARR = 0xFFFFFFFF;
+    TIM2->EGR = TIM_EGR_UG;
+    TIM2->SR = 0;
+    timebaseHigh = 0;
+    timebaseLast = 0;
+    TIM2->CR1 = TIM_CR1_CEN;
+}
+
+unsigned int Timebase_Ticks() {
+    return TIM2->CNT;
+}
+
+unsigned int Timebase_UsToTicks(unsigned int us) {
+    return ((uint64_t)us * ticksPerUs) >> 16;
+}
+
+unsigned int sys_now_us() {
+    uint32_t high, last, ticks;
+
+    do {
+        high = timebaseHigh;
+        last = timebaseLast;
+        ticks = TIM2->CNT;
+    } while (high != timebaseHigh);
+
+    // Wrapped since the last SysTick
+    if (ticks < last) {
+        high++;
+    }
+
+    // (high * 2^32 + ticks) * usPerWrap / 2^32, only the lower 32 bit of the result are kept
+    return high * usPerWrap + (uint32_t)(((uint64_t)high * usPerWrapFraction) >> 32) + (uint32_t)(((uint64_t)ticks * usPerWrap) >> 32);
+}
+
+void delay_us(unsigned int us) {
+    uint32_t start = TIM2->CNT;
+    uint32_t ticks = Timebase_UsToTicks(us);
+
+    while (TIM2->CNT - start < ticks) {
+    }
+}
+
+void Cycles_Init() {
+#if (__CORTEX_M >= 3)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+unsigned int sys_cycles() {
+#if (__CORTEX_M >= 3)
+    return DWT->CYCCNT;
+#else
+    // The Cortex-M0 has no cycle counter, so combine the millisecond tick with the SysTick down counter
+    uint32_t ms, val;
+    do {
+        ms = globalTime_ms;
+        val = SysTick->VAL;
+    } while (ms != globalTime_ms);
+
+    uint32_t div = (SysTick->CTRL & SysTick_CTRL_CLKSOURCE_Msk) ? 1 : 8;
+    return ms * (SystemCoreClock / 1000) + (SysTick->LOAD - val) * div;
+#endif
 }
 
 void Systick_Init() {
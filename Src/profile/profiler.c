@@ -0,0 +1,155 @@
+#include "profile/profiler.h"
+
+#define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
+#define PROFILER_PROBES 8
+
+#if (PROFILER_SLOTS & (PROFILER_SLOTS - 1)) != 0
+#error "PROFILER_SLOTS has to be a power of two"
+#endif
+
+#if defined(STM32G441xx) || defined(STM32G474xx)
+#define PROFILER_TIM TIM6
+#define PROFILER_IRQ TIM6_DAC_IRQn
+#define PROFILER_HANDLER TIM6_DAC_IRQHandler
+#elif defined(STM32F042x6)
+#define PROFILER_TIM TIM14
+#define PROFILER_IRQ TIM14_IRQn
+#define PROFILER_HANDLER TIM14_IRQHandler
+#endif
+
+static PROFILER_SLOT slots[PROFILER_SLOTS];
+static PROFILER_INFO info;
+static volatile char running = 0;
+
+void PROFILER_Sample(const unsigned int *frame);
+
+// Hand the stacked exception frame (r0-r3, r12, lr, pc, xpsr) to PROFILER_Sample. Thumb-1 only, so it runs on the Cortex-M0 as well
+__attribute__((naked)) void PROFILER_HANDLER() {
+    __asm volatile(
+        "movs r0, #4        \n"
+        "mov r1, lr         \n"
+        "tst r0, r1         \n"
+        "beq 1f             \n"
+        "mrs r0, psp        \n"
+        "b 2f               \n"
+        "1: mrs r0, msp     \n"
+        "2: ldr r2, =PROFILER_Sample \n"
+        "bx r2              \n"
+        ".ltorg             \n");
+}
+
+void PROFILER_Sample(const unsigned int *frame) {
+    PROFILER_TIM->SR = ~TIM_SR_UIF;
+
+    unsigned int pc = frame[6];
+    unsigned int lr = frame[5];
+    unsigned int hash = ((pc >> 1) ^ (lr >> 1) * 31) & (PROFILER_SLOTS - 1);
+
+    info.Samples++;
+
+    // Open addressing with a short probe, a full neighbourhood loses the sample instead of spending time searching
+    for (int i = 0; i < PROFILER_PROBES; i++) {
+        PROFILER_SLOT *slot = &slots[(hash + i) & (PROFILER_SLOTS - 1)];
+
+        if (slot->Count == 0) {
+            slot->Pc = pc;
+            slot->Lr = lr;
+            slot->Count = 1;
+            return;
+        }
+
+        if (slot->Pc == pc && slot->Lr == lr) {
+            slot->Count++;
+            return;
+        }
+    }
+
+    info.Lost++;
+}
+
+void PROFILER_Init() {
+#if defined(STM32G441xx) || defined(STM32G474xx)
+    RCC->APB1ENR1 |= RCC_APB1ENR1_TIM6EN;
+    unsigned int presc = APBPrescTable[(RCC->CFGR & RCC_CFGR_PPRE1_Msk) >> RCC_CFGR_PPRE1_Pos];
+#elif defined(STM32F042x6)
+    RCC->APB1ENR |= RCC_APB1ENR_TIM14EN;
+    unsigned int ppre = (RCC->CFGR & RCC_CFGR_PPRE) >> 8;
+    unsigned int presc = (ppre & 0x04) ? (ppre & 0x03) + 1 : 0; // No APBPrescTable in the stm32f0xx headers
+#endif
+
+    // The timers run at twice the APB clock if it is divided
+    unsigned int clock = (SystemCoreClock >> presc) * (presc > 0 ? 2 : 1);
+
+    PROFILER_TIM->CR1 = 0;
+    PROFILER_TIM->PSC = 0;
+    PROFILER_TIM->ARR = clock / PROFILER_RATE - 1;
+    PROFILER_TIM->EGR = TIM_EGR_UG;
+    PROFILER_TIM->SR = 0;
+    PROFILER_TIM->DIER = TIM_DIER_UIE;
+
+    NVIC_SetPriority(PROFILER_IRQ, 0);
+    NVIC_EnableIRQ(PROFILER_IRQ);
+
+    PROFILER_Enable(1);
+}
+
+void PROFILER_Enable(char enable) {
+    running = enable;
+
+    if (enable) {
+        PROFILER_TIM->CR1 |= TIM_CR1_CEN;
+    } else {
+        PROFILER_TIM->CR1 &= ~TIM_CR1_CEN;
+    }
+}
+
+void PROFILER_Clear() {
+    unsigned int primask = __get_PRIMASK();
+    __disable_irq();
+
+    for (int i = 0; i < PROFILER_SLOTS; i++) {
+        slots[i].Count = 0;
+    }
+    info.Samples = 0;
+    info.Lost = 0;
+
+    __set_PRIMASK(primask);
+}
+
+char PROFILER_SetupPacket(USB_SETUP_PACKET *setup) {
+    if ((setup->RequestType & 0x80) == 0) {
+        switch (setup->Value) {
+        case PROFILER_STOP:
+            PROFILER_Enable(0);
+            return USB_OK;
+        case PROFILER_START:
+            PROFILER_Enable(1);
+            return USB_OK;
+        case PROFILER_CLEAR:
+            PROFILER_Clear();
+            return USB_OK;
+        }
+
+        return USB_ERR;
+    }
+
+    if (setup->Value == PROFILER_INFO_INDEX) {
+        info.Slots = PROFILER_SLOTS;
+        info.Rate = PROFILER_RATE;
+        info.CoreClock = SystemCoreClock;
+        info.Running = running;
+
+        USB_Transmit(0, (const unsigned char *)&info, MIN(sizeof(info), setup->Length));
+        return USB_OK;
+    }
+
+    if (setup->Value >= PROFILER_SLOTS) {
+        return USB_ERR;
+    }
+
+    // Only the contiguous part, the host stops the sampling while reading and asks again for the rest
+    unsigned short length = (PROFILER_SLOTS - setup->Value) * sizeof(PROFILER_SLOT);
+
+    USB_Transmit(0, (const unsigned char *)&slots[setup->Value], MIN(length, setup->Length));
+    return USB_OK;
+}
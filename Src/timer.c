@@ -0,0 +1,99 @@
+#include "timer.h"
+
+// Same priority as the USB interrupts, so callbacks may use the USB stack without further locking
+#if defined(STM32G441xx) || defined(STM32G474xx)
+#define TIMER_PRIORITY 8
+#elif defined(STM32F042x6)
+#define TIMER_PRIORITY 1
+#endif
+
+// Running timers sorted by their due time, the first one is armed on TIM2 compare channel 1
+static TIMER *timers = 0;
+
+static void TIMER_Insert(TIMER *timer) {
+    TIMER **link = &timers;
+
+    while (*link != 0 && (int)((*link)->Due - timer->Due) <= 0) {
+        link = &(*link)->Next;
+    }
+
+    timer->Next = *link;
+    *link = timer;
+}
+
+static void TIMER_Remove(TIMER *timer) {
+    for (TIMER **link = &timers; *link != 0; link = &(*link)->Next) {
+        if (*link == timer) {
+            *link = timer->Next;
+            timer->Next = 0;
+            return;
+        }
+    }
+}
+
+static void TIMER_Arm() {
+    if (timers == 0) {
+        TIM2->DIER &= ~TIM_DIER_CC1IE;
+        return;
+    }
+
+    TIM2->CCR1 = timers->Due;
+    TIM2->SR = ~TIM_SR_CC1IF;
+    TIM2->DIER |= TIM_DIER_CC1IE;
+
+    // The compare only matches on equality, a due time that already passed would wait for the counter to wrap
+    if ((int)(TIM2->CNT - timers->Due) >= 0) {
+        NVIC_SetPendingIRQ(TIM2_IRQn);
+    }
+}
+
+void TIM2_IRQHandler() {
+    TIM2->SR = ~TIM_SR_CC1IF;
+
+    while (timers != 0 && (int)(TIM2->CNT - timers->Due) >= 0) {
+        TIMER *timer = timers;
+        timers = timer->Next;
+        timer->Next = 0;
+
+        // Periodic timers keep their phase instead of drifting by the interrupt latency
+        if (timer->Period > 0) {
+            timer->Due += timer->Period;
+            TIMER_Insert(timer);
+        }
+
+        timer->Callback(timer->Arg);
+    }
+
+    TIMER_Arm();
+}
+
+void TIMER_Start(TIMER *timer, unsigned int delay, unsigned int period, void (*callback)(void *arg), void *arg) {
+    unsigned int primask = __get_PRIMASK();
+    __disable_irq();
+
+    TIMER_Remove(timer);
+
+    timer->Callback = callback;
+    timer->Arg = arg;
+    timer->Period = Timebase_UsToTicks(period);
+    timer->Due = Timebase_Ticks() + Timebase_UsToTicks(delay);
+    TIMER_Insert(timer);
+
+    if (!NVIC_GetEnableIRQ(TIM2_IRQn)) {
+        NVIC_SetPriority(TIM2_IRQn, TIMER_PRIORITY);
+        NVIC_EnableIRQ(TIM2_IRQn);
+    }
+
+    TIMER_Arm();
+    __set_PRIMASK(primask);
+}
+
+void TIMER_Stop(TIMER *timer) {
+    unsigned int primask = __get_PRIMASK();
+    __disable_irq();
+
+    TIMER_Remove(timer);
+    TIMER_Arm();
+
+    __set_PRIMASK(primask);
+}
@@ -1,12 +1,34 @@
 #include "usb.h"
+#include "boot.h"
+#include "log/log.h"
+#include "usb_trace.h"
+#ifdef PROFILER
+#include "profile/profiler.h"
+#endif
 #include "platform.h"
+#include "timer.h"
 
 #define __USB_MEM __attribute__((section(".usbbuf")))
 #define __USBBUF_BEGIN 0x40006000
+#define __USBBUF_SIZE 1024
+#define __IS_USBMEM(X) ((unsigned int)(X) >= __USBBUF_BEGIN && (unsigned int)(X) < __USBBUF_BEGIN + __USBBUF_SIZE)
 #define __MEM2USB(X) (((int)X - __USBBUF_BEGIN))
 #define __USB2MEM(X) (((int)X + __USBBUF_BEGIN))
 #define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
 
+#define USB_AWAKE 0
+#define USB_SLEEP_L1 1
+#define USB_SUSPENDED 2
+#define USB_RESUME_IDLE 2000 // us after SUSP until a remote wakeup may signal resume (5ms idle bus)
+
+#ifdef USB_STATS
+#define USB_STAT(X) X
+#define USB_CNTR_STATS (USB_CNTR_ERRM | USB_CNTR_PMAOVRM | USB_CNTR_ESOFM)
+#else
+#define USB_STAT(X)
+#define USB_CNTR_STATS 0
+#endif
+
 #ifdef USB_TXTIMEOUT
 extern unsigned int sys_now();
 #endif
@@ -44,7 +66,7 @@ typedef struct {
 
 typedef struct {
     volatile unsigned char *Buffer;
-    char Size;
+    unsigned short Size;
     void (*CompleteCallback)(unsigned char ep, short length);
 } USB_BufferConfig;
 
@@ -63,9 +85,46 @@ static USB_TRANSFER_STATE Transfers[7] = {0};
 static char ActiveConfiguration = 0x00;
 static char DeviceState = 0x00; // 0 - Default, 1 - Address, 2 - Configured
 static char EndpointState[USB_NumEndpoints] = {0};
+static volatile char ReceivePaused[USB_NumEndpoints] = {0}; // Leave the endpoint in RX_NAK after the next packet
+static unsigned short AllocatedSRAM = 0;                      // Bytes handed out from the end of the USB-SRAM
+static unsigned short EndpointSRAM = 0;                       // BTable & endpoint buffers of the implementation from the start, 0 before USB_Init
+static char RemoteWakeupEnabled = 0;                          // SET_FEATURE(DEVICE_REMOTE_WAKEUP) by the host
+static char L1RemoteWake = 0;                                 // bRemoteWake of the last acknowledged LPM token
+static volatile char SleepState = USB_AWAKE;
+static unsigned int SuspendTime = 0;                          // sys_now_us() of the last SUSP interrupt
+static TIMER ResumeTimer;
+static unsigned char ControlHandle = 0;                       // Counts the SETUP packets, identifies a deferred request
+static char ControlDeferred = 0;                              // The class replies later with USB_CompleteControl
+static TIMER ControlTimer;
+static char SofEnabled = 0;                                   // Keep the SOF interrupt on for the Sof_Handler
+
+#pragma pack(1)
+// LPM with BESL, so the host may use L1 sleep instead of a full suspend. The clocks keep running in L1, the
+// recommended baseline BESL is 400us (4) and the deep one 1ms (6)
+static const struct {
+    USB_DESCRIPTOR_BOS Header;
+    USB_DESC_CAP_USB20 Usb20;
+} BosDescriptor = {
+    .Header = {
+        .Length = 5,
+        .Type = 0x0F,
+        .TotalLength = 12,
+        .Capabilities = 1},
+    .Usb20 = {
+        .Length = 7,
+        .Type = 0x10,
+        .CapabilityType = 0x02,
+        .Attributes = (1 << 1) | (1 << 2) | (1 << 3) | (1 << 4) | (4 << 8) | (6 << 12)}};
+#pragma pack()
 
 static unsigned char ControlDataBuffer[USB_MaxControlData] = {0};
 static USB_Implementation implementation = {0};
+static USB_STATISTICS Statistics = {0};
+#ifdef USB_STATS
+static USB_STATISTICS StatisticsSnapshot;
+static char WakeMeasuring = 0;
+static unsigned int WakeStart = 0;
+#endif
 
 /// @brief Copy data from / to USB-SRAM
 static void USB_CopyMemory(const volatile unsigned char *source, volatile unsigned char *target, short length);
@@ -80,6 +139,28 @@ static void USB_SetEP(volatile unsigned short *ep, short value, short mask);
 static void USB_HandleControl();
 /// @brief Called to handle Setup-Packets on EP0
 static void USB_HandleSetup(USB_SETUP_PACKET *setup);
+/// @brief Called to handle the vendor requests reserved for the USB core
+static void USB_HandleDiagnostics(USB_SETUP_PACKET *setup);
+/// @brief Account the cycles spent since start
+static void USB_CountCycles(unsigned int *calls, unsigned int *cycles, unsigned int *maxCycles, unsigned int start);
+/// @brief Start timing a resume until the first SOF
+static void USB_StartWakeMeasure();
+/// @brief Begin the resume signaling of a remote wakeup from suspend
+static void USB_StartResume(void *arg);
+/// @brief End the resume signaling of a remote wakeup from suspend
+static void USB_EndResume(void *arg);
+/// @brief Stall a deferred control request the class did not complete in time
+static void USB_ControlTimeout(void *arg);
+/// @brief Handle a transaction of an isochronous endpoint
+static void USB_HandleIso(unsigned char ep);
+/// @brief Get the half of an isochronous double buffer that belongs to the application
+/// @param ep The endpoint id
+/// @param dtog USB_EP_DTOG_RX for OUT, USB_EP_DTOG_TX for IN endpoints
+/// @param count Receives the count register of this half
+/// @return The index of the half in Buffers
+static unsigned char USB_GetIsoBuffer(unsigned char ep, unsigned short dtog, volatile unsigned short **count);
+/// @brief Encode the size of a reception buffer for a COUNT_RX register
+static unsigned short USB_EncodeRxSize(unsigned short size);
 /// @brief Prepare a transfer on an endpoint
 /// @param transfer A pointer to the transfer metadata
 /// @param ep The endpoint to send from
@@ -87,14 +168,23 @@ static void USB_HandleSetup(USB_SETUP_PACKET *setup);
 /// @param txBufferCount The Register that should contain the number of bytes to send
 /// @param txBufferSize The size of the TX-Buffer
 static void USB_PrepareTransfer(USB_TRANSFER_STATE *transfer, volatile unsigned short *ep, volatile unsigned char *txBuffer, volatile unsigned short *txBufferCount, const unsigned short txBufferSize);
+/// @brief Select the TX-Buffer for the next chunk of a transfer on an endpoint
+/// @param ep The endpoint id
+/// @return The endpoint buffer, or the data itself if the transfer already lives in the USB-SRAM
+static volatile unsigned char *USB_GetTxBuffer(unsigned char ep);
+/// @brief Round the buffer sizes of an endpoint to what the hardware can count
+static void USB_GetBufferSizes(const USB_CONFIG_EP *config, unsigned short *rxSize, unsigned short *txSize);
+/// @brief Get the USB-SRAM the BTable and the buffers of all endpoints of the implementation take from the start
+static unsigned short USB_GetEndpointSRAM();
 
 void delay_ms(unsigned int ms);
 
 void USB_Init(USB_Implementation impl) {
     implementation = impl;
+    EndpointSRAM = USB_GetEndpointSRAM();
 
     // Initialize the NVIC
-#ifdef STM32G441xx
+#if defined(STM32G441xx) || defined(STM32G474xx)
     NVIC_SetPriority(USB_LP_IRQn, 8);
     NVIC_EnableIRQ(USB_LP_IRQn);
     NVIC_SetPriority(USB_HP_IRQn, 8);
@@ -110,11 +200,18 @@ void USB_Init(USB_Implementation impl) {
     USB->CNTR &= ~USB_CNTR_PDWN;
 
     // Wait 1μs until clock is stable
-    delay_ms(1);
+    delay_us(1);
+
+    // Clear SRAM for readability, only once, a bus reset has to be answered quickly
+    USB_ClearSRAM();
+
+    // Acknowledge LPM tokens, the L1 request is handled like a short suspend
+    USB->LPMCSR = USB_LPMCSR_LMPEN | USB_LPMCSR_LPMACK;
 
     // Enable all interrupts & the internal pullup to put 1.5K on D+ for FullSpeed USB
-    USB->CNTR |= USB_CNTR_RESETM | USB_CNTR_CTRM | USB_CNTR_WKUPM | USB_CNTR_SUSPM;
+    USB->CNTR |= USB_CNTR_RESETM | USB_CNTR_CTRM | USB_CNTR_WKUPM | USB_CNTR_SUSPM | USB_CNTR_L1REQM | USB_CNTR_STATS;
     USB->BCDR |= USB_BCDR_DPPU;
+    BOOT_Mark(BOOT_PULLUP);
 
     // Clear the USB Reset (D+ & D- low) to start enumeration
     USB->CNTR &= ~USB_CNTR_FRES;
@@ -127,32 +224,71 @@ void USB_IRQHandler(void)
 }
 #endif
 
-void USB_HP_IRQHandler() {
+__RAMFUNC void USB_HP_IRQHandler() {
     // Only take care of regular transmissions
     if ((USB->ISTR & USB_ISTR_CTR) != 0) {
         unsigned char ep = USB->ISTR & USB_ISTR_EP_ID;
 
         if (ep > 0 && ep < 8) {
+#ifdef USB_STATS
+            USB_EP_STATISTICS *stats = &Statistics.Endpoints[ep];
+            unsigned int start = sys_cycles();
+#endif
+
+            // Isochronous endpoints have neither handshakes nor chunked transfers, this clears their CTR flags
+            if ((*(&USB->EP0R + ep * 2) & USB_EP_TYPE_MASK) == USB_EP_ISOCHRONOUS) {
+                USB_HandleIso(ep);
+            }
+
             // On RX, call the registered callback if available
             if ((*(&USB->EP0R + ep * 2) & USB_EP_CTR_RX) != 0) {
+                USB_TRACE_EVENT(USB_TRACE_CTR_RX, ep, BTable[ep].COUNT_RX & 0x01FF);
+#ifdef USB_STATS
+                stats->RxPackets++;
+                stats->RxBytes += BTable[ep].COUNT_RX & 0x01FF;
+                if ((BTable[ep].COUNT_RX & 0x01FF) == 0) {
+                    stats->RxZlps++;
+                }
+#endif
+
                 if (Buffers[ep * 2].CompleteCallback != 0) {
+                    USB_TRACE_EVENT(USB_TRACE_CALLBACK, ep, 0);
                     Buffers[ep * 2].CompleteCallback(ep, BTable[ep].COUNT_RX & 0x01FF);
+                    USB_TRACE_EVENT(USB_TRACE_RETURN, ep, 0);
                 }
 
-                USB_SetEP(&USB->EP0R + ep * 2, USB_EP_RX_VALID, USB_EP_CTR_RX | USB_EP_RX_VALID);
+                if (ReceivePaused[ep]) {
+                    // The hardware already switched to NAK, keep the packet in the USB-SRAM until resumed
+                    USB_STAT(stats->Naks++);
+                    USB_SetEP(&USB->EP0R + ep * 2, 0x00, USB_EP_CTR_RX);
+                } else {
+                    USB_SetEP(&USB->EP0R + ep * 2, USB_EP_RX_VALID, USB_EP_CTR_RX | USB_EP_RX_VALID);
+                }
             }
 
             // On TX, check if there is some remaining data to be sent in the pending Transfers
             if ((*(&USB->EP0R + ep * 2) & USB_EP_CTR_TX) != 0) {
+                USB_TRACE_EVENT(USB_TRACE_CTR_TX, ep, Transfers[ep - 1].BytesSent);
+#ifdef USB_STATS
+                stats->TxPackets++;
+                stats->TxBytes += BTable[ep].COUNT_TX & 0x03FF;
+                if ((BTable[ep].COUNT_TX & 0x03FF) == 0) {
+                    stats->TxZlps++;
+                }
+#endif
+
                 if (Transfers[ep - 1].Length > 0) {
                     if (Transfers[ep - 1].Length > Transfers[ep - 1].BytesSent) {
-                        USB_PrepareTransfer(&Transfers[ep - 1], &USB->EP0R + ep * 2, Buffers[ep * 2 + 1].Buffer, &BTable[ep].COUNT_TX, Buffers[ep * 2 + 1].Size);
+                        USB_PrepareTransfer(&Transfers[ep - 1], &USB->EP0R + ep * 2, USB_GetTxBuffer(ep), &BTable[ep].COUNT_TX, Buffers[ep * 2 + 1].Size);
                     } else {
-                        char length = Transfers[ep - 1].Length;
+                        short length = Transfers[ep - 1].Length;
                         Transfers[ep - 1].Length = 0;
 
+                        USB_STAT(stats->Completions++);
                         if (Buffers[ep * 2 + 1].CompleteCallback != 0) {
+                            USB_TRACE_EVENT(USB_TRACE_CALLBACK, ep, 1);
                             Buffers[ep * 2 + 1].CompleteCallback(ep, length);
+                            USB_TRACE_EVENT(USB_TRACE_RETURN, ep, 1);
                         }
 
                         // if complete and no new TX, add one empty packet to flush queue, send tx complete signal
@@ -165,17 +301,69 @@ void USB_HP_IRQHandler() {
 
                 USB_SetEP(&USB->EP0R + ep * 2, 0x00, USB_EP_CTR_TX);
             }
+
+            USB_STAT(USB_CountCycles(&stats->IsrCalls, &stats->IsrCycles, &stats->IsrMaxCycles, start));
         }
     }
 }
 
-void USB_LP_IRQHandler() {
+__RAMFUNC void USB_LP_IRQHandler() {
+    USB_TRACE_EVENT(USB_TRACE_IRQ, 0, USB->ISTR);
+#ifdef USB_STATS
+    unsigned int start = sys_cycles();
+
+    // Bus errors are only counted, they never hide one of the events below
+    if ((USB->ISTR & USB_ISTR_ERR) != 0) {
+        USB->ISTR = ~USB_ISTR_ERR;
+        Statistics.Errors++;
+    }
+    if ((USB->ISTR & USB_ISTR_PMAOVR) != 0) {
+        USB->ISTR = ~USB_ISTR_PMAOVR;
+        Statistics.Overruns++;
+    }
+    if ((USB->ISTR & USB_ISTR_ESOF) != 0) {
+        USB->ISTR = ~USB_ISTR_ESOF;
+        Statistics.MissedSofs++;
+    }
+    if (WakeMeasuring && (USB->ISTR & USB_ISTR_SOF) != 0) {
+        // The first SOF after a resume, the bus is back
+        unsigned int latency = sys_now_us() - WakeStart;
+        if (!SofEnabled) {
+            USB->ISTR = ~USB_ISTR_SOF;
+            USB->CNTR &= ~USB_CNTR_SOFM;
+        }
+        WakeMeasuring = 0;
+
+        Statistics.WakeLatency = latency;
+        if (latency > Statistics.WakeMaxLatency) {
+            Statistics.WakeMaxLatency = latency;
+        }
+    }
+#endif
+
+    if (SofEnabled && (USB->ISTR & USB_ISTR_SOF) != 0) {
+        USB->ISTR = ~USB_ISTR_SOF;
+        if (implementation.Sof_Handler != 0) {
+            implementation.Sof_Handler(USB->FNR & USB_FNR_FN);
+        }
+    }
+
     if ((USB->ISTR & USB_ISTR_RESET) != 0) {
         // Clear interrupt
         USB->ISTR = ~USB_ISTR_RESET;
-
-        // Clear SRAM for readability
-        USB_ClearSRAM();
+        LOG_Print("usb: bus reset");
+        USB_TRACE_EVENT(USB_TRACE_RESET, 0, 0);
+        USB_STAT(Statistics.Resets++);
+        USB->CNTR |= USB_CNTR_STATS;
+        BOOT_Mark(BOOT_RESET);
+
+        RemoteWakeupEnabled = 0;
+        SleepState = USB_AWAKE;
+
+        if (ControlDeferred) {
+            ControlDeferred = 0;
+            TIMER_Stop(&ControlTimer);
+        }
 
         // Prepare BTable
         USB->BTABLE = __MEM2USB(BTable);
@@ -193,6 +381,21 @@ void USB_LP_IRQHandler() {
         // Prepare for a setup packet (RX = Valid, TX = NAK)
         USB_SetEP(&USB->EP0R, USB_EP_CONTROL | USB_EP_RX_VALID | USB_EP_TX_NAK, USB_EP_TYPE_MASK | USB_EP_RX_VALID | USB_EP_TX_VALID);
 
+        for (int i = 0; i < USB_NumEndpoints; i++) {
+            ReceivePaused[i] = 0;
+        }
+
+        for (int i = 0; i < 7; i++) {
+            Transfers[i].Length = 0;
+        }
+
+        // Only a Sof_Handler needs the SOF interrupt, isochronous endpoints alternate their halves without it
+        SofEnabled = implementation.Sof_Handler != 0;
+        if (SofEnabled) {
+            USB->CNTR |= USB_CNTR_SOFM;
+        } else {
+            USB->CNTR &= ~USB_CNTR_SOFM;
+        }
         for (int i = 0; i < implementation.NumEndpoints; i++) {
             USB_SetEPConfig(implementation.Endpoints[i]);
         }
@@ -207,29 +410,57 @@ void USB_LP_IRQHandler() {
         } else {
             USB_HP_IRQHandler();
         }
+    } else if ((USB->ISTR & USB_ISTR_L1REQ) != 0) {
+        USB->ISTR = ~USB_ISTR_L1REQ;
+        USB_TRACE_EVENT(USB_TRACE_L1, 0, USB->LPMCSR);
+        USB_STAT(Statistics.L1Sleeps++);
+
+        // The hardware already acknowledged the LPM token. L1 only lasts until the host resumes within BESL,
+        // so the class implementations are not involved, but the peripheral is put into low power like on suspend
+        L1RemoteWake = (USB->LPMCSR & USB_LPMCSR_REMWAKE) != 0;
+        SleepState = USB_SLEEP_L1;
+        USB->CNTR &= ~USB_CNTR_ESOFM;
+        USB->CNTR |= USB_CNTR_FSUSP;
+        USB->CNTR |= USB_CNTR_LPMODE;
     } else if ((USB->ISTR & USB_ISTR_SUSP) != 0) {
         USB->ISTR = ~USB_ISTR_SUSP;
+        LOG_Print("usb: suspend");
+        USB_TRACE_EVENT(USB_TRACE_SUSPEND, 0, 0);
+        USB_STAT(Statistics.Suspends++);
+        SleepState = USB_SUSPENDED;
+        SuspendTime = sys_now_us();
         if (implementation.Suspend_Handler != 0) {
             implementation.Suspend_Handler();
         }
 
-        // On Suspend, the device should enter low power mode and turn off the USB-Peripheral
+        // On Suspend, the device should enter low power mode and turn off the USB-Peripheral.
+        // The host stopped sending SOFs on purpose, so ESOF is not counted until the bus is back
+        USB->CNTR &= ~USB_CNTR_ESOFM;
         USB->CNTR |= USB_CNTR_FSUSP;
 
         // If the device still needs power from the USB Host
         USB->CNTR |= USB_CNTR_LPMODE;
-    } else if ((USB->ISTR & USB_CLR_WKUP) != 0) {
+    } else if ((USB->ISTR & USB_ISTR_WKUP) != 0) {
         USB->ISTR = ~USB_ISTR_WKUP;
+        LOG_Print("usb: wakeup");
+        USB_TRACE_EVENT(USB_TRACE_WAKEUP, 0, 0);
+        USB_STAT(Statistics.Wakeups++);
+        USB_STAT(USB_StartWakeMeasure());
 
         // Resume peripheral
+        char state = SleepState;
+        SleepState = USB_AWAKE;
         USB->CNTR &= ~(USB_CNTR_FSUSP | USB_CNTR_LPMODE);
-        if (implementation.Wakeup_Handler != 0) {
+        USB->CNTR |= USB_CNTR_STATS;
+        if (state != USB_SLEEP_L1 && implementation.Wakeup_Handler != 0) {
             implementation.Wakeup_Handler();
         }
     }
+
+    USB_STAT(USB_CountCycles(&Statistics.Irqs, &Statistics.IrqCycles, &Statistics.IrqMaxCycles, start));
 }
 
-static void USB_CopyMemory(const volatile unsigned char *source, volatile unsigned char *target, short length) {
+__RAMFUNC static void USB_CopyMemory(const volatile unsigned char *source, volatile unsigned char *target, short length) {
     volatile unsigned short *dest = (volatile unsigned short *)target;
     volatile unsigned short *src = (volatile unsigned short *)source;
 
@@ -256,14 +487,14 @@ static void USB_WriteToUSBMemory(const unsigned char byte0, const unsigned char
 }
 
 static void USB_ClearSRAM() {
-    volatile unsigned char *buffer = (volatile unsigned char *)__USBBUF_BEGIN;
+    volatile unsigned short *buffer = (volatile unsigned short *)__USBBUF_BEGIN;
 
-    for (int i = 0; i < 1024; i++) {
+    for (int i = 0; i < __USBBUF_SIZE / 2; i++) {
         buffer[i] = 0;
     }
 }
 
-static void USB_SetEP(volatile unsigned short *ep, short value, short mask) {
+__RAMFUNC static void USB_SetEP(volatile unsigned short *ep, short value, short mask) {
     short toggle = 0b0111000001110000;
     short rc_w0 = 0b1000000010000000;
     short rw = 0b0000011100001111;
@@ -276,7 +507,20 @@ static void USB_SetEP(volatile unsigned short *ep, short value, short mask) {
 }
 
 static void USB_HandleControl() {
+#ifdef USB_STATS
+    USB_EP_STATISTICS *stats = &Statistics.Endpoints[0];
+    unsigned int start = sys_cycles();
+#endif
+
     if (USB->EP0R & USB_EP_CTR_RX) {
+#ifdef USB_STATS
+        stats->RxPackets++;
+        stats->RxBytes += BTable[0].COUNT_RX & 0x01FF;
+        if ((BTable[0].COUNT_RX & 0x01FF) == 0) {
+            stats->RxZlps++;
+        }
+#endif
+
         // We received a control message
         if (USB->EP0R & USB_EP_SETUP) {
             // On Setup, ditch all running receptions and start anew
@@ -285,6 +529,13 @@ static void USB_HandleControl() {
             ControlState.Transfer.Length = 0;
             ControlState.Receive.Length = 0;
 
+            // A new request ends a deferred one, the host gave up on it
+            ControlHandle++;
+            if (ControlDeferred) {
+                ControlDeferred = 0;
+                TIMER_Stop(&ControlTimer);
+            }
+
             // If this is an OUT Transfer and we expect data, postpone handling the setup until the data arrives
             if ((setup->RequestType & 0x80) == 0 && setup->Length > 0) {
                 ControlState.Receive.Length = setup->Length;
@@ -294,7 +545,24 @@ static void USB_HandleControl() {
             }
         } else {
             // Check if we are expecting data for a setup-packet. If so, read it and call the Setup-Handler once the transfer is complete
-            if (ControlState.Receive.Length > 0) {
+            if (ControlState.Receive.Length > USB_MaxControlData) {
+                // Too large for the control buffer, stream every packet to the class as it arrives
+                short count = MIN(BTable[0].COUNT_RX & 0x1FF, ControlState.Receive.Length - ControlState.Receive.BytesSent);
+                USB_CopyFromUsb(EP0_Buf[0], ControlState.Receive.Buffer, count);
+
+                if (implementation.ControlData_Handler == 0 ||
+                    implementation.ControlData_Handler(&ControlState.Setup, ControlState.Receive.Buffer, count, ControlState.Receive.BytesSent) != USB_OK) {
+                    USB_SetEP(&USB->EP0R, USB_EP_TX_STALL, USB_EP_TX_VALID);
+                    ControlState.Receive.Length = 0;
+                } else {
+                    ControlState.Receive.BytesSent += count;
+
+                    if (ControlState.Receive.BytesSent >= ControlState.Receive.Length) {
+                        USB_HandleSetup(&ControlState.Setup);
+                        ControlState.Receive.Length = 0;
+                    }
+                }
+            } else if (ControlState.Receive.Length > 0) {
                 if (ControlState.Receive.BytesSent < USB_MaxControlData) {
                     USB_CopyFromUsb(EP0_Buf[0], (ControlState.Receive.Buffer + ControlState.Receive.BytesSent), MIN(USB_MaxControlData - ControlState.Receive.BytesSent, BTable[0].COUNT_RX & 0x1FF));
                     ControlState.Receive.BytesSent += MIN(USB_MaxControlData - ControlState.Receive.BytesSent, BTable[0].COUNT_RX & 0x1FF);
@@ -303,9 +571,6 @@ static void USB_HandleControl() {
                 if (ControlState.Receive.BytesSent >= ControlState.Receive.Length) {
                     USB_HandleSetup(&ControlState.Setup);
                     ControlState.Receive.Length = 0;
-                } else if (ControlState.Receive.BytesSent >= USB_MaxControlData) {
-                    USB_SetEP(&USB->EP0R, USB_EP_TX_STALL, USB_EP_TX_VALID);
-                    ControlState.Receive.Length = 0;
                 }
             }
         }
@@ -314,6 +579,14 @@ static void USB_HandleControl() {
     }
 
     if (USB->EP0R & USB_EP_CTR_TX) {
+#ifdef USB_STATS
+        stats->TxPackets++;
+        stats->TxBytes += BTable[0].COUNT_TX & 0x03FF;
+        if ((BTable[0].COUNT_TX & 0x03FF) == 0) {
+            stats->TxZlps++;
+        }
+#endif
+
         // We just sent a control message
         if (ControlState.Setup.Request == 0x05) {
             USB->DADDR = USB_DADDR_EF | ControlState.Setup.Value;
@@ -330,15 +603,31 @@ static void USB_HandleControl() {
 
         USB_SetEP(&USB->EP0R, 0x00, USB_EP_CTR_TX);
     }
+
+    USB_STAT(USB_CountCycles(&stats->IsrCalls, &stats->IsrCycles, &stats->IsrMaxCycles, start));
 }
 
 static void USB_HandleSetup(USB_SETUP_PACKET *setup) {
-    if ((setup->RequestType & 0x60) != 0) { // || (setup->RequestType & 0x1F) != 0) {
+    USB_TRACE_EVENT(USB_TRACE_SETUP, 0, setup->RequestType | setup->Request << 8);
+    BOOT_Mark(BOOT_SETUP);
+
+    if ((setup->RequestType & 0x7F) == 0x40 && (setup->Request & 0xF0) == 0xE0) {
+        // Vendor requests 0xE0 - 0xEF to the device are reserved for the diagnostics of the USB core
+        USB_HandleDiagnostics(setup);
+    } else if ((setup->RequestType & 0x60) != 0) { // || (setup->RequestType & 0x1F) != 0) {
         // Class and interface setup packets are redirected to the class specific implementation
         if (implementation.SetupPacket_Handler != 0) {
-            char ret = implementation.SetupPacket_Handler(setup, ControlState.Receive.Buffer, ControlState.Receive.Length);
-
-            if ((setup->RequestType & 0x80) == 0) {
+            // Streamed data stages were already handed to ControlData_Handler
+            const unsigned char *data = ControlState.Receive.Length > USB_MaxControlData ? 0 : ControlState.Receive.Buffer;
+            char ret = implementation.SetupPacket_Handler(setup, data, ControlState.Receive.Length);
+
+            if (ret == USB_DEFER) {
+                // NAK the data (IN) or status (OUT) stage until USB_CompleteControl
+                USB_TRACE_EVENT(USB_TRACE_DEFER, 0, ControlHandle);
+                ControlDeferred = 1;
+                USB_SetEP(&USB->EP0R, USB_EP_TX_NAK, USB_EP_TX_VALID);
+                TIMER_Start(&ControlTimer, USB_CONTROL_TIMEOUT * 1000, 0, USB_ControlTimeout, 0);
+            } else if ((setup->RequestType & 0x80) == 0) {
                 if (ret == USB_OK) {
                     BTable[0].COUNT_TX = 0;
                     USB_SetEP(&USB->EP0R, USB_EP_TX_VALID, USB_EP_TX_VALID);
@@ -353,15 +642,24 @@ static void USB_HandleSetup(USB_SETUP_PACKET *setup) {
         if ((setup->RequestType & 0x0F) == 0) { // Device Requests
             switch (setup->Request) {
             case 0x00: // Get Status
-                EP0_Buf[1][0] = USB_SelfPowered;
+                EP0_Buf[1][0] = USB_SelfPowered | (RemoteWakeupEnabled << 1);
                 EP0_Buf[1][1] = 0x00;
                 BTable[0].COUNT_TX = 2;
                 USB_SetEP(&USB->EP0R, USB_EP_TX_VALID, USB_EP_TX_VALID);
                 break;
             case 0x01: // Clear Feature
-                USB_SetEP(&USB->EP0R, USB_EP_TX_STALL, USB_EP_TX_VALID);
+                if (setup->Value == 0x01) { // DEVICE_REMOTE_WAKEUP
+                    RemoteWakeupEnabled = 0;
+                    BTable[0].COUNT_TX = 0;
+                    USB_SetEP(&USB->EP0R, USB_EP_TX_VALID, USB_EP_TX_VALID);
+                } else {
+                    USB_SetEP(&USB->EP0R, USB_EP_TX_STALL, USB_EP_TX_VALID);
+                }
                 break;
             case 0x03: // Set Feature
+                if (setup->Value == 0x01) { // DEVICE_REMOTE_WAKEUP
+                    RemoteWakeupEnabled = 1;
+                }
                 BTable[0].COUNT_TX = 0;
                 USB_SetEP(&USB->EP0R, USB_EP_TX_VALID, USB_EP_TX_VALID);
                 break;
@@ -370,6 +668,7 @@ static void USB_HandleSetup(USB_SETUP_PACKET *setup) {
                     BTable[0].COUNT_TX = 0;
                     USB_SetEP(&USB->EP0R, USB_EP_TX_VALID, USB_EP_TX_VALID);
                     DeviceState = 1;
+                    BOOT_Mark(BOOT_ADDRESS);
                 } else {
                     USB_SetEP(&USB->EP0R, USB_EP_TX_STALL, USB_EP_TX_VALID);
                 }
@@ -436,6 +735,11 @@ static void USB_HandleSetup(USB_SETUP_PACKET *setup) {
                 case 0x06: // Device Qualifier Descriptor
                     USB_SetEP(&USB->EP0R, USB_EP_TX_STALL, USB_EP_TX_VALID);
                     break;
+                case 0x0F: // BOS Descriptor
+                    USB_CopyToUsb(&BosDescriptor, EP0_Buf[1], sizeof(BosDescriptor));
+                    BTable[0].COUNT_TX = MIN(sizeof(BosDescriptor), setup->Length);
+                    USB_SetEP(&USB->EP0R, USB_EP_TX_VALID, USB_EP_TX_VALID);
+                    break;
                 }
                 break;
             case 0x07: // Set Descriptor
@@ -456,6 +760,7 @@ static void USB_HandleSetup(USB_SETUP_PACKET *setup) {
                 }
                 break;
             case 0x09: // Set Configuration
+                LOG_Print("usb: set configuration %u", setup->Value & 0xFF);
                 if (DeviceState == 1 || DeviceState == 2) {
                     BTable[0].COUNT_TX = 0;
                     switch (setup->Value & 0xFF) {
@@ -467,6 +772,7 @@ static void USB_HandleSetup(USB_SETUP_PACKET *setup) {
                     case 1:
                         DeviceState = 2;
                         ActiveConfiguration = 1;
+                        BOOT_Mark(BOOT_CONFIGURED);
                         USB_SetEP(&USB->EP0R, USB_EP_TX_VALID, USB_EP_TX_VALID);
                         break;
                     default:
@@ -505,6 +811,13 @@ static void USB_HandleSetup(USB_SETUP_PACKET *setup) {
             case 0x03: // Set Feature
                 USB_SetEP(&USB->EP0R, USB_EP_TX_STALL, USB_EP_TX_VALID);
                 break;
+            case 0x06: // Get Descriptor
+                // Class descriptors like the HID report descriptor are only known to the implementation
+                if (implementation.SetupPacket_Handler == 0 ||
+                    implementation.SetupPacket_Handler(setup, ControlState.Receive.Buffer, ControlState.Receive.Length) != USB_OK) {
+                    USB_SetEP(&USB->EP0R, USB_EP_TX_STALL, USB_EP_TX_VALID);
+                }
+                break;
             case 0x0A: // Get Interface
                 if (DeviceState == 2 && setup->Index < implementation.NumInterfaces) {
                     EP0_Buf[1][0] = 0x00;
@@ -576,15 +889,59 @@ static void USB_HandleSetup(USB_SETUP_PACKET *setup) {
     }
 }
 
-static void USB_PrepareTransfer(USB_TRANSFER_STATE *transfer, volatile unsigned short *ep, volatile unsigned char *txBuffer, volatile unsigned short *txBufferCount, const unsigned short txBufferSize) {
+static void USB_HandleDiagnostics(USB_SETUP_PACKET *setup) {
+    char ret = USB_ERR;
+
+    switch (setup->Request) {
+#ifdef USB_TRACE
+    case USB_TRACE_REQUEST_INFO:
+    case USB_TRACE_REQUEST_READ:
+        ret = USB_Trace_SetupPacket(setup);
+        break;
+#endif
+#ifdef USB_STATS
+    case USB_STATS_REQUEST:
+        if ((setup->RequestType & 0x80) != 0) {
+            // Sent from a copy, the counters keep changing during the transfer
+            USB_SnapshotStatistics(&StatisticsSnapshot, setup->Value == 1);
+            USB_Transmit(0, (const unsigned char *)&StatisticsSnapshot, MIN(sizeof(StatisticsSnapshot), setup->Length));
+            ret = USB_OK;
+        }
+        break;
+#endif
+    case BOOT_REQUEST:
+        if ((setup->RequestType & 0x80) != 0) {
+            USB_Transmit(0, (const unsigned char *)BOOT_GetTimes(), MIN(BOOT_PHASES * sizeof(unsigned int), setup->Length));
+            ret = USB_OK;
+        }
+        break;
+#ifdef PROFILER
+    case PROFILER_REQUEST:
+        ret = PROFILER_SetupPacket(setup);
+        break;
+#endif
+    }
+
+    if (ret != USB_OK) {
+        USB_SetEP(&USB->EP0R, USB_EP_TX_STALL, USB_EP_TX_VALID);
+    } else if ((setup->RequestType & 0x80) == 0) {
+        BTable[0].COUNT_TX = 0;
+        USB_SetEP(&USB->EP0R, USB_EP_TX_VALID, USB_EP_TX_VALID);
+    }
+}
+
+__RAMFUNC static void USB_PrepareTransfer(USB_TRANSFER_STATE *transfer, volatile unsigned short *ep, volatile unsigned char *txBuffer, volatile unsigned short *txBufferCount, const unsigned short txBufferSize) {
     // Check if there is still data to transmit and if so transmit the next chunk of data
     *txBufferCount = MIN(txBufferSize, transfer->Length - transfer->BytesSent);
+    USB_TRACE_EVENT(USB_TRACE_PREPARE, (ep - &USB->EP0R) / 2, *txBufferCount);
 #ifdef USB_TXTIMEOUT
     transfer->Timeout = sys_now();
 #endif
 
     if (*txBufferCount > 0) {
-        USB_CopyMemory(transfer->Buffer + transfer->BytesSent, txBuffer, *txBufferCount);
+        if (transfer->Buffer + transfer->BytesSent != txBuffer) {
+            USB_CopyMemory(transfer->Buffer + transfer->BytesSent, txBuffer, *txBufferCount);
+        }
         transfer->BytesSent += *txBufferCount;
         USB_SetEP(ep, USB_EP_TX_VALID, USB_EP_TX_VALID);
     } else {
@@ -592,6 +949,18 @@ static void USB_PrepareTransfer(USB_TRANSFER_STATE *transfer, volatile unsigned
     }
 }
 
+static volatile unsigned char *USB_GetTxBuffer(unsigned char ep) {
+    volatile unsigned char *buffer = Buffers[ep * 2 + 1].Buffer;
+
+    if (__IS_USBMEM(Transfers[ep - 1].Buffer)) {
+        // Send straight from the USB-SRAM by moving the endpoint buffer along the data
+        buffer = (volatile unsigned char *)Transfers[ep - 1].Buffer + Transfers[ep - 1].BytesSent;
+    }
+
+    BTable[ep].ADDR_TX = __MEM2USB(buffer);
+    return buffer;
+}
+
 void USB_Transmit(unsigned char ep, const unsigned char *buffer, short length) {
     // Prepare the transfer metadata and initiate the chunked transfer
     if (ep == 0) {
@@ -600,10 +969,131 @@ void USB_Transmit(unsigned char ep, const unsigned char *buffer, short length) {
         ControlState.Transfer.Length = length;
         USB_PrepareTransfer(&ControlState.Transfer, &USB->EP0R, EP0_Buf[1], &BTable[0].COUNT_TX, 64);
     } else if (ep < 8) {
+        unsigned int primask = __get_PRIMASK();
+        __disable_irq();
+
+#ifdef USB_STATS
+        if (length > Statistics.Endpoints[ep].MaxQueued) {
+            Statistics.Endpoints[ep].MaxQueued = length;
+        }
+#endif
+
         Transfers[ep - 1].Buffer = buffer;
         Transfers[ep - 1].Length = length;
         Transfers[ep - 1].BytesSent = 0;
-        USB_PrepareTransfer(&Transfers[ep - 1], (&USB->EP0R) + ep * 2, Buffers[ep * 2 + 1].Buffer, &BTable[ep].COUNT_TX, Buffers[ep * 2 + 1].Size);
+
+        // While the previous packet (or the trailing empty one) is still in flight, the buffer belongs to the hardware.
+        // The next CTR_TX picks the transfer up instead
+        if ((*(&USB->EP0R + ep * 2) & USB_EPTX_STAT) != USB_EP_TX_VALID) {
+            USB_PrepareTransfer(&Transfers[ep - 1], (&USB->EP0R) + ep * 2, USB_GetTxBuffer(ep), &BTable[ep].COUNT_TX, Buffers[ep * 2 + 1].Size);
+        }
+
+        __set_PRIMASK(primask);
+    }
+}
+
+unsigned char USB_GetControlHandle() {
+    return ControlHandle;
+}
+
+char USB_CompleteControl(unsigned char handle, char result, const unsigned char *data, short length) {
+    unsigned int primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (!ControlDeferred || handle != ControlHandle) {
+        __set_PRIMASK(primask);
+        return USB_ERR;
+    }
+
+    USB_TRACE_EVENT(USB_TRACE_COMPLETE, 0, handle | result << 8);
+    ControlDeferred = 0;
+    TIMER_Stop(&ControlTimer);
+
+    if (result != USB_OK) {
+        USB_SetEP(&USB->EP0R, USB_EP_TX_STALL, USB_EP_TX_VALID);
+    } else if ((ControlState.Setup.RequestType & 0x80) != 0) {
+        USB_Transmit(0, data, MIN(length, ControlState.Setup.Length));
+    } else {
+        BTable[0].COUNT_TX = 0;
+        USB_SetEP(&USB->EP0R, USB_EP_TX_VALID, USB_EP_TX_VALID);
+    }
+
+    __set_PRIMASK(primask);
+    return USB_OK;
+}
+
+static void USB_ControlTimeout(void *arg) {
+    if (ControlDeferred) {
+        USB_TRACE_EVENT(USB_TRACE_COMPLETE, 0, ControlHandle | 0xFF << 8);
+        ControlDeferred = 0;
+        USB_SetEP(&USB->EP0R, USB_EP_TX_STALL, USB_EP_TX_VALID);
+    }
+}
+
+char USB_IsConfigured() {
+    return DeviceState == 2;
+}
+
+char USB_IsSuspended() {
+    return SleepState != USB_AWAKE;
+}
+
+char USB_RemoteWakeup() {
+    unsigned int primask = __get_PRIMASK();
+    __disable_irq();
+
+    char state = SleepState;
+    if ((state != USB_SLEEP_L1 || !L1RemoteWake) && (state != USB_SUSPENDED || !RemoteWakeupEnabled)) {
+        __set_PRIMASK(primask);
+        return USB_ERR;
+    }
+
+    USB_TRACE_EVENT(USB_TRACE_RESUME, 0, state);
+    USB_STAT(Statistics.RemoteWakeups++);
+    USB_STAT(USB_StartWakeMeasure());
+
+    USB->CNTR &= ~(USB_CNTR_FSUSP | USB_CNTR_LPMODE);
+
+    if (state == USB_SLEEP_L1) {
+        // The peripheral times the 50us L1 resume by itself
+        USB->CNTR |= USB_CNTR_L1RESUME;
+        USB->CNTR |= USB_CNTR_STATS;
+        SleepState = USB_AWAKE;
+    } else {
+        // The bus has to be idle for 5ms before resume signaling, SUSP is raised after 3ms of them
+        unsigned int idle = sys_now_us() - SuspendTime;
+        if (idle < USB_RESUME_IDLE) {
+            TIMER_Start(&ResumeTimer, USB_RESUME_IDLE - idle, 0, USB_StartResume, 0);
+        } else {
+            USB_StartResume(0);
+        }
+    }
+
+    __set_PRIMASK(primask);
+    return USB_OK;
+}
+
+static void USB_StartResume(void *arg) {
+    // The host may have resumed the bus while waiting for the idle time
+    if (SleepState != USB_SUSPENDED) {
+        return;
+    }
+
+    // Resume signaling from suspend has to last 1 - 15ms
+    USB->CNTR |= USB_CNTR_RESUME;
+    TIMER_Start(&ResumeTimer, 2000, 0, USB_EndResume, 0);
+}
+
+static void USB_EndResume(void *arg) {
+    USB->CNTR &= ~USB_CNTR_RESUME;
+    USB->CNTR |= USB_CNTR_STATS;
+
+    // The host may already have taken over the resume and woken everything in the WKUP interrupt
+    if (SleepState == USB_SUSPENDED) {
+        SleepState = USB_AWAKE;
+        if (implementation.Wakeup_Handler != 0) {
+            implementation.Wakeup_Handler();
+        }
     }
 }
 
@@ -624,9 +1114,15 @@ char USB_IsTransmitPending(unsigned char ep) {
     return tx->Length > 0;
 }
 
-void USB_Fetch(unsigned char ep, unsigned char *buffer, short *length) {
+__RAMFUNC void USB_Fetch(unsigned char ep, unsigned char *buffer, short *length) {
     // Read data from the RX Buffer
-    if (ep >= 0 && ep < 8) {
+    if (ep > 0 && ep < 8 && (*(&USB->EP0R + ep * 2) & USB_EP_TYPE_MASK) == USB_EP_ISOCHRONOUS) {
+        volatile unsigned short *count;
+        unsigned char index = USB_GetIsoBuffer(ep, USB_EP_DTOG_RX, &count);
+        *length = MIN(*count & 0x3FF, *length);
+
+        USB_CopyMemory(Buffers[index].Buffer, buffer, *length);
+    } else if (ep >= 0 && ep < 8) {
         short rxcount = BTable[ep].COUNT_RX & 0x1FF;
         *length = MIN(rxcount, *length);
 
@@ -634,6 +1130,174 @@ void USB_Fetch(unsigned char ep, unsigned char *buffer, short *length) {
     }
 }
 
+void USB_TransmitIso(unsigned char ep, const unsigned char *buffer, short length) {
+    if (ep > 0 && ep < 8) {
+        unsigned int primask = __get_PRIMASK();
+        __disable_irq();
+
+        volatile unsigned short *count;
+        unsigned char index = USB_GetIsoBuffer(ep, USB_EP_DTOG_TX, &count);
+        length = MIN(length, Buffers[index].Size);
+
+        USB_CopyToUsb(buffer, Buffers[index].Buffer, length);
+        *count = length;
+
+        __set_PRIMASK(primask);
+    }
+}
+
+__RAMFUNC static unsigned char USB_GetIsoBuffer(unsigned char ep, unsigned short dtog, volatile unsigned short **count) {
+    // DTOG selects the half the hardware uses for the next transaction: 0 the ADDR_TX / COUNT_TX slot, 1 the ADDR_RX / COUNT_RX slot
+    if ((*(&USB->EP0R + ep * 2) & dtog) != 0) {
+        *count = &BTable[ep].COUNT_TX;
+        return ep * 2 + 1;
+    }
+
+    *count = &BTable[ep].COUNT_RX;
+    return ep * 2;
+}
+
+__RAMFUNC static void USB_HandleIso(unsigned char ep) {
+    volatile unsigned short *epr = &USB->EP0R + ep * 2;
+    volatile unsigned short *count;
+#ifdef USB_STATS
+    USB_EP_STATISTICS *stats = &Statistics.Endpoints[ep];
+#endif
+
+    if ((*epr & USB_EP_CTR_RX) != 0) {
+        // The hardware already toggled to the other half, the received packet is in the application half.
+        // There is no NAK, the endpoint stays valid and a packet not fetched in time is overwritten
+        USB_SetEP(epr, 0x00, USB_EP_CTR_RX);
+        USB_GetIsoBuffer(ep, USB_EP_DTOG_RX, &count);
+        short length = *count & 0x3FF;
+
+        USB_TRACE_EVENT(USB_TRACE_CTR_RX, ep, length);
+#ifdef USB_STATS
+        stats->RxPackets++;
+        stats->RxBytes += length;
+        if (length == 0) {
+            stats->RxZlps++;
+        }
+#endif
+
+        if (Buffers[ep * 2].CompleteCallback != 0) {
+            USB_TRACE_EVENT(USB_TRACE_CALLBACK, ep, 0);
+            Buffers[ep * 2].CompleteCallback(ep, length);
+            USB_TRACE_EVENT(USB_TRACE_RETURN, ep, 0);
+        }
+    }
+
+    if ((*epr & USB_EP_CTR_TX) != 0) {
+        // The half just sent is free again, empty it so it is not repeated if the class has nothing new
+        USB_SetEP(epr, 0x00, USB_EP_CTR_TX);
+        USB_GetIsoBuffer(ep, USB_EP_DTOG_TX, &count);
+        short length = *count & 0x3FF;
+        *count = 0;
+
+        USB_TRACE_EVENT(USB_TRACE_CTR_TX, ep, length);
+#ifdef USB_STATS
+        stats->TxPackets++;
+        stats->TxBytes += length;
+        if (length == 0) {
+            stats->TxZlps++;
+        }
+#endif
+
+        if (Buffers[ep * 2 + 1].CompleteCallback != 0) {
+            USB_TRACE_EVENT(USB_TRACE_CALLBACK, ep, 1);
+            Buffers[ep * 2 + 1].CompleteCallback(ep, length);
+            USB_TRACE_EVENT(USB_TRACE_RETURN, ep, 1);
+        }
+    }
+}
+
+void USB_PauseReceive(unsigned char ep) {
+    if (ep > 0 && ep < 8) {
+        ReceivePaused[ep] = 1;
+    }
+}
+
+void USB_ResumeReceive(unsigned char ep) {
+    if (ep > 0 && ep < 8) {
+        unsigned int primask = __get_PRIMASK();
+        __disable_irq();
+
+        ReceivePaused[ep] = 0;
+        USB_SetEP(&USB->EP0R + ep * 2, USB_EP_RX_VALID, USB_EP_RX_VALID);
+
+        __set_PRIMASK(primask);
+    }
+}
+
+static void USB_CountCycles(unsigned int *calls, unsigned int *cycles, unsigned int *maxCycles, unsigned int start) {
+    unsigned int duration = sys_cycles() - start;
+
+    (*calls)++;
+    *cycles += duration;
+    if (duration > *maxCycles) {
+        *maxCycles = duration;
+    }
+}
+
+static void USB_StartWakeMeasure() {
+#ifdef USB_STATS
+    // Drop a SOF flag left from before the sleep, the interrupt is only enabled until the next one
+    WakeStart = sys_now_us();
+    WakeMeasuring = 1;
+    USB->ISTR = ~USB_ISTR_SOF;
+    USB->CNTR |= USB_CNTR_SOFM;
+#endif
+}
+
+const USB_STATISTICS *USB_GetStatistics() {
+    return &Statistics;
+}
+
+void USB_SnapshotStatistics(USB_STATISTICS *target, char clear) {
+    unsigned int primask = __get_PRIMASK();
+    __disable_irq();
+
+    *target = Statistics;
+    if (clear) {
+        Statistics = (USB_STATISTICS){0};
+    }
+
+    __set_PRIMASK(primask);
+}
+
+volatile unsigned char *USB_AllocateSRAM(unsigned short size) {
+    // Take the memory from the end, it must not reach into the endpoint buffers distributed from the start
+    size = (size + 1) & ~1;
+
+    if (EndpointSRAM == 0 || EndpointSRAM + AllocatedSRAM + size > __USBBUF_SIZE) {
+        return 0;
+    }
+
+    AllocatedSRAM += size;
+    return (volatile unsigned char *)(__USBBUF_BEGIN + __USBBUF_SIZE - AllocatedSRAM);
+}
+
+void USB_WriteSRAM(volatile unsigned char *target, const void *source, short length) {
+    // The USB-SRAM is only written in half-words, merge odd bytes at the borders
+    const unsigned char *src = (const unsigned char *)source;
+    volatile unsigned short *dest = (volatile unsigned short *)((unsigned int)target & ~1);
+    int i = 0;
+
+    if (((unsigned int)target & 1) != 0 && length > 0) {
+        *dest = (*dest & 0x00FF) | (src[0] << 8);
+        dest++;
+        i = 1;
+    }
+
+    for (; i + 1 < length; i += 2) {
+        *dest++ = src[i] | (src[i + 1] << 8);
+    }
+
+    if (i < length) {
+        *dest = (*dest & 0xFF00) | src[i];
+    }
+}
+
 static void USB_DistributeBuffers() {
     // This function will organize the USB-SRAM and assign RX- and TX-Buffers
     volatile unsigned char *addr = (volatile unsigned char *)(__USBBUF_BEGIN + sizeof(BTable));
@@ -650,18 +1314,58 @@ static void USB_DistributeBuffers() {
     }
 }
 
+static void USB_GetBufferSizes(const USB_CONFIG_EP *config, unsigned short *rxSize, unsigned short *txSize) {
+    unsigned short rx = config->RxBufferSize;
+    unsigned short tx = config->TxBufferSize;
+
+    // Large reception buffers are counted in blocks of 32 bytes
+    if (rx > 62)
+        rx = (rx + 31) & ~31;
+    if (rx & 0x01)
+        rx++;
+    if (tx & 0x01)
+        tx++;
+
+    // Isochronous endpoints are double buffered in their one direction, using both buffer descriptors
+    if ((config->Type & USB_EP_TYPE_MASK) == USB_EP_ISOCHRONOUS) {
+        if (tx > 0) {
+            rx = tx;
+        } else {
+            tx = rx;
+        }
+    }
+
+    *rxSize = rx;
+    *txSize = tx;
+}
+
+static unsigned short USB_GetEndpointSRAM() {
+    // Same order & sizes as USB_DistributeBuffers will use once the host resets the bus
+    unsigned short size = sizeof(BTable) + sizeof(EP0_Buf);
+
+    for (int i = 0; i < implementation.NumEndpoints; i++) {
+        unsigned short rxSize;
+        unsigned short txSize;
+
+        if (implementation.Endpoints[i].EP > 0 && implementation.Endpoints[i].EP < 8) {
+            USB_GetBufferSizes(&implementation.Endpoints[i], &rxSize, &txSize);
+            size += rxSize + txSize;
+        }
+    }
+
+    return size;
+}
+
 void USB_SetEPConfig(USB_CONFIG_EP config) {
     if (config.EP > 0 && config.EP < 8) {
-        unsigned char rxSize = config.RxBufferSize;
-        unsigned char txSize = config.TxBufferSize;
+        unsigned short rxSize;
+        unsigned short txSize;
+        char iso = (config.Type & USB_EP_TYPE_MASK) == USB_EP_ISOCHRONOUS;
 
-        if (rxSize & 0x01)
-            rxSize++;
-        if (txSize & 0x01)
-            txSize++;
+        USB_GetBufferSizes(&config, &rxSize, &txSize);
 
-        Buffers[config.EP * 2].Size = config.RxBufferSize;
-        Buffers[config.EP * 2 + 1].Size = config.TxBufferSize;
+        Buffers[config.EP * 2].Size = rxSize;
+        Buffers[config.EP * 2 + 1].Size = txSize;
         Buffers[config.EP * 2].CompleteCallback = config.RxCallback;
         Buffers[config.EP * 2 + 1].CompleteCallback = config.TxCallback;
         USB_DistributeBuffers();
@@ -673,27 +1377,44 @@ void USB_SetEPConfig(USB_CONFIG_EP config) {
             BTable[config.EP].ADDR_TX = __MEM2USB(Buffers[config.EP * 2 + 1].Buffer);
         }
 
-        BTable[config.EP].COUNT_TX = 0;
-        if (rxSize < 64) {
-            BTable[config.EP].COUNT_RX = (rxSize / 2) << 10;
-        } else {
-            BTable[config.EP].COUNT_RX = (1 << 15) | (((rxSize / 32) - 1) << 10);
-        }
-
         // only allow to set ep type & kind
         short epConfig = config.Type & 0x0700;
-        epConfig |= USB_EP_TX_NAK;
         epConfig |= config.EP;
-        if (rxSize > 0) {
+
+        if (iso && config.TxBufferSize > 0) {
+            // Both halves start empty, the endpoint sends empty packets until USB_TransmitIso
+            BTable[config.EP].COUNT_TX = 0;
+            BTable[config.EP].COUNT_RX = 0;
+            epConfig |= USB_EP_TX_VALID;
+        } else if (iso) {
+            BTable[config.EP].COUNT_TX = USB_EncodeRxSize(rxSize);
+            BTable[config.EP].COUNT_RX = USB_EncodeRxSize(rxSize);
             epConfig |= USB_EP_RX_VALID;
+        } else {
+            BTable[config.EP].COUNT_TX = 0;
+            BTable[config.EP].COUNT_RX = USB_EncodeRxSize(rxSize);
+            epConfig |= USB_EP_TX_NAK;
+            if (rxSize > 0) {
+                epConfig |= USB_EP_RX_VALID;
+            }
         }
 
         USB_SetEP((&USB->EP0R) + 2 * config.EP, epConfig, USB_EP_DTOG_RX | USB_EP_RX_VALID | USB_EP_TYPE_MASK | USB_EP_KIND | USB_EP_DTOG_TX | USB_EP_TX_VALID | 0x000F);
     }
 }
 
+static unsigned short USB_EncodeRxSize(unsigned short size) {
+    // Up to 62 bytes in 2 byte blocks, above in 32 byte blocks (BL_SIZE)
+    if (size <= 62) {
+        return (size / 2) << 10;
+    } else {
+        return (1 << 15) | (((size / 32) - 1) << 10);
+    }
+}
+
 void USB_SetImplementation(USB_Implementation impl) {
     implementation = impl;
+    EndpointSRAM = USB_GetEndpointSRAM();
 }
 
 unsigned short USB_BuildDescriptor(unsigned char *buffer, unsigned short size, unsigned char num, const void **parts) {
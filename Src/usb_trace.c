@@ -0,0 +1,85 @@
+#include "usb_trace.h"
+
+#define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
+
+#if (USB_TRACE_SIZE & (USB_TRACE_SIZE - 1)) != 0
+#error "USB_TRACE_SIZE has to be a power of two"
+#endif
+
+static USB_TRACE_ENTRY ring[USB_TRACE_SIZE];
+static volatile unsigned int written = 0;
+static volatile char frozen = 0;
+static USB_TRACE_INFO info;
+
+static unsigned int USB_Trace_Claim() {
+#if (__CORTEX_M >= 3)
+    unsigned int index;
+
+    do {
+        index = __LDREXW(&written);
+    } while (__STREXW(index + 1, &written) != 0);
+
+    return index;
+#else
+    // No exclusive access on the Cortex-M0
+    unsigned int primask = __get_PRIMASK();
+    __disable_irq();
+
+    unsigned int index = written++;
+
+    __set_PRIMASK(primask);
+    return index;
+#endif
+}
+
+void USB_Trace(USB_TRACE_TYPE event, unsigned char ep, unsigned short value) {
+    // While the host reads the ring, it has to stay as it is
+    if (frozen) {
+        return;
+    }
+
+    USB_TRACE_ENTRY *entry = &ring[USB_Trace_Claim() & (USB_TRACE_SIZE - 1)];
+
+    entry->Cycles = sys_cycles();
+    entry->Event = event;
+    entry->Endpoint = ep;
+    entry->Value = value;
+}
+
+char USB_Trace_SetupPacket(USB_SETUP_PACKET *setup) {
+    switch (setup->Request) {
+    case USB_TRACE_REQUEST_INFO:
+        if ((setup->RequestType & 0x80) == 0) {
+            if (setup->Value == 1) {
+                written = 0;
+            }
+
+            frozen = 0;
+            return USB_OK;
+        }
+
+        frozen = 1;
+
+        info.Written = written;
+        info.Size = USB_TRACE_SIZE;
+        info.EntrySize = sizeof(USB_TRACE_ENTRY);
+        info.Frozen = frozen;
+        info.CoreClock = SystemCoreClock;
+
+        USB_Transmit(0, (const unsigned char *)&info, MIN(sizeof(info), setup->Length));
+        return USB_OK;
+    case USB_TRACE_REQUEST_READ: {
+        if ((setup->RequestType & 0x80) == 0 || setup->Value >= USB_TRACE_SIZE) {
+            return USB_ERR;
+        }
+
+        // Only the contiguous part, the host asks again for the rest
+        unsigned short length = (USB_TRACE_SIZE - setup->Value) * sizeof(USB_TRACE_ENTRY);
+
+        USB_Transmit(0, (const unsigned char *)&ring[setup->Value], MIN(length, setup->Length));
+        return USB_OK;
+    }
+    }
+
+    return USB_ERR;
+}
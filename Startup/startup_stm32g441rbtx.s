@@ -63,6 +63,9 @@ Reset_Handler:
   ldr   r0, =_estack
   mov   sp, r0          /* set stack pointer */
 
+/* Start the cycle counter timing the boot phases */
+  bl  BOOT_Start
+
 /* Copy the data segment initializers from flash to SRAM */
   ldr r0, =_sdata
   ldr r1, =_edata
@@ -80,10 +83,39 @@ LoopCopyDataInit:
   cmp r4, r1
   bcc CopyDataInit
   
-/* Zero fill the bss segment. */
+/* Copy the CCM-SRAM code from flash */
+  ldr r0, =_sccmram
+  ldr r1, =_eccmram
+  ldr r2, =_siccmram
+  movs r3, #0
+  b	LoopCopyCcmInit
+
+CopyCcmInit:
+  ldr r4, [r2, r3]
+  str r4, [r0, r3]
+  adds r3, r3, #4
+
+LoopCopyCcmInit:
+  adds r4, r0, r3
+  cmp r4, r1
+  bcc CopyCcmInit
+
+/* Zero fill the bss segment, 16 bytes per store while they fit, the rest word by word */
   ldr r2, =_sbss
   ldr r4, =_ebss
   movs r3, #0
+  movs r5, #0
+  movs r6, #0
+  movs r7, #0
+  b LoopFillZerobss16
+
+FillZerobss16:
+  stmia r2!, {r3, r5, r6, r7}
+
+LoopFillZerobss16:
+  adds r1, r2, #16
+  cmp r1, r4
+  bls FillZerobss16
   b LoopFillZerobss
 
 FillZerobss:
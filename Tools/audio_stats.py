@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""Read the streaming counters of the audio interface (built with USB_AUDIO).
+
+The snapshot is fetched with the vendor request 0xA0 on EP0 while the host
+audio driver keeps streaming. With --interval the difference between two
+snapshots is printed as rates, --json prints the raw counters for scraping.
+The feedback is shown in frames per ms, 48.0 is exactly the nominal rate.
+
+    ./audio_stats.py
+    ./audio_stats.py --interval 10
+    ./audio_stats.py --json --clear
+"""
+
+import argparse
+import json
+import struct
+import sys
+import time
+
+REQUEST_STATS = 0xA0
+
+FIELDS = ("PlayPackets", "PlayFrames", "PlayUnderruns", "PlayOverruns", "CapturePackets", "CaptureFrames",
+          "CaptureShort", "CaptureOverruns", "SaiErrors", "Feedback", "PlayLevel", "SofJitter", "SofMaxJitter")
+STATS = struct.Struct("<10Ii2I")
+
+# Values that are a state, not a count
+LATEST = ("Feedback", "PlayLevel", "SofJitter", "SofMaxJitter")
+
+
+def read_stats(dev, clear=False):
+    data = bytes(dev.ctrl_transfer(0xC0, REQUEST_STATS, 1 if clear else 0, 0, STATS.size))
+    return dict(zip(FIELDS, STATS.unpack_from(data)))
+
+
+def difference(before, after):
+    return {k: after[k] if k in LATEST else (after[k] - before[k]) & 0xFFFFFFFF for k in FIELDS}
+
+
+def report(stats, seconds):
+    print("playback %d packets, %d frames, %d underruns, %d overruns, level %d frames" % (
+        stats["PlayPackets"], stats["PlayFrames"], stats["PlayUnderruns"], stats["PlayOverruns"], stats["PlayLevel"]))
+    print("capture  %d packets, %d frames, %d short, %d frames skipped" % (
+        stats["CapturePackets"], stats["CaptureFrames"], stats["CaptureShort"], stats["CaptureOverruns"]))
+    print("feedback %.4f frames/ms (%.1f Hz)" % (stats["Feedback"] / 16384, stats["Feedback"] / 16384 * 1000))
+    print("sai      %d fifo errors" % stats["SaiErrors"])
+    print("sof      jitter %d ns (max %d ns)" % (stats["SofJitter"], stats["SofMaxJitter"]))
+    if seconds:
+        print("rates    playback %.1f Hz, capture %.1f Hz" % (stats["PlayFrames"] / seconds, stats["CaptureFrames"] / seconds))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--vid", type=lambda x: int(x, 16), default=0x16C0, help="vendor id (hex)")
+    parser.add_argument("--pid", type=lambda x: int(x, 16), default=0x088B, help="product id (hex)")
+    parser.add_argument("--interval", type=float, help="print the rates over this many seconds")
+    parser.add_argument("--json", action="store_true", help="print the raw counters as JSON")
+    parser.add_argument("--clear", action="store_true", help="reset the counters after reading")
+    args = parser.parse_args()
+
+    import usb.core
+
+    dev = usb.core.find(idVendor=args.vid, idProduct=args.pid)
+    if dev is None:
+        raise SystemExit("device %04x:%04x not found" % (args.vid, args.pid))
+
+    stats = read_stats(dev, args.clear and not args.interval)
+    seconds = 0
+    if args.interval:
+        time.sleep(args.interval)
+        stats = difference(stats, read_stats(dev, args.clear))
+        seconds = args.interval
+
+    if args.json:
+        print(json.dumps(stats, indent=2))
+    else:
+        report(stats, seconds)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+"""Print how long the firmware took to reach each boot phase.
+
+The timestamps are read with the vendor request 0xE4 on EP0, in microseconds
+since reset (since the timebase start on the stm32f042, which has no cycle
+counter). Phases that were not reached yet are shown as '-'.
+
+    ./boot_time.py
+    ./boot_time.py --json
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+REQUEST_BOOT = 0xE4
+PHASES = ("main", "clock", "pullup", "reset", "setup", "address", "configured", "network")
+DESCRIPTIONS = {
+    "main": "startup code done, main entered",
+    "clock": "clock profile & timebase running",
+    "pullup": "D+ pull-up enabled",
+    "reset": "first bus reset",
+    "setup": "first SETUP packet",
+    "address": "SET_ADDRESS",
+    "configured": "SET_CONFIGURATION",
+    "network": "lwIP & NCM interface up",
+}
+
+
+def read_times(dev):
+    data = bytes(dev.ctrl_transfer(0xC0, REQUEST_BOOT, 0, 0, 4 * len(PHASES)))
+    return dict(zip(PHASES, struct.unpack_from("<%dI" % (len(data) // 4), data)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--vid", type=lambda x: int(x, 16), default=0xDEAD, help="vendor id (hex)")
+    parser.add_argument("--pid", type=lambda x: int(x, 16), default=0xBEEF, help="product id (hex)")
+    parser.add_argument("--json", action="store_true", help="print the raw timestamps as JSON")
+    args = parser.parse_args()
+
+    import usb.core
+
+    dev = usb.core.find(idVendor=args.vid, idProduct=args.pid)
+    if dev is None:
+        raise SystemExit("device %04x:%04x not found" % (args.vid, args.pid))
+
+    times = read_times(dev)
+    if args.json:
+        print(json.dumps(times, indent=2))
+        return 0
+
+    print("phase        at (us)   step (us)")
+    last = 0
+    for phase in PHASES:
+        at = times.get(phase, 0)
+        if not at:
+            print("%-10s %9s %11s  %s" % (phase, "-", "-", DESCRIPTIONS[phase]))
+            continue
+        print("%-10s %9d %11d  %s" % (phase, at, at - last, DESCRIPTIONS[phase]))
+        last = at
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+"""Soak test for the CDC to UART bridge (build with -DCDC_UART_BRIDGE=ON).
+
+Connect PC10 (TX) to PC11 (RX) of UART4. Everything written to the port then
+travels USB -> UART -> USB. A counter based pattern is written as fast as the
+port accepts it and every returned byte is checked, so a single lost or
+corrupted byte is reported with its offset. Afterwards the end-to-end latency
+of small writes is measured on the idle link.
+
+    ./cdc_soak.py /dev/ttyACM0 --baud 3000000 --time 60
+"""
+
+import argparse
+import sys
+import threading
+import time
+
+import serial
+
+BLOCK = 4096
+
+
+def pattern(offset, length):
+    # Period of 251 bytes, so a dropped block of any power of two size is detected
+    return bytes((offset + i) % 251 for i in range(length))
+
+
+class Soak:
+    def __init__(self, port, seconds):
+        self.port = port
+        self.seconds = seconds
+        self.written = 0
+        self.received = 0
+        self.error = None
+        self.done = False
+
+    def writer(self):
+        end = time.perf_counter() + self.seconds
+        while time.perf_counter() < end and self.error is None:
+            self.port.write(pattern(self.written, BLOCK))
+            self.written += BLOCK
+        self.done = True
+
+    def reader(self):
+        idle = None
+        while self.error is None:
+            data = self.port.read(max(1, self.port.in_waiting))
+            if data:
+                idle = None
+                if data != pattern(self.received, len(data)):
+                    expected = pattern(self.received, len(data))
+                    first = next(i for i in range(len(data)) if data[i] != expected[i])
+                    self.error = "mismatch at byte %d" % (self.received + first)
+                self.received += len(data)
+            elif self.done:
+                idle = idle or time.perf_counter()
+                if self.received >= self.written or time.perf_counter() - idle > 1.0:
+                    break
+
+    def run(self):
+        threads = [threading.Thread(target=self.writer), threading.Thread(target=self.reader)]
+        start = time.perf_counter()
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        return time.perf_counter() - start
+
+
+def latency(port, count, size):
+    samples = []
+    for i in range(count):
+        probe = pattern(i, size)
+        port.reset_input_buffer()
+        start = time.perf_counter()
+        port.write(probe)
+        data = b""
+        while len(data) < size:
+            chunk = port.read(size - len(data))
+            if not chunk:
+                break
+            data += chunk
+        if data == probe:
+            samples.append((time.perf_counter() - start) * 1e6)
+    return sorted(samples)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port", help="serial port of the device")
+    parser.add_argument("--baud", type=int, default=3000000, help="UART baudrate set by SET_LINE_CODING")
+    parser.add_argument("--time", type=int, default=30, help="soak duration in seconds")
+    parser.add_argument("--probes", type=int, default=200, help="number of latency probes")
+    parser.add_argument("--probe-size", type=int, default=16, help="bytes per latency probe")
+    args = parser.parse_args()
+
+    with serial.Serial(args.port, args.baud, timeout=0.2) as port:
+        port.reset_input_buffer()
+        soak = Soak(port, args.time)
+        elapsed = soak.run()
+
+        # The wire limits the rate: 10 bits per byte with 8N1
+        wire = args.baud / 10 / 1024
+        rate = soak.received / 1024 / elapsed
+        print("written             %12d bytes" % soak.written)
+        print("received            %12d bytes" % soak.received)
+        print("throughput          %12.1f KiB/s each way (%.1f %% of the wire)" % (rate, rate / wire * 100))
+        if soak.error:
+            print("FAILED              %s" % soak.error)
+            return 1
+        if soak.received != soak.written:
+            print("FAILED              %d bytes lost" % (soak.written - soak.received))
+            return 1
+
+        samples = latency(port, args.probes, args.probe_size)
+        if samples:
+            print("latency %4d B      %10.1f us min / %.1f us median / %.1f us max (%d/%d)" % (
+                args.probe_size, samples[0], samples[len(samples) // 2], samples[-1], len(samples), args.probes))
+        else:
+            print("latency             no replies")
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
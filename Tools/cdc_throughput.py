@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+"""Measure the sustained throughput of the CDC loopback (default firmware build).
+
+Everything written to the port comes back through CDC_Read / CDC_Write on the
+device. Data is written in chunks of the given sizes while a thread reads it
+back, the rate is taken over the whole payload once it returned completely.
+Needs pyserial.
+
+    ./cdc_throughput.py /dev/ttyACM0 --size 1M --chunks 1,16,64,512,4096
+"""
+
+import argparse
+import os
+import sys
+import threading
+import time
+
+import serial
+
+
+def parse_size(text):
+    units = {"K": 1024, "M": 1024 * 1024}
+    if text[-1].upper() in units:
+        return int(text[:-1]) * units[text[-1].upper()]
+    return int(text)
+
+
+def measure(port, total, chunk, timeout):
+    payload = os.urandom(total)
+    received = bytearray()
+
+    def reader():
+        deadline = time.perf_counter() + timeout
+        while len(received) < total and time.perf_counter() < deadline:
+            received.extend(port.read(max(1, port.in_waiting)))
+
+    port.reset_input_buffer()
+    thread = threading.Thread(target=reader)
+    start = time.perf_counter()
+    thread.start()
+
+    for offset in range(0, total, chunk):
+        port.write(payload[offset:offset + chunk])
+
+    thread.join()
+    elapsed = time.perf_counter() - start
+
+    return elapsed, bytes(received) == payload, len(received)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port", help="serial port of the device")
+    parser.add_argument("--size", default="256K", help="bytes per run, e.g. 1M")
+    parser.add_argument("--chunks", default="1,16,64,512,4096", help="comma separated write sizes")
+    parser.add_argument("--timeout", type=float, default=30.0, help="seconds per run")
+    args = parser.parse_args()
+
+    total = parse_size(args.size)
+
+    with serial.Serial(args.port, timeout=0.1) as port:
+        for chunk in (int(c) for c in args.chunks.split(",")):
+            # Tiny writes take ages, scale the payload down so every run takes about as long
+            size = total if chunk >= 64 else max(total * chunk // 64, chunk)
+            elapsed, ok, count = measure(port, size, chunk, args.timeout)
+            print("write %5d B  %8.1f KiB/s  %s" % (
+                chunk, count / 1024 / elapsed, "ok" if ok else "MISMATCH (%d/%d bytes)" % (count, size)))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+"""Check that a DMX universe written over HID is published as one frame (built with DMX).
+
+Every round sends a random 512 channel frame as 16 output reports of 32
+channels, only the last one carries the commit flag. Halfway through and
+after the commit the state of the universe is read with GET_REPORT (feature,
+report ID = universe): the update counter must not move before the commit and
+must advance by exactly one afterwards, and the checksum of the published
+frame must match the frame that was sent. Any other input writing the same
+universe meanwhile (Art-Net, sACN, Enttec) makes the check fail.
+
+The HID driver of the host is detached from the interface while it runs.
+
+    ./dmx_hid_check.py
+    ./dmx_hid_check.py --universe 1 --rounds 500
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+GET_REPORT = 0x01
+FEATURE = 3
+CHANNELS = 512
+BLOCK = 32
+COMMIT = 0x80
+
+STATUS = struct.Struct("<IHH")
+
+
+def fletcher16(data):
+    sum1 = sum2 = 0
+    for value in data:
+        sum1 = (sum1 + value) % 255
+        sum2 = (sum2 + sum1) % 255
+    return sum2 << 8 | sum1
+
+
+def find_hid(dev):
+    # The HID function may be one of several in the composite device
+    for interface in dev.get_active_configuration():
+        if interface.bInterfaceClass == 3:
+            for ep in interface:
+                if ep.bEndpointAddress & 0x80 == 0:
+                    return interface.bInterfaceNumber, ep.bEndpointAddress
+    raise SystemExit("no HID interface with an OUT endpoint found")
+
+
+def read_status(dev, interface, universe):
+    data = bytes(dev.ctrl_transfer(0xA1, GET_REPORT, FEATURE << 8 | universe, interface, STATUS.size))
+    return STATUS.unpack_from(data)
+
+
+def check_round(dev, interface, ep, universe):
+    frame = os.urandom(CHANNELS)
+    updates, _, _ = read_status(dev, interface, universe)
+
+    for block in range(CHANNELS // BLOCK):
+        header = universe << 4 | block
+        if block == CHANNELS // BLOCK - 1:
+            header |= COMMIT
+        dev.write(ep, bytes([header]) + frame[block * BLOCK:(block + 1) * BLOCK])
+
+        if block == CHANNELS // BLOCK // 2:
+            if read_status(dev, interface, universe)[0] != updates:
+                return "published before the commit"
+
+    after, length, checksum = read_status(dev, interface, universe)
+    if (after - updates) & 0xFFFFFFFF != 1:
+        return "%d updates instead of one" % ((after - updates) & 0xFFFFFFFF)
+    if length != CHANNELS:
+        return "published %d channels instead of %d" % (length, CHANNELS)
+    if checksum != fletcher16(frame):
+        return "checksum %04x instead of %04x" % (checksum, fletcher16(frame))
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--vid", type=lambda x: int(x, 16), default=0xDEAD, help="vendor id (hex)")
+    parser.add_argument("--pid", type=lambda x: int(x, 16), default=0xBEEF, help="product id (hex)")
+    parser.add_argument("--universe", type=int, default=0, help="universe slot to write (0 - 7)")
+    parser.add_argument("--rounds", type=int, default=100, help="number of frames to send")
+    args = parser.parse_args()
+
+    import usb.core
+
+    dev = usb.core.find(idVendor=args.vid, idProduct=args.pid)
+    if dev is None:
+        raise SystemExit("device %04x:%04x not found" % (args.vid, args.pid))
+
+    interface, ep = find_hid(dev)
+    if dev.is_kernel_driver_active(interface):
+        dev.detach_kernel_driver(interface)
+
+    failures = 0
+    for i in range(args.rounds):
+        error = check_round(dev, interface, ep, args.universe)
+        if error:
+            failures += 1
+            print("round %d: %s" % (i, error))
+
+    print("%d of %d frames published consistently" % (args.rounds - failures, args.rounds))
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
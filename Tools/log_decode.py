@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""Decode the binary log of the firmware (build with -DUSB_LOG=ON).
+
+The device only sends the ID of a format string and its raw arguments. The
+strings are taken from the .logstr section of the ELF the firmware was built
+from, so both have to match. The log is drained over the last CDC port.
+
+    ./log_decode.py build/stm32g474 /dev/ttyACM1
+    ./log_decode.py build/stm32g474 capture.bin
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+MAGIC = 0x474F4C53
+BATCH_HEADER = struct.Struct("<IIII")
+VALID = 0x80000000
+CONVERSION = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(?:hh|h|ll|l|z|t)?([diuxXoc%p])")
+
+
+def read_strings(path):
+    # Just enough ELF parsing to find .logstr, so no dependencies are needed
+    with open(path, "rb") as f:
+        elf = f.read()
+
+    if elf[:4] != b"\x7fELF" or elf[4] != 1:
+        raise ValueError("%s is not a 32 bit ELF" % path)
+
+    shoff, = struct.unpack_from("<I", elf, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from("<HHH", elf, 0x2E)
+
+    def section(index):
+        return struct.unpack_from("<IIIIIIIIII", elf, shoff + index * shentsize)
+
+    names = section(shstrndx)
+    for i in range(shnum):
+        name, _, _, addr, offset, size = section(i)[:6]
+        end = elf.index(b"\0", names[4] + name)
+        if elf[names[4] + name:end] == b".logstr":
+            return addr, elf[offset:offset + size]
+
+    raise ValueError("%s has no .logstr section, was it built with USB_LOG?" % path)
+
+
+def format_message(text, args):
+    index = 0
+
+    def replace(match):
+        nonlocal index
+        flags, kind = match.groups()
+        if kind == "%":
+            return "%"
+        if index >= len(args):
+            return "<missing>"
+
+        value = args[index]
+        index += 1
+        if kind in "di":
+            value = value - (1 << 32) if value & 0x80000000 else value
+            kind = "d"
+        elif kind == "u":
+            kind = "d"
+        elif kind == "p":
+            flags, kind = "#", "x"
+        return ("%" + flags + kind) % value
+
+    return CONVERSION.sub(replace, text)
+
+
+class Decoder:
+    def __init__(self, base, strings):
+        self.base = base
+        self.strings = strings
+        self.buffer = b""
+        self.last = None
+        self.high = 0
+
+    def string(self, id):
+        offset = id - (self.base & 0xFFFF)
+        if offset < 0 or offset >= len(self.strings):
+            return "<unknown id %d>" % id
+        return self.strings[offset:self.strings.index(b"\0", offset)].decode("utf-8", "replace")
+
+    def timestamp(self, cycles, clock):
+        # Extend the 32 bit cycle counter, batches are drained far more often than it wraps
+        if self.last is not None and cycles < self.last:
+            self.high += 1 << 32
+        self.last = cycles
+        return (self.high + cycles) / clock
+
+    def feed(self, data):
+        self.buffer += data
+        lines = []
+
+        while True:
+            start = self.buffer.find(struct.pack("<I", MAGIC))
+            if start < 0:
+                self.buffer = self.buffer[-3:]
+                return lines
+
+            self.buffer = self.buffer[start:]
+            if len(self.buffer) < BATCH_HEADER.size:
+                return lines
+
+            _, length, dropped, clock = BATCH_HEADER.unpack_from(self.buffer)
+            if len(self.buffer) < BATCH_HEADER.size + length:
+                return lines
+
+            if dropped:
+                lines.append("*** %d records dropped" % dropped)
+
+            words = struct.unpack_from("<%dI" % (length // 4), self.buffer, BATCH_HEADER.size)
+            self.buffer = self.buffer[BATCH_HEADER.size + length:]
+
+            i = 0
+            while i + 1 < len(words):
+                header = words[i]
+                count = (header >> 16) & 0x07
+                if not header & VALID:
+                    lines.append("*** corrupted batch")
+                    break
+
+                args = words[i + 2:i + 2 + count]
+                text = format_message(self.string(header & 0xFFFF), args)
+                lines.append("%12.6f %s" % (self.timestamp(words[i + 1], clock or 1), text))
+                i += 2 + count
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("elf", help="firmware ELF the device runs")
+    parser.add_argument("source", help="serial port of the log or a captured file")
+    args = parser.parse_args()
+
+    decoder = Decoder(*read_strings(args.elf))
+
+    if os.path.isfile(args.source):
+        with open(args.source, "rb") as f:
+            for line in decoder.feed(f.read()):
+                print(line)
+        return 0
+
+    import serial
+
+    with serial.Serial(args.source, timeout=0.1) as port:
+        try:
+            while True:
+                for line in decoder.feed(port.read(4096)):
+                    print(line, flush=True)
+        except KeyboardInterrupt:
+            pass
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""Measure the event rate and round trip latency of the MIDI firmware (built with USB_MIDI).
+
+The firmware echoes every event it receives. The latency test sends single
+note-on events and times their echo, the throughput test keeps the OUT
+endpoint busy with full packets of 16 events from a second thread and checks
+that the echo comes back complete and in order. Afterwards the counters of
+the MIDI function are read with the vendor request 0xA1.
+
+The host MIDI driver is detached from the interfaces while the test runs.
+
+    ./midi_bench.py
+    ./midi_bench.py --latency 2000 --time 10
+    ./midi_bench.py --json
+"""
+
+import argparse
+import json
+import struct
+import sys
+import threading
+import time
+
+REQUEST_STATS = 0xA1
+EP_OUT = 0x01
+EP_IN = 0x81
+PACKET_EVENTS = 16
+
+FIELDS = ("RxEvents", "RxPackets", "TxEvents", "TxPackets", "TxFull", "TxFlushed", "Dropped", "MaxQueued")
+STATS = struct.Struct("<%dI" % len(FIELDS))
+
+
+def event(sequence):
+    # Note on, cable 0, the sequence number in note & velocity. The velocity is never 0 so no event is empty
+    return struct.pack("<BBBB", 0x09, 0x90, sequence & 0x7F, 1 + ((sequence >> 7) % 127))
+
+
+def read_stats(dev, clear=False):
+    data = bytes(dev.ctrl_transfer(0xC0, REQUEST_STATS, 1 if clear else 0, 0, STATS.size))
+    return dict(zip(FIELDS, STATS.unpack_from(data)))
+
+
+def read_events(dev, timeout):
+    data = bytes(dev.read(EP_IN, 64, timeout))
+    return [data[i:i + 4] for i in range(0, len(data) - 3, 4)]
+
+
+def latency(dev, count):
+    times = []
+    for i in range(count):
+        packet = event(i)
+        start = time.perf_counter()
+        dev.write(EP_OUT, packet, 1000)
+
+        while True:
+            if packet in read_events(dev, 1000):
+                break
+
+        times.append((time.perf_counter() - start) * 1e6)
+
+    times.sort()
+    return {"Count": count, "Min": times[0], "Avg": sum(times) / count, "P99": times[int(count * 0.99) - 1], "Max": times[-1]}
+
+
+def throughput(dev, seconds):
+    import usb.core
+
+    result = {"Sent": 0, "Received": 0, "OutOfOrder": 0}
+    running = True
+
+    def writer():
+        sequence = 0
+        while running:
+            dev.write(EP_OUT, b"".join(event(sequence + i) for i in range(PACKET_EVENTS)), 1000)
+            sequence += PACKET_EVENTS
+        result["Sent"] = sequence
+
+    thread = threading.Thread(target=writer)
+    start = time.perf_counter()
+    thread.start()
+
+    expected = 0
+    while time.perf_counter() - start < seconds:
+        try:
+            for e in read_events(dev, 100):
+                if e != event(expected):
+                    result["OutOfOrder"] += 1
+                expected += 1
+        except usb.core.USBTimeoutError:
+            pass
+
+    running = False
+    thread.join()
+
+    # Collect what is still on the way
+    try:
+        while True:
+            expected += len(read_events(dev, 100))
+    except usb.core.USBTimeoutError:
+        pass
+
+    elapsed = time.perf_counter() - start
+    result["Received"] = expected
+    result["Seconds"] = elapsed
+    result["EventsPerSecond"] = expected / elapsed
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--vid", type=lambda x: int(x, 16), default=0xDEAD, help="vendor id (hex)")
+    parser.add_argument("--pid", type=lambda x: int(x, 16), default=0xBEEF, help="product id (hex)")
+    parser.add_argument("--latency", type=int, default=1000, help="number of single events to time")
+    parser.add_argument("--time", type=float, default=5, help="seconds of the throughput test")
+    parser.add_argument("--json", action="store_true", help="print the results as JSON")
+    args = parser.parse_args()
+
+    import usb.core
+
+    dev = usb.core.find(idVendor=args.vid, idProduct=args.pid)
+    if dev is None:
+        raise SystemExit("device %04x:%04x not found" % (args.vid, args.pid))
+
+    for interface in (0, 1):
+        if dev.is_kernel_driver_active(interface):
+            dev.detach_kernel_driver(interface)
+
+    read_stats(dev, True)
+    results = {"Latency": latency(dev, args.latency), "Throughput": throughput(dev, args.time), "Stats": read_stats(dev)}
+
+    if args.json:
+        print(json.dumps(results, indent=2))
+    else:
+        l, t, s = results["Latency"], results["Throughput"], results["Stats"]
+        print("latency    %d events, min %.0f us, avg %.0f us, p99 %.0f us, max %.0f us" % (
+            l["Count"], l["Min"], l["Avg"], l["P99"], l["Max"]))
+        print("throughput %.0f events/s, %d sent, %d received, %d out of order" % (
+            t["EventsPerSecond"], t["Sent"], t["Received"], t["OutOfOrder"]))
+        print("device     rx %d events in %d packets, tx %d events in %d packets (%d full, %d by the timer)" % (
+            s["RxEvents"], s["RxPackets"], s["TxEvents"], s["TxPackets"], s["TxFull"], s["TxFlushed"]))
+        print("           %d dropped, at most %d queued" % (s["Dropped"], s["MaxQueued"]))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
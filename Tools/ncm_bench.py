@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+"""Drive the NCM benchmark mode of the firmware (build with -DNCM_BENCHMARK=ON).
+
+Runs iperf2 against the lwiperf server (TCP 5001), optionally floods the UDP
+sink (port 9), measures the UDP echo round trip (port 7) and prints the NCM
+counters read from the stats port (UDP 5002) as rates for the test window.
+With --raw the round trip of raw ethernet frames (EtherType 0x88B5), which
+bypass lwIP on the device, is measured as well (Linux, needs CAP_NET_RAW).
+With --memory the device measures its memcpy / memset against a byte loop.
+
+    ./ncm_bench.py 169.254.12.34 --time 10 --udp 8M
+    ./ncm_bench.py 169.254.12.34 --raw usb0
+    ./ncm_bench.py 169.254.12.34 --memory
+"""
+
+import argparse
+import socket
+import struct
+import subprocess
+import sys
+import time
+
+STATS_PORT = 5002
+ECHO_PORT = 7
+SINK_PORT = 9
+RAW_ETHERTYPE = 0x88B5
+
+STATS_FIELDS = (
+    "Uptime", "CoreClock",
+    "RxNtbs", "RxDatagrams", "RxDrops", "TxNtbs", "TxDatagrams",
+    "IsrCalls", "IsrCycles", "IsrMaxCycles", "CopyCycles", "CopyBytes",
+    "UdpEchoed", "UdpSunk", "UdpSinkBytes",
+    "IperfBytes", "IperfMs", "IperfKbps",
+    "RawEchoed",
+    "ClockProfile", "FlashLatency",
+)
+CLOCK_PROFILES = {1: "low", 2: "balanced", 3: "performance"}
+STATS_FORMAT = "<" + "I" * len(STATS_FIELDS)
+MEMORY_ROW = struct.Struct("<HBBII")
+MEMSET = 0xFF
+
+
+def read_stats(host, reset=False, timeout=1.0):
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        sock.settimeout(timeout)
+        sock.sendto(b"R" if reset else b"S", (host, STATS_PORT))
+        data, _ = sock.recvfrom(512)
+
+    return dict(zip(STATS_FIELDS, struct.unpack_from(STATS_FORMAT, data)))
+
+
+def read_memory(host, timeout=2.0):
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        sock.settimeout(timeout)
+        sock.sendto(b"M", (host, STATS_PORT))
+        data, _ = sock.recvfrom(2048)
+
+    return [MEMORY_ROW.unpack_from(data, i) for i in range(0, len(data) - MEMORY_ROW.size + 1, MEMORY_ROW.size)]
+
+
+def print_memory(rows):
+    print("%-7s %5s %4s %4s %10s %10s %8s %8s" % ("", "size", "dst", "src", "cycles", "byte loop", "B/cycle", "speedup"))
+    for size, dst, src, cycles, reference in rows:
+        print("%-7s %5d %4d %4s %10d %10d %8.2f %7.1fx" % (
+            "memset" if src == MEMSET else "memcpy", size, dst, "-" if src == MEMSET else src,
+            cycles, reference, size / cycles if cycles else 0, reference / cycles if cycles else 0))
+
+
+def echo_rtt(host, count, size, timeout=0.5):
+    samples = []
+    payload = bytes(range(256)) * (size // 256 + 1)
+    payload = payload[:size]
+
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        sock.settimeout(timeout)
+        for _ in range(count):
+            start = time.perf_counter()
+            sock.sendto(payload, (host, ECHO_PORT))
+            try:
+                data, _ = sock.recvfrom(2048)
+            except socket.timeout:
+                continue
+            if data == payload:
+                samples.append((time.perf_counter() - start) * 1e6)
+
+    return samples
+
+
+def raw_rtt(iface, count, size, timeout=0.5):
+    samples = []
+    payload = bytes(range(256)) * (size // 256 + 1)
+    payload = payload[:size]
+
+    with socket.socket(socket.AF_PACKET, socket.SOCK_RAW, socket.htons(RAW_ETHERTYPE)) as sock:
+        sock.bind((iface, RAW_ETHERTYPE))
+        sock.settimeout(timeout)
+        own = sock.getsockname()[4]
+        # The device answers to whoever sent the frame, broadcast saves resolving its MAC
+        header = b"\xff" * 6 + own + struct.pack("!H", RAW_ETHERTYPE)
+
+        for _ in range(count):
+            start = time.perf_counter()
+            sock.send(header + payload)
+            try:
+                while True:
+                    data = sock.recv(2048)
+                    if data[:6] == own and data[14:14 + size] == payload:
+                        break
+            except socket.timeout:
+                continue
+            samples.append((time.perf_counter() - start) * 1e6)
+
+    return samples
+
+
+def print_rtt(name, samples, count):
+    if samples:
+        print("%-19s %10.1f us min / %.1f us median / %.1f us max (%d/%d)" % (
+            name, samples[0], samples[len(samples) // 2], samples[-1], len(samples), count))
+    else:
+        print("%-19s no replies" % name)
+
+
+def run_iperf(host, args):
+    cmd = [args.iperf, "-c", host, "-t", str(args.time), "-i", "1", "-f", "k"]
+    print("$ " + " ".join(cmd))
+    subprocess.run(cmd, check=False)
+
+    if args.udp:
+        cmd = [args.iperf, "-c", host, "-u", "-p", str(SINK_PORT), "-b", args.udp, "-t", str(args.time), "-l", str(args.length)]
+        print("$ " + " ".join(cmd))
+        # The sink never answers, so iperf will complain about the missing server report
+        subprocess.run(cmd, check=False)
+
+
+def report(before, after):
+    delta = {k: (after[k] - before[k]) & 0xFFFFFFFF for k in STATS_FIELDS}
+    profile = CLOCK_PROFILES.get(after["ClockProfile"], "unknown")
+    seconds = max(delta["Uptime"], 1) / 1000.0
+    mhz = after["CoreClock"] / 1e6 or 1
+
+    def per(a, b):
+        return a / b if b else 0.0
+
+    print()
+    print("window              %10.2f s @ %.2f MHz (%s, %d ws)" % (seconds, mhz, profile, after["FlashLatency"]))
+    print("rx NTB/s            %10.1f" % (delta["RxNtbs"] / seconds))
+    print("rx datagrams/NTB    %10.2f" % per(delta["RxDatagrams"], delta["RxNtbs"]))
+    print("rx drops            %10d" % delta["RxDrops"])
+    print("tx NTB/s            %10.1f" % (delta["TxNtbs"] / seconds))
+    print("tx datagrams/NTB    %10.2f" % per(delta["TxDatagrams"], delta["TxNtbs"]))
+    print("isr avg             %10.2f us" % (per(delta["IsrCycles"], delta["IsrCalls"]) / mhz))
+    print("isr max             %10.2f us" % (after["IsrMaxCycles"] / mhz))
+    print("isr load            %10.2f %%" % (delta["IsrCycles"] / mhz / seconds / 1e4))
+    print("copy                %10.2f cycles/byte" % per(delta["CopyCycles"], delta["CopyBytes"]))
+    print("copy load           %10.2f %%" % (delta["CopyCycles"] / mhz / seconds / 1e4))
+    print("udp sink            %10.1f kbit/s" % (delta["UdpSinkBytes"] * 8 / 1000 / seconds))
+    if after["IperfMs"]:
+        print("last iperf (device) %10d kbit/s" % after["IperfKbps"])
+        print("  per MHz           %10.1f kbit/s" % (after["IperfKbps"] / mhz))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host", help="IP address of the device")
+    parser.add_argument("--time", type=int, default=10, help="iperf duration in seconds")
+    parser.add_argument("--udp", metavar="RATE", help="additionally flood the UDP sink at this iperf rate, e.g. 8M")
+    parser.add_argument("--length", type=int, default=1470, help="UDP datagram length")
+    parser.add_argument("--echo", type=int, default=100, help="number of UDP echo round trips")
+    parser.add_argument("--raw", metavar="IFACE", help="measure the raw ethernet echo on this interface")
+    parser.add_argument("--iperf", default="iperf", help="iperf2 binary")
+    parser.add_argument("--stats-only", action="store_true", help="only dump the raw counters")
+    parser.add_argument("--memory", action="store_true", help="only run the memcpy / memset benchmark")
+    args = parser.parse_args()
+
+    if args.memory:
+        print_memory(read_memory(args.host))
+        return 0
+
+    if args.stats_only:
+        for key, value in read_stats(args.host).items():
+            print("%-14s %d" % (key, value))
+        return 0
+
+    read_stats(args.host, reset=True)
+    before = read_stats(args.host)
+    run_iperf(args.host, args)
+    after = read_stats(args.host)
+    report(before, after)
+
+    if args.echo:
+        print_rtt("udp echo rtt", sorted(echo_rtt(args.host, args.echo, 64)), args.echo)
+        if args.raw:
+            print_rtt("raw echo rtt", sorted(raw_rtt(args.raw, args.echo, 64)), args.echo)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""Read the sampling profiler of the firmware (build with -DPROFILER=ON).
+
+The histogram of interrupted PC / LR pairs is read with the vendor request
+0xE3 on EP0 (sampling is paused meanwhile) and symbolized against the ELF.
+Prints the hottest functions and writes the samples as folded stacks
+(caller;function count), which flamegraph.pl or speedscope turn into a
+flame graph. The caller comes from LR and is only exact for leaf functions.
+
+    ./pc_profile.py build/stm32g474 --clear --time 10 --folded ncm.folded
+    flamegraph.pl ncm.folded > ncm.svg
+"""
+
+import argparse
+import bisect
+import collections
+import struct
+import sys
+import time
+
+REQUEST = 0xE3
+INFO_INDEX = 0xFFFF
+STOP, START, CLEAR = 0, 1, 2
+INFO = struct.Struct("<IIHHIB")
+SLOT = struct.Struct("<III")
+
+
+class Symbols:
+    def __init__(self, path):
+        # Function symbols from .symtab, no toolchain needed
+        with open(path, "rb") as f:
+            elf = f.read()
+
+        if elf[:4] != b"\x7fELF" or elf[4] != 1:
+            raise ValueError("%s is not a 32 bit ELF" % path)
+
+        shoff, = struct.unpack_from("<I", elf, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", elf, 0x2E)
+        sections = [struct.unpack_from("<IIIIIIIIII", elf, shoff + i * shentsize) for i in range(shnum)]
+
+        functions = []
+        for section in sections:
+            if section[1] != 2:  # SHT_SYMTAB
+                continue
+            strtab = sections[section[6]]
+            for offset in range(section[4], section[4] + section[5], 16):
+                name, value, size, info = struct.unpack_from("<IIIB", elf, offset)
+                if info & 0x0F == 2 and value:  # STT_FUNC
+                    start = strtab[4] + name
+                    functions.append((value & ~1, size, elf[start:elf.index(b"\0", start)].decode()))
+
+        functions.sort()
+        self.starts = [f[0] for f in functions]
+        self.functions = functions
+
+    def lookup(self, address):
+        if address >= 0xFFFFFFE0:
+            return "[exception return]"
+
+        address &= ~1
+        index = bisect.bisect_right(self.starts, address) - 1
+        if index >= 0:
+            start, size, name = self.functions[index]
+            if address < start + max(size, 2):
+                return name
+        return "0x%08x" % address
+
+
+def control(dev, value):
+    dev.ctrl_transfer(0x40, REQUEST, value, 0)
+
+
+def read_profile(dev):
+    control(dev, STOP)
+    try:
+        samples, lost, count, rate, clock, _ = INFO.unpack(dev.ctrl_transfer(0xC0, REQUEST, INFO_INDEX, 0, INFO.size))
+        data = b""
+        while len(data) < count * SLOT.size:
+            data += bytes(dev.ctrl_transfer(0xC0, REQUEST, len(data) // SLOT.size, 0, count * SLOT.size - len(data)))
+    finally:
+        control(dev, START)
+
+    slots = [SLOT.unpack_from(data, i * SLOT.size) for i in range(count)]
+    return samples, lost, rate, [s for s in slots if s[2]]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("elf", help="firmware ELF the device runs")
+    parser.add_argument("--vid", type=lambda x: int(x, 16), default=0xDEAD, help="vendor id (hex)")
+    parser.add_argument("--pid", type=lambda x: int(x, 16), default=0xBEEF, help="product id (hex)")
+    parser.add_argument("--clear", action="store_true", help="clear the histogram first")
+    parser.add_argument("--time", type=float, default=0, help="seconds to sample after clearing")
+    parser.add_argument("--top", type=int, default=25, help="number of functions to list")
+    parser.add_argument("--folded", metavar="FILE", help="write folded stacks for flamegraph.pl")
+    args = parser.parse_args()
+
+    import usb.core
+
+    dev = usb.core.find(idVendor=args.vid, idProduct=args.pid)
+    if dev is None:
+        raise SystemExit("device %04x:%04x not found" % (args.vid, args.pid))
+
+    if args.clear:
+        control(dev, CLEAR)
+        time.sleep(args.time)
+
+    symbols = Symbols(args.elf)
+    samples, lost, rate, slots = read_profile(dev)
+
+    flat = collections.Counter()
+    folded = collections.Counter()
+    for pc, lr, count in slots:
+        function = symbols.lookup(pc)
+        caller = symbols.lookup(lr)
+        flat[function] += count
+        folded["%s;%s" % (caller, function) if caller != function else function] += count
+
+    total = sum(flat.values()) or 1
+    print("%d samples @ %d Hz (%.1f s), %d lost for lack of slots" % (samples, rate, samples / rate, lost))
+    for function, count in flat.most_common(args.top):
+        print("%6.2f %%  %7d  %s" % (count * 100.0 / total, count, function))
+
+    if args.folded:
+        with open(args.folded, "w") as f:
+            for stack, count in sorted(folded.items()):
+                f.write("%s %d\n" % (stack, count))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
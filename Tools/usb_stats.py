@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""Read the USB counters of the firmware (built with USB_STATS, the default).
+
+The snapshot is fetched with the vendor request 0xE2 on EP0, which works for
+every implementation. With --interval the difference between two snapshots
+is printed as rates, --json prints the raw counters for scraping.
+
+    ./usb_stats.py
+    ./usb_stats.py --interval 5
+    ./usb_stats.py --json --clear
+"""
+
+import argparse
+import json
+import struct
+import sys
+import time
+
+REQUEST_STATS = 0xE2
+ENDPOINTS = 8
+
+BUS_FIELDS = ("Resets", "Suspends", "Wakeups", "Errors", "Overruns", "MissedSofs", "Irqs", "IrqCycles", "IrqMaxCycles",
+              "L1Sleeps", "RemoteWakeups", "WakeLatency", "WakeMaxLatency")
+EP_FIELDS = ("RxBytes", "RxPackets", "RxZlps", "TxBytes", "TxPackets", "TxZlps", "Completions", "Naks",
+             "IsrCalls", "IsrCycles", "IsrMaxCycles", "MaxQueued", "Reserved")
+BUS = struct.Struct("<%dI" % len(BUS_FIELDS))
+EP = struct.Struct("<11IHH")
+
+
+def read_stats(dev, clear=False):
+    data = bytes(dev.ctrl_transfer(0xC0, REQUEST_STATS, 1 if clear else 0, 0, BUS.size + ENDPOINTS * EP.size))
+    stats = dict(zip(BUS_FIELDS, BUS.unpack_from(data)))
+    stats["Endpoints"] = [dict(zip(EP_FIELDS, EP.unpack_from(data, BUS.size + i * EP.size))) for i in range(ENDPOINTS)]
+    return stats
+
+
+def difference(before, after):
+    # Max values & high-water marks are not summed up, keep the latest
+    def sub(a, b, keep):
+        return {k: b[k] if k in keep else (b[k] - a[k]) & 0xFFFFFFFF for k in a}
+
+    delta = sub({k: before[k] for k in BUS_FIELDS}, {k: after[k] for k in BUS_FIELDS}, ("IrqMaxCycles", "WakeLatency", "WakeMaxLatency"))
+    delta["Endpoints"] = [sub(a, b, ("IsrMaxCycles", "MaxQueued")) for a, b in zip(before["Endpoints"], after["Endpoints"])]
+    return delta
+
+
+def report(stats, seconds, mhz):
+    def per(a, b):
+        return a / b if b else 0.0
+
+    print("bus   resets %d, suspends %d, wakeups %d, errors %d, overruns %d, missed sofs %d" % (
+        stats["Resets"], stats["Suspends"], stats["Wakeups"], stats["Errors"], stats["Overruns"], stats["MissedSofs"]))
+    print("power l1 sleeps %d, remote wakeups %d, wake to SOF %d us (max %d us)" % (
+        stats["L1Sleeps"], stats["RemoteWakeups"], stats["WakeLatency"], stats["WakeMaxLatency"]))
+    print("irq   %d calls, avg %.2f us, max %.2f us" % (
+        stats["Irqs"], per(stats["IrqCycles"], stats["Irqs"]) / mhz, stats["IrqMaxCycles"] / mhz))
+    if seconds:
+        print("      load %.2f %%" % (stats["IrqCycles"] / mhz / seconds / 1e4))
+
+    print()
+    print("ep    rx bytes  rx pkts  zlp    tx bytes  tx pkts  zlp    done   naks   isr avg   isr max  max queued")
+    for ep, e in enumerate(stats["Endpoints"]):
+        if not e["IsrCalls"] and not e["MaxQueued"]:
+            continue
+        print("%-3d %10d %8d %4d %11d %8d %4d %7d %6d %7.2fus %7.2fus %10d" % (
+            ep, e["RxBytes"], e["RxPackets"], e["RxZlps"], e["TxBytes"], e["TxPackets"], e["TxZlps"],
+            e["Completions"], e["Naks"], per(e["IsrCycles"], e["IsrCalls"]) / mhz, e["IsrMaxCycles"] / mhz, e["MaxQueued"]))
+        if seconds:
+            print("    %7.1f kB/s %7.1f/s       %8.1f kB/s %7.1f/s" % (
+                e["RxBytes"] / seconds / 1e3, e["RxPackets"] / seconds, e["TxBytes"] / seconds / 1e3, e["TxPackets"] / seconds))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--vid", type=lambda x: int(x, 16), default=0xDEAD, help="vendor id (hex)")
+    parser.add_argument("--pid", type=lambda x: int(x, 16), default=0xBEEF, help="product id (hex)")
+    parser.add_argument("--interval", type=float, help="print the rates over this many seconds")
+    parser.add_argument("--mhz", type=float, default=71.875, help="core clock to convert cycles")
+    parser.add_argument("--json", action="store_true", help="print the raw counters as JSON")
+    parser.add_argument("--clear", action="store_true", help="reset the counters after reading")
+    args = parser.parse_args()
+
+    import usb.core
+
+    dev = usb.core.find(idVendor=args.vid, idProduct=args.pid)
+    if dev is None:
+        raise SystemExit("device %04x:%04x not found" % (args.vid, args.pid))
+
+    stats = read_stats(dev, args.clear and not args.interval)
+    seconds = 0
+    if args.interval:
+        time.sleep(args.interval)
+        stats = difference(stats, read_stats(dev, args.clear))
+        seconds = args.interval
+
+    if args.json:
+        print(json.dumps(stats, indent=2))
+    else:
+        report(stats, seconds, args.mhz)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+"""Read the USB event trace of the firmware (build with -DUSB_TRACE=ON).
+
+The trace is frozen, read over the vendor requests 0xE0 / 0xE1 on EP0 and
+resumed afterwards. Prints the timeline of the newest events and histograms
+of how long the ISR took to reach each event and how long the class
+callbacks ran. Needs pyusb and access to the device.
+
+    ./usb_trace.py --last 100
+    ./usb_trace.py --save trace.bin
+    ./usb_trace.py --load trace.bin --no-timeline
+"""
+
+import argparse
+import collections
+import struct
+import sys
+
+REQUEST_INFO = 0xE0
+REQUEST_READ = 0xE1
+INFO = struct.Struct("<IHBBI")
+ENTRY = struct.Struct("<IBBH")
+
+EVENTS = {
+    1: "IRQ", 2: "RESET", 3: "SETUP", 4: "CTR_RX", 5: "CTR_TX",
+    6: "PREPARE", 7: "CALLBACK", 8: "RETURN", 9: "SUSPEND", 10: "WAKEUP",
+    11: "L1", 12: "RESUME", 13: "DEFER", 14: "COMPLETE",
+}
+
+
+def read_trace(vid, pid):
+    import usb.core
+
+    dev = usb.core.find(idVendor=vid, idProduct=pid)
+    if dev is None:
+        raise SystemExit("device %04x:%04x not found" % (vid, pid))
+
+    written, size, entry_size, _, clock = INFO.unpack(dev.ctrl_transfer(0xC0, REQUEST_INFO, 0, 0, INFO.size))
+    try:
+        data = b""
+        while len(data) < size * entry_size:
+            data += bytes(dev.ctrl_transfer(0xC0, REQUEST_READ, len(data) // entry_size, 0, size * entry_size - len(data)))
+    finally:
+        dev.ctrl_transfer(0x40, REQUEST_INFO, 0, 0)
+
+    return written, size, clock, data
+
+
+def ordered(written, size, data):
+    # Oldest event first, the ring only holds the last <size> events
+    entries = [ENTRY.unpack_from(data, i * ENTRY.size) for i in range(size)]
+    if written <= size:
+        return entries[:written]
+    start = written % size
+    return entries[start:] + entries[:start]
+
+
+def describe(event, ep, value):
+    name = EVENTS.get(event, "EVENT%d" % event)
+    if event == 3:
+        return "%-8s type %02x request %02x" % (name, value & 0xFF, value >> 8)
+    if event in (7, 8):
+        return "%-8s ep%d %s" % (name, ep, "tx" if value else "rx")
+    if event == 1:
+        return "%-8s istr %04x" % (name, value)
+    if event in (2, 9, 10):
+        return name
+    return "%-8s ep%d %d" % (name, ep, value)
+
+
+def timeline(entries, clock, last):
+    first = entries[0][0] if entries else 0
+    previous = first
+    for cycles, event, ep, value in entries[-last:]:
+        print("%12.2f us  +%9.2f us  %s" % (
+            ((cycles - first) & 0xFFFFFFFF) * 1e6 / clock,
+            ((cycles - previous) & 0xFFFFFFFF) * 1e6 / clock,
+            describe(event, ep, value)))
+        previous = cycles
+
+
+def histogram(name, samples):
+    if not samples:
+        return
+
+    samples.sort()
+    buckets = collections.Counter()
+    for sample in samples:
+        bucket = 0.25
+        while sample > bucket:
+            bucket *= 2
+        buckets[bucket] += 1
+
+    print("%s: %d samples, min %.2f us / median %.2f us / max %.2f us" % (
+        name, len(samples), samples[0], samples[len(samples) // 2], samples[-1]))
+    peak = max(buckets.values())
+    for bucket in sorted(buckets):
+        print("  <= %8.2f us %6d %s" % (bucket, buckets[bucket], "#" * max(1, buckets[bucket] * 40 // peak)))
+
+
+def latencies(entries, clock):
+    since_irq = collections.defaultdict(list)
+    callbacks = collections.defaultdict(list)
+    irq = None
+    entered = {}
+
+    for cycles, event, ep, value in entries:
+        if event == 1:
+            irq = cycles
+            continue
+
+        if irq is not None:
+            since_irq[EVENTS.get(event, "EVENT%d" % event)].append(((cycles - irq) & 0xFFFFFFFF) * 1e6 / clock)
+
+        if event == 7:
+            entered[(ep, value)] = cycles
+        elif event == 8 and (ep, value) in entered:
+            start = entered.pop((ep, value))
+            callbacks["ep%d %s" % (ep, "tx" if value else "rx")].append(((cycles - start) & 0xFFFFFFFF) * 1e6 / clock)
+
+    for name in sorted(since_irq):
+        histogram("irq -> %s" % name, since_irq[name])
+    for name in sorted(callbacks):
+        histogram("callback %s" % name, callbacks[name])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--vid", type=lambda x: int(x, 16), default=0xDEAD, help="vendor id (hex)")
+    parser.add_argument("--pid", type=lambda x: int(x, 16), default=0xBEEF, help="product id (hex)")
+    parser.add_argument("--last", type=int, default=64, help="number of events in the timeline")
+    parser.add_argument("--no-timeline", action="store_true", help="only print the histograms")
+    parser.add_argument("--save", metavar="FILE", help="store the raw trace")
+    parser.add_argument("--load", metavar="FILE", help="read a stored trace instead of the device")
+    args = parser.parse_args()
+
+    if args.load:
+        with open(args.load, "rb") as f:
+            raw = f.read()
+        written, size, _, _, clock = INFO.unpack_from(raw)
+        data = raw[INFO.size:]
+    else:
+        written, size, clock, data = read_trace(args.vid, args.pid)
+
+    if args.save:
+        with open(args.save, "wb") as f:
+            f.write(INFO.pack(written, size, ENTRY.size, 1, clock) + data)
+
+    entries = ordered(written, size, data)
+    print("%d events recorded, %d in the ring @ %.2f MHz" % (written, len(entries), clock / 1e6))
+
+    if not args.no_timeline:
+        timeline(entries, clock, args.last)
+        print()
+    latencies(entries, clock)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -28,4 +28,7 @@ typedef uintptr_t   mem_ptr_t;
 #define PACK_STRUCT_BEGIN
 #define PACK_STRUCT_END
 
+/* The heap & pools are set up by mem_init / memp_init, keep them out of the .bss zero fill */
+#define LWIP_DECLARE_MEMORY_ALIGNED(variable_name, size) u8_t variable_name[LWIP_MEM_ALIGN_BUFFER(size)] __attribute__((section(".noinit")))
+
 #endif /* __ARCH_CC_H__ */
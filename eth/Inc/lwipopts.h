@@ -36,6 +36,9 @@
 #include "lwipopts_test.h"
 #else /* LWIP_OPTTEST_FILE */
 
+/* Window, MSS and pool sizes are derived from the target in lwipprofile.h */
+#include "lwipprofile.h"
+
 #define LWIP_IPV4                  1
 #define LWIP_IPV6                  0
 
@@ -44,10 +47,10 @@
 #define LWIP_NETCONN               (NO_SYS==0)
 #define LWIP_NETIF_API             (NO_SYS==0)
 
-#define LWIP_IGMP                  LWIP_IPV4
+#define LWIP_IGMP                  (LWIP_IPV4 && NET_FULL_STACK)
 #define LWIP_ICMP                  LWIP_IPV4
 
-#define LWIP_SNMP                  LWIP_UDP
+#define LWIP_SNMP                  0
 #define MIB2_STATS                 LWIP_SNMP
 #ifdef LWIP_HAVE_MBEDTLS
 #define LWIP_SNMP_V3               (LWIP_SNMP)
@@ -58,8 +61,8 @@
 
 #define LWIP_NUM_NETIF_CLIENT_DATA (LWIP_MDNS_RESPONDER)
 
-#define LWIP_HAVE_LOOPIF           1
-#define LWIP_NETIF_LOOPBACK        1
+#define LWIP_HAVE_LOOPIF           NET_FULL_STACK
+#define LWIP_NETIF_LOOPBACK        NET_FULL_STACK
 #define LWIP_LOOPBACK_MAX_PBUFS    10
 
 #define TCP_LISTEN_BACKLOG         1
@@ -70,9 +73,9 @@
 
 #define LWIP_TCPIP_CORE_LOCKING    1
 
-#define LWIP_NETIF_LINK_CALLBACK        1
-#define LWIP_NETIF_STATUS_CALLBACK      1
-#define LWIP_NETIF_EXT_STATUS_CALLBACK  1
+#define LWIP_NETIF_LINK_CALLBACK        NET_FULL_STACK
+#define LWIP_NETIF_STATUS_CALLBACK      NET_FULL_STACK
+#define LWIP_NETIF_EXT_STATUS_CALLBACK  NET_FULL_STACK
 
 #ifdef LWIP_DEBUG
 
@@ -118,18 +121,26 @@
 
 /* MEM_SIZE: the size of the heap memory. If the application will send
 a lot of data that needs to be copied, this should be set high. */
-#define MEM_SIZE               (3 * 1024)
+#define MEM_SIZE               NET_MEM_SIZE
 
 /* MEMP_NUM_PBUF: the number of memp struct pbufs. If the application
    sends a lot of data out of ROM (or other static memory), this
    should be set high. */
+#if NET_FULL_STACK
 #define MEMP_NUM_PBUF           10
+#else
+#define MEMP_NUM_PBUF           2
+#endif
 /* MEMP_NUM_RAW_PCB: the number of UDP protocol control blocks. One
    per active RAW "connection". */
 #define MEMP_NUM_RAW_PCB        3
 /* MEMP_NUM_UDP_PCB: the number of UDP protocol control blocks. One
    per active UDP "connection". */
+#if NET_FULL_STACK
 #define MEMP_NUM_UDP_PCB        6
+#else
+#define MEMP_NUM_UDP_PCB        2
+#endif
 /* MEMP_NUM_TCP_PCB: the number of simulatenously active TCP
    connections. */
 #define MEMP_NUM_TCP_PCB        4
@@ -138,10 +149,14 @@ a lot of data that needs to be copied, this should be set high. */
 #define MEMP_NUM_TCP_PCB_LISTEN 4
 /* MEMP_NUM_TCP_SEG: the number of simultaneously queued TCP
    segments. */
-#define MEMP_NUM_TCP_SEG        8
+#define MEMP_NUM_TCP_SEG        TCP_SND_QUEUELEN
 /* MEMP_NUM_SYS_TIMEOUT: the number of simulateously active
    timeouts. */
+#if NET_FULL_STACK
 #define MEMP_NUM_SYS_TIMEOUT    10
+#else
+#define MEMP_NUM_SYS_TIMEOUT    LWIP_NUM_SYS_TIMEOUT_INTERNAL
+#endif
 
 /* The following four are used only with the sequential API and can be
    set to 0 if the application only will use the raw API. */
@@ -158,10 +173,13 @@ a lot of data that needs to be copied, this should be set high. */
 
 /* ---------- Pbuf options ---------- */
 /* PBUF_POOL_SIZE: the number of buffers in the pbuf pool. */
-#define PBUF_POOL_SIZE          16
+#define PBUF_POOL_SIZE          NET_PBUF_POOL_SIZE
 
 /* PBUF_POOL_BUFSIZE: the size of each pbuf in the pbuf pool. */
-#define PBUF_POOL_BUFSIZE       256
+#define PBUF_POOL_BUFSIZE       NET_PBUF_POOL_BUFSIZE
+
+/* Received datagrams can be passed to lwIP without copying them out of the NTB */
+#define LWIP_SUPPORT_CUSTOM_PBUF NCM_RX_ZEROCOPY
 
 /** SYS_LIGHTWEIGHT_PROT
  * define SYS_LIGHTWEIGHT_PROT in lwipopts.h if you want inter-task protection
@@ -172,7 +190,7 @@ a lot of data that needs to be copied, this should be set high. */
 
 
 /* ---------- TCP options ---------- */
-#define LWIP_TCP                1
+#define LWIP_TCP                NET_TCP
 #define TCP_TTL                 255
 
 #define LWIP_ALTCP              (LWIP_TCP)
@@ -187,14 +205,14 @@ a lot of data that needs to be copied, this should be set high. */
 #define TCP_QUEUE_OOSEQ         1
 
 /* TCP Maximum segment size. */
-#define TCP_MSS                 1024
+#define TCP_MSS                 NET_TCP_MSS
 
 /* TCP sender buffer space (bytes). */
-#define TCP_SND_BUF             2048
+#define TCP_SND_BUF             NET_TCP_SND_BUF
 
 /* TCP sender buffer space (pbufs). This must be at least = 2 *
    TCP_SND_BUF/TCP_MSS for things to work. */
-#define TCP_SND_QUEUELEN       (4 * TCP_SND_BUF/TCP_MSS)
+#define TCP_SND_QUEUELEN       (2 * TCP_SND_BUF/TCP_MSS)
 
 /* TCP writable space (bytes). This must be less than or equal
    to TCP_SND_BUF. It is the amount of space which must be
@@ -202,7 +220,7 @@ a lot of data that needs to be copied, this should be set high. */
 #define TCP_SNDLOWAT           (TCP_SND_BUF/2)
 
 /* TCP receive window. */
-#define TCP_WND                 (2 * 1024)
+#define TCP_WND                 NET_TCP_WND
 
 /* Maximum number of retransmissions of data segments. */
 #define TCP_MAXRTX              12
@@ -213,8 +231,13 @@ a lot of data that needs to be copied, this should be set high. */
 
 /* ---------- ARP options ---------- */
 #define LWIP_ARP                1
+#if NET_FULL_STACK
 #define ARP_TABLE_SIZE          10
 #define ARP_QUEUEING            1
+#else
+#define ARP_TABLE_SIZE          2
+#define ARP_QUEUEING            0
+#endif
 
 
 /* ---------- IP options ---------- */
@@ -225,10 +248,10 @@ a lot of data that needs to be copied, this should be set high. */
 
 /* IP reassembly and segmentation.These are orthogonal even
  * if they both deal with IP fragments */
-#define IP_REASSEMBLY           1
-#define IP_REASS_MAX_PBUFS      (10 * ((1500 + PBUF_POOL_BUFSIZE - 1) / PBUF_POOL_BUFSIZE))
+#define IP_REASSEMBLY           NET_FULL_STACK
+#define IP_REASS_MAX_PBUFS      (PBUF_POOL_SIZE / 2)
 #define MEMP_NUM_REASSDATA      IP_REASS_MAX_PBUFS
-#define IP_FRAG                 1
+#define IP_FRAG                 NET_FULL_STACK
 #define IPV6_FRAG_COPYHEADER    1
 
 /* ---------- ICMP options ---------- */
@@ -238,7 +261,7 @@ a lot of data that needs to be copied, this should be set high. */
 /* ---------- DHCP options ---------- */
 /* Define LWIP_DHCP to 1 if you want DHCP configuration of
    interfaces. */
-#define LWIP_DHCP               LWIP_UDP
+#define LWIP_DHCP               (LWIP_UDP && NET_FULL_STACK)
 
 /* 1 if you want to do an ARP check on the offered address
    (recommended). */
@@ -246,24 +269,24 @@ a lot of data that needs to be copied, this should be set high. */
 
 
 /* ---------- AUTOIP options ------- */
-#define LWIP_AUTOIP            (LWIP_DHCP)
+#define LWIP_AUTOIP            1
 #define LWIP_DHCP_AUTOIP_COOP  (LWIP_DHCP && LWIP_AUTOIP)
 
 
 /* ---------- UDP options ---------- */
 #define LWIP_UDP                1
-#define LWIP_UDPLITE            LWIP_UDP
+#define LWIP_UDPLITE            (LWIP_UDP && NET_FULL_STACK)
 #define UDP_TTL                 255
 
 
 /* ---------- RAW options ---------- */
-#define LWIP_RAW                1
+#define LWIP_RAW                NET_FULL_STACK
 
 
 /* ---------- Statistics options ---------- */
 
-#define LWIP_STATS              1
-#define LWIP_STATS_DISPLAY      1
+#define LWIP_STATS              NET_FULL_STACK
+#define LWIP_STATS_DISPLAY      NET_FULL_STACK
 
 #if LWIP_STATS
 #define LINK_STATS              1
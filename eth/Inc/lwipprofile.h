@@ -0,0 +1,148 @@
+#ifndef LWIP_LWIPPROFILE_H
+#define LWIP_LWIPPROFILE_H
+
+/*
+ * Memory profiles for the NCM interface and lwIP.
+ *
+ * Every profile only describes the target: how much RAM the linker script
+ * gives it, the MTU and how the NTB buffers are laid out. Window, MSS and
+ * pool sizes are derived from that description below, so the TCP window
+ * always matches what the pbuf pool can actually hold. Whether the rest of
+ * the firmware still fits next to it is left to the linker, see the
+ * --print-memory-usage report of the build.
+ *
+ * The profile follows the MCU, define LWIP_PROFILE to override it. The slim
+ * NCM build (NCM_SLIM) always uses the minimal profile.
+ */
+#define LWIP_PROFILE_MINIMAL    1
+#define LWIP_PROFILE_BALANCED   2
+#define LWIP_PROFILE_THROUGHPUT 3
+
+#ifndef LWIP_PROFILE
+#if defined(NCM_SLIM)
+#define LWIP_PROFILE LWIP_PROFILE_MINIMAL
+#elif defined(STM32G474xx)
+#define LWIP_PROFILE LWIP_PROFILE_THROUGHPUT
+#elif defined(STM32G441xx)
+#define LWIP_PROFILE LWIP_PROFILE_BALANCED
+#else
+#define LWIP_PROFILE LWIP_PROFILE_MINIMAL
+#endif
+#endif
+
+/* ---------- Target description ---------- */
+#if LWIP_PROFILE == LWIP_PROFILE_THROUGHPUT
+/* stm32g474: 128K RAM, bulk throughput first. The top 4K are used as CCM-SRAM */
+#define NET_RAM_SIZE            (124 * 1024)
+#define NET_MTU                 1500
+#define NCM_NTB_SIZE            4096
+#define NCM_NTB_RX_COUNT        3
+#define NCM_NTB_TX_COUNT        3
+#define NCM_NTB_MAX_DATAGRAMS   16
+#define NET_RX_SEGMENTS         16
+#define NET_TX_SEGMENTS         16
+#define NET_TCP                 1
+#define NET_FULL_STACK          1
+#define NCM_RX_ZEROCOPY         0
+#define NCM_TX_PMA              0
+
+#elif LWIP_PROFILE == LWIP_PROFILE_BALANCED
+/* stm32g441: 32K RAM, shared with the application. The top 2K are used as
+ * CCM-SRAM, one TX NTB and two TX segments leave room for the DMX universes */
+#define NET_RAM_SIZE            (30 * 1024)
+#define NET_MTU                 1500
+#define NCM_NTB_SIZE            2048
+#define NCM_NTB_RX_COUNT        2
+#define NCM_NTB_TX_COUNT        1
+#define NCM_NTB_MAX_DATAGRAMS   10
+#define NET_RX_SEGMENTS         3
+#define NET_TX_SEGMENTS         2
+#define NET_TCP                 1
+#define NET_FULL_STACK          1
+#define NCM_RX_ZEROCOPY         0
+#define NCM_TX_PMA              0
+
+#elif LWIP_PROFILE == LWIP_PROFILE_MINIMAL
+/* stm32f042: 6K RAM, UDP & ICMP only. Datagrams are passed to lwIP in place
+ * and the TX NTB lives in the USB-SRAM next to the endpoint buffers */
+#define NET_RAM_SIZE            (6 * 1024)
+#define NET_MTU                 576
+#define NCM_NTB_SIZE            640
+#define NCM_NTB_RX_COUNT        1
+#define NCM_NTB_TX_COUNT        1
+#define NCM_NTB_MAX_DATAGRAMS   4
+#define NET_RX_SEGMENTS         1
+#define NET_TX_SEGMENTS         1
+#define NET_TCP                 0
+#define NET_FULL_STACK          0
+#define NCM_RX_ZEROCOPY         1
+#define NCM_TX_PMA              1
+
+#else
+#error "Unknown LWIP_PROFILE"
+#endif
+
+/* ---------- Derived sizes ---------- */
+/* Ethernet frame as carried in an NTB datagram */
+#define NET_FRAME_SIZE          (NET_MTU + 14)
+#define NET_ALIGN4(x)           (((x) + 3) & ~3)
+
+#if NCM_RX_ZEROCOPY
+/* Received datagrams reference the NTB, the driver never allocates from the pool */
+#define NET_PBUF_POOL_BUFSIZE   64
+#define NET_PBUF_POOL_SIZE      1
+/* One custom pbuf per datagram that may be held while the NTB drains */
+#define NET_RX_PBUFS            (NCM_NTB_RX_COUNT * NCM_NTB_MAX_DATAGRAMS)
+#else
+/* One pool pbuf holds one complete frame, so a datagram never spans a chain */
+#define NET_PBUF_POOL_BUFSIZE   NET_ALIGN4(NET_FRAME_SIZE)
+/* The receive window is backed by pool pbufs, keep two spare for ARP & ICMP */
+#define NET_PBUF_POOL_SIZE      (NET_RX_SEGMENTS + 2)
+#define NET_RX_PBUFS            0
+#endif
+
+#define NET_TCP_MSS             (NET_MTU - 40)
+#define NET_TCP_WND             (NET_RX_SEGMENTS * NET_TCP_MSS)
+#define NET_TCP_SND_BUF         (NET_TX_SEGMENTS * NET_TCP_MSS)
+
+/* Unacked TX data lives in the heap, plus headroom for headers and UDP replies */
+#if NET_TCP
+#define NET_MEM_SIZE            NET_ALIGN4(NET_TCP_SND_BUF + NET_TX_SEGMENTS * 64 + 1024)
+#else
+#define NET_MEM_SIZE            NET_ALIGN4(NET_FRAME_SIZE + 128)
+#endif
+
+/* ---------- Static RAM checks ---------- */
+/* Upper bounds for the lwIP 2.1 pool elements on a 32 bit target */
+#if NCM_TX_PMA
+#define NET_RAM_NCM             (NCM_NTB_SIZE * NCM_NTB_RX_COUNT)
+#else
+#define NET_RAM_NCM             (NCM_NTB_SIZE * (NCM_NTB_RX_COUNT + NCM_NTB_TX_COUNT))
+#endif
+#define NET_RAM_POOL            (NET_PBUF_POOL_SIZE * (NET_PBUF_POOL_BUFSIZE + 24) + NET_RX_PBUFS * 28)
+#define NET_RAM_HEAP            NET_MEM_SIZE
+#if NET_TCP
+#define NET_RAM_TCP             (4 * 176 + 2 * 32 + 2 * NET_TX_SEGMENTS * 24)
+#else
+#define NET_RAM_TCP             0
+#endif
+#define NET_RAM_TOTAL           (NET_RAM_NCM + NET_RAM_POOL + NET_RAM_HEAP + NET_RAM_TCP)
+
+#if NET_TCP && (NET_TCP_WND > 0xFFFF)
+#error "NET_RX_SEGMENTS exceeds the TCP window without window scaling"
+#endif
+
+#if NET_TCP && (NET_TX_SEGMENTS < 2 || NET_RX_SEGMENTS < 2)
+#error "lwIP needs at least two segments of send buffer and receive window"
+#endif
+
+#if NCM_NTB_SIZE < (NET_FRAME_SIZE + 12 + 8 + 4 * (NCM_NTB_MAX_DATAGRAMS + 1) + 4)
+#error "NCM_NTB_SIZE can not hold a full frame plus NTB header and NDP"
+#endif
+
+/* Only networking itself is checked here, the linker fails on ._user_heap_stack if the whole firmware does not fit */
+#if NET_RAM_TOTAL > NET_RAM_SIZE
+#error "The selected lwIP profile does not fit into NET_RAM_SIZE"
+#endif
+
+#endif /* LWIP_LWIPPROFILE_H */